@@ -1,38 +1,20 @@
 #include "apu.h"
-#include <SDL3/SDL_audio.h>
+#include "nes.h"
 #include <stdio.h>
 
 #define CPU_FREQUENCY 1789773
 
-static SDL_AudioDeviceID device;
-static SDL_AudioStream *stream;
-
 bool apu_init(nes_apu_t *apu)
 {
-	
-    SDL_AudioSpec dev_spec;
-    dev_spec.freq = 44100;
-    dev_spec.format = SDL_AUDIO_F32;
-    dev_spec.channels = 2;
-
-    device = SDL_OpenAudioDevice(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &dev_spec);
-    if (!device) {
-        return false;
-    }
-
-    SDL_AudioSpec src_spec;
-    src_spec.freq = 44100;
-    src_spec.format = SDL_AUDIO_F32;
-    src_spec.channels = 1;
-
-    stream = SDL_CreateAudioStream(&src_spec, NULL);
-    if (!stream) {
-        SDL_CloseAudioDevice(device);
-        return false;
-    }
-
 	apu->status = 0;
 
+	apu->frame_five_step = false;
+	apu->frame_irq_inhibit = false;
+	apu->frame_irq = false;
+
+	apu->num_samples = 0;
+	apu->sample_clock = 0;
+
 	return true;
 }
 
@@ -40,3 +22,25 @@ void apu_pulse_play(nes_apu_t *apu, nes_apu_pulse_t *pulse)
 {
 
 }
+
+// Mix of all channels, none of them produce output yet
+static float apu_mix(nes_apu_t *apu)
+{
+	return 0.0f;
+}
+
+/*
+Called once per APU cycle, downsamples the APU output to APU_SAMPLE_RATE
+*/
+void apu_output_sample(nes_apu_t *apu)
+{
+	apu->sample_clock += (uint64_t)APU_SAMPLE_RATE * MASTER_CLOCKS_PER_APU_CLOCK;
+	if (apu->sample_clock < MASTER_CLOCK_PER_SEC) {
+		return;
+	}
+
+	apu->sample_clock -= MASTER_CLOCK_PER_SEC;
+	if (apu->num_samples < APU_SAMPLE_BUFFER_SIZE) {
+		apu->samples[apu->num_samples++] = apu_mix(apu);
+	}
+}
@@ -23,6 +23,15 @@
 
 #define MASTER_CLOCKS_PER_APU_CLOCK 24
 
+// In CPU cycles, for the 4-step frame counter sequence
+#define APU_FRAME_IRQ_CYCLES 29829
+#define APU_FRAME_SEQUENCE_CYCLES 29830
+
+#define APU_SAMPLE_RATE 44100
+
+// Enough for one frame of samples at APU_SAMPLE_RATE
+#define APU_SAMPLE_BUFFER_SIZE 1024
+
 typedef struct {
 	int duty : 2;
 	bool loop : 1;
@@ -42,9 +51,21 @@ typedef struct {
 	nes_apu_pulse_t pulse1;
 	nes_apu_pulse_t pulse2;
 	uint8_t status;
+
+	// Frame counter
+	bool frame_five_step;
+	bool frame_irq_inhibit;
+	bool frame_irq;
+
+	// Output samples for the current frame. sample_clock counts master
+	// clocks (scaled by the sample rate) towards the next sample
+	float samples[APU_SAMPLE_BUFFER_SIZE];
+	uint32_t num_samples;
+	uint64_t sample_clock;
 } nes_apu_t;
 
 
 bool apu_init(nes_apu_t *);
 void apu_pulse_play(nes_apu_t *, nes_apu_pulse_t *pulse);
+void apu_output_sample(nes_apu_t *);
 #endif // APU_INCLUDE
@@ -2,18 +2,32 @@
 #include "instructions.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
-void cpu_init(nes_cpu_t *cpu, nes_memory_t *memory, nes_ppu_t *ppu, nes_apu_t *apu)
+void cpu_init(nes_cpu_t *cpu, nes_memory_t *memory, nes_ppu_t *ppu, nes_apu_t *apu, nes_scheduler_t *scheduler)
 {
 	cpu->mem = memory;
 	cpu->ppu = ppu;
 	cpu->apu = apu;
+	cpu->scheduler = scheduler;
 
 	cpu->sp = 0xfd;
 
+	// IRQs start off masked, everything else clear
+	cpu_set_flag(cpu, FLAG_I, 1);
+	cpu_set_flag(cpu, FLAG_Z, 0);
+
 	cpu->wait_cycles = 7;
+	cpu->frame_cycle = 0;
+	cpu->halted = false;
+	cpu->irq_input = false;
+	cpu->nmi_input = false;
 	cpu->total_cycles = 0;
 	cpu->total_cycles += cpu->wait_cycles;
+
+	#ifdef DEBUG
+	cpu->debug_file = NULL;
+	#endif
 }
 
 void cpu_reset(nes_cpu_t *cpu)
@@ -24,9 +38,10 @@ void cpu_reset(nes_cpu_t *cpu)
 
 static void do_irq_interrupt(nes_cpu_t *cpu)
 {
-	instr_SEI(cpu, 1);
+	cpu->wait_cycles += 7;
 	oper_push_16(cpu, cpu->pc);
 	oper_push_8(cpu, cpu_get_sr(cpu));
+	cpu_set_flag(cpu, FLAG_I, 1);
 	cpu->pc = mem_read_16(cpu, IRQ_INTERRUPT_VECTOR_ADDR);
 }
 
@@ -37,17 +52,22 @@ static void do_nmi_interrupt(nes_cpu_t *cpu)
 	oper_push_8(cpu, cpu_get_sr(cpu));
 	cpu->pc = mem_read_16(cpu, NMI_INTERRUPT_VECTOR_ADDR);
 	cpu->ppu->triggered_NMI = true;
+	cpu->nmi_input = false;
 }
 
+/*
+The interrupt lines are driven by the PPU / APU through scheduled events and
+register accesses, so this only has to look at the lines themselves
+*/
 void cpu_check_interrupts(nes_cpu_t *cpu)
 {
 	// NMI interrupt
-	if (cpu->ppu->in_vblank && cpu->ppu->NMI_output && !cpu->ppu->triggered_NMI) {
+	if (cpu->nmi_input) {
 		do_nmi_interrupt(cpu);
 	}
 
 	// IRQ interrupt
-	if (!get_flag(cpu, FLAG_I) && cpu->irq_input) {
+	if (!cpu_get_flag(cpu, FLAG_I) && cpu->irq_input) {
 		do_irq_interrupt(cpu);
 	}
 }
@@ -145,7 +165,7 @@ static void (*const opcode_table[256])(nes_cpu_t *, uint32_t) = {
 #endif
 
 
-static const uint8_t size_table[256] = {
+const uint8_t cpu_size_table[256] = {
 //      0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
 /* 00*/	2, 2, 0, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3, // good
 /* 10*/	2, 2, 0, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3, // good
@@ -165,7 +185,7 @@ static const uint8_t size_table[256] = {
 /* F0*/	2, 2, 0, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3
 };
 
-static const uint8_t cycle_count_table[256] = {
+const uint8_t cpu_cycle_count_table[256] = {
 //      0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
 /*00*/	2, 6, 2, 2, 2, 3, 5, 2, 3, 2, 2, 2, 4, 4, 6, 2,
 		2, 5, 2, 2, 4, 4, 6, 2, 2, 4, 2, 2, 4, 4, 7, 2,
@@ -189,7 +209,7 @@ static const uint8_t cycle_count_table[256] = {
 uint32_t cpu_fetch_instruction(nes_cpu_t *cpu)
 {
 	uint8_t op = mem_read_8(cpu, cpu->pc);
-	uint8_t sz = size_table[op];
+	uint8_t sz = cpu_size_table[op];
 	uint32_t final_opcode = op << 16;
 
 	if (sz == 2) {
@@ -209,13 +229,13 @@ void cpu_execute_instruction(nes_cpu_t *cpu, uint32_t instruction)
 
 #ifdef DEBUG
 #include "disassembler.h"
-static FILE *debug_file = NULL;
 void log_debug_info(nes_cpu_t *cpu, uint32_t instr, uint16_t iaddr)
 {
-	if (!debug_file) {
-		debug_file = fopen("debug/path.log", "w+");
+	if (!cpu->debug_file) {
+		cpu->debug_file = fopen("debug/path.log", "w+");
 	}
-	int sz = size_table[instr >> 16];
+	FILE *debug_file = cpu->debug_file;
+	int sz = cpu_size_table[instr >> 16];
 
 	char disasm_buf[32];
 	disasm_instr(instr, disasm_buf, sizeof(disasm_buf), cpu->pc);
@@ -247,11 +267,61 @@ void cpu_update_registers(nes_cpu_t *cpu, uint8_t key_state)
 }
 
 
-void cpu_run_cycle(nes_cpu_t *cpu)
+static void cpu_decode_instruction(uint32_t instr, uint16_t generation, decoded_instr_t *out)
 {
-	uint32_t instr = cpu_fetch_instruction(cpu);
 	uint8_t op = (instr >> 16) & 0xff;
-	uint8_t sz = size_table[op];
+
+	out->handler = opcode_table[op];
+	out->instr = instr;
+	out->size = cpu_size_table[op];
+	out->cycles = cpu_cycle_count_table[op];
+	out->generation = generation;
+}
+
+/*
+Returns the decode cache entry for the instruction at PC, decoding it first if
+the entry is stale, or NULL if PC isn't in the cached range. The last two
+bytes are left out since an instruction there would take its operand from RAM.
+*/
+static const decoded_instr_t *cpu_lookup_decoded(nes_cpu_t *cpu)
+{
+	nes_memory_t *mem = cpu->mem;
+	uint16_t pc = cpu->pc;
+
+	if (pc < DECODE_CACHE_START || pc > 0xfffd) {
+		return NULL;
+	}
+
+	if (mem->decode_writes != mem->shared_writes) {
+		mem->decode_writes = mem->shared_writes;
+		mem->decode_generation++;
+
+		// generations are about to repeat, so clear out the old entries
+		if (mem->decode_generation == 0) {
+			memset(mem->decoded, 0, DECODE_CACHE_SIZE * sizeof(decoded_instr_t));
+			mem->decode_generation = 1;
+		}
+	}
+
+	decoded_instr_t *entry = &mem->decoded[pc - DECODE_CACHE_START];
+	if (entry->generation != mem->decode_generation) {
+		cpu_decode_instruction(cpu_fetch_instruction(cpu), mem->decode_generation, entry);
+	}
+
+	return entry;
+}
+
+void cpu_run_cycle(nes_cpu_t *cpu)
+{
+	decoded_instr_t uncached;
+	const decoded_instr_t *decoded = cpu_lookup_decoded(cpu);
+	if (!decoded) {
+		cpu_decode_instruction(cpu_fetch_instruction(cpu), 0, &uncached);
+		decoded = &uncached;
+	}
+
+	uint32_t instr = decoded->instr;
+	uint8_t sz = decoded->size;
 
 	cpu->pc += sz;
 
@@ -259,8 +329,8 @@ void cpu_run_cycle(nes_cpu_t *cpu)
 	log_debug_info(cpu, instr, cpu->pc - sz);
 	#endif
 
-	int instr_cycle_count = cycle_count_table[op];
-	cpu_execute_instruction(cpu, instr);
+	int instr_cycle_count = decoded->cycles;
+	decoded->handler(cpu, instr);
 
 	cpu->wait_cycles += instr_cycle_count;
 	cpu->total_cycles += cpu->wait_cycles;
@@ -268,13 +338,92 @@ void cpu_run_cycle(nes_cpu_t *cpu)
 	cpu_check_interrupts(cpu);
 }
 
+// Whether an idle loop can read from address without anything changing
+static bool cpu_idle_loop_reads(uint16_t address, bool *reads_ppustatus)
+{
+	if (address < 0x2000 || address >= 0x6000) {
+		return true;
+	}
+
+	// PPUSTATUS and its mirrors
+	if (address < 0x4000 && (address & 7) == (PPUSTATUS_ADDR & 7)) {
+		*reads_ppustatus = true;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+Looks for an idle loop starting at pc: up to CPU_IDLE_LOOP_MAX_OPS
+instructions in PRG ROM that only change A/X/Y and C/Z/V/N, read nothing but
+RAM, ROM and PPUSTATUS (at fixed addresses), and end with a branch or JMP
+back to pc. Any other branch is taken to leave the loop. Increments and
+decrements are left out, a loop with one never comes round the same way twice.
+*/
+bool cpu_find_idle_loop(const uint8_t *mem, uint16_t pc, cpu_idle_loop_t *loop)
+{
+	loop->pc = pc;
+	loop->cycles = 0;
+	loop->reads_ppustatus = false;
+
+	uint16_t at = pc;
+	for (int i = 0; i < CPU_IDLE_LOOP_MAX_OPS; i++) {
+		if (at < CPU_BLOCK_CACHE_START || at > 0xfffd) {
+			return false;
+		}
+
+		uint8_t op = mem[at];
+		uint16_t next = at + cpu_size_table[op];
+		uint16_t address = mem[at + 1] | (mem[at + 2] << 8);
+		loop->cycles += cpu_cycle_count_table[op];
+
+		switch (op) {
+			// branches, taken with a page cross is 2 cycles more
+			case 0x10: case 0x30: case 0x50: case 0x70:
+			case 0x90: case 0xB0: case 0xD0: case 0xF0:
+				if ((uint16_t)(next + (int8_t)mem[at + 1]) == pc) {
+					loop->cycles += (next & 0xff) + mem[at + 1] > 0xff ? 2 : 1;
+					return true;
+				}
+				break;
+			// JMP abs
+			case 0x4C:
+				return address == pc;
+			// immediate and implied
+			case 0xA9: case 0xA2: case 0xA0: case 0x29: case 0x09: case 0x49:
+			case 0x69: case 0xE9: case 0xC9: case 0xE0: case 0xC0:
+			case 0xAA: case 0x8A: case 0xA8: case 0x98: case 0xBA:
+			case 0x18: case 0x38: case 0xB8: case 0xEA:
+			case 0x0A: case 0x4A: case 0x2A: case 0x6A:
+			// zero page
+			case 0xA5: case 0xA6: case 0xA4: case 0x25: case 0x05: case 0x45:
+			case 0x65: case 0xE5: case 0xC5: case 0xE4: case 0xC4: case 0x24:
+				break;
+			// absolute
+			case 0xAD: case 0xAE: case 0xAC: case 0x2D: case 0x0D: case 0x4D:
+			case 0x6D: case 0xED: case 0xCD: case 0xEC: case 0xCC: case 0x2C:
+				if (!cpu_idle_loop_reads(address, &loop->reads_ppustatus)) {
+					return false;
+				}
+				break;
+			default:
+				return false;
+		}
+
+		at = next;
+	}
+
+	return false;
+}
+
 uint8_t cpu_get_sr(nes_cpu_t *cpu) {
 	return 	cpu->flags[FLAG_C] |
-			(cpu->flags[FLAG_Z] << 1) |
+			(cpu_get_flag(cpu, FLAG_Z) << 1) |
 			(cpu->flags[FLAG_I] << 2) |
 			(cpu->flags[FLAG_D] << 3) |
 			(cpu->flags[FLAG_V] << 6) |
-			(cpu->flags[FLAG_N] << 7);
+			(cpu->n_result & 0x80);
 }
 
 static inline uint8_t __get_bit_8(uint8_t byte, int bit) 
@@ -284,17 +433,19 @@ static inline uint8_t __get_bit_8(uint8_t byte, int bit)
 
 void cpu_set_sr(nes_cpu_t *cpu, uint8_t flags)
 {
-	set_flag(cpu, FLAG_C, __get_bit_8(flags, 0));
-	set_flag(cpu, FLAG_Z, __get_bit_8(flags, 1));
-	set_flag(cpu, FLAG_I, __get_bit_8(flags, 2));
-	set_flag(cpu, FLAG_D, __get_bit_8(flags, 3));
-	set_flag(cpu, FLAG_V, __get_bit_8(flags, 6));
-	set_flag(cpu, FLAG_N, __get_bit_8(flags, 7));
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(flags, 0));
+	cpu_set_flag(cpu, FLAG_Z, __get_bit_8(flags, 1));
+	cpu_set_flag(cpu, FLAG_I, __get_bit_8(flags, 2));
+	cpu_set_flag(cpu, FLAG_D, __get_bit_8(flags, 3));
+	cpu_set_flag(cpu, FLAG_V, __get_bit_8(flags, 6));
+	cpu_set_flag(cpu, FLAG_N, __get_bit_8(flags, 7));
 }
 
 void cpu_cleanup(nes_cpu_t *cpu)
 {
 	#ifdef DEBUG
-	fclose(debug_file);
+	if (cpu->debug_file) {
+		fclose(cpu->debug_file);
+	}
 	#endif
 }
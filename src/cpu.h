@@ -6,14 +6,19 @@
 #include "memory.h"
 #include "ppu.h"
 #include "apu.h"
+#include "scheduler.h"
 
 #define CPU_IMPLEMENT_ILLEGAL_OPCODES
 
+// CPU cycles the CPU is halted for by an OAM DMA
+#define OAM_DMA_CYCLES 513
+
 #define NMI_INTERRUPT_VECTOR_ADDR 0xFFFA
 #define RESET_VECTOR_ADDR 0xFFFC
 #define IRQ_INTERRUPT_VECTOR_ADDR 0xFFFE
 
 #define MASTER_CLOCKS_PER_CPU_CLOCK 12
+#define PPU_DOTS_PER_CPU_CYCLE (MASTER_CLOCKS_PER_CPU_CLOCK / MASTER_CLOCKS_PER_PPU_CLOCK)
 
 #define FLAG_N 7
 #define FLAG_V 6
@@ -40,18 +45,30 @@ typedef struct __nes_cpu {
 	uint8_t y;
 	uint8_t sp;
 
-	// Flags (pretty self explanatory)
+	// Flags (pretty self explanatory). N and Z aren't kept in here, most
+	// instructions set them and the next one overwrites them unread, so all
+	// that's stored is the result they come from (see cpu_get_flag)
 	uint8_t flags[CPU_NUM_FLAGS];
+	uint8_t n_result;
+	uint8_t z_result;
 
 	// Handles to other components
 	// TODO: Abstract this out into a bus probably
 	nes_memory_t *mem;
 	nes_ppu_t *ppu;
 	nes_apu_t *apu;
+	nes_scheduler_t *scheduler;
 
 	uint32_t wait_cycles;
 	uint32_t total_cycles;
 
+	// CPU cycle (within the frame) the current instruction started on
+	uint32_t frame_cycle;
+
+	// Set while OAM DMA owns the bus. The CPU's remaining wait cycles are
+	// frozen until EVENT_OAM_DMA_END
+	bool halted;
+
 	mmc_type_t mmc_type;
 
 	// Input key state management
@@ -60,9 +77,189 @@ typedef struct __nes_cpu {
 	bool strobe_keys;
 	int strobe_keys_write_no;
 	bool irq_input;
+	bool nmi_input;
+
+	#ifdef DEBUG
+	FILE *debug_file;
+	#endif
 } nes_cpu_t;
 
-void cpu_init(nes_cpu_t *, nes_memory_t *, nes_ppu_t *, nes_apu_t *);
+static inline bool cpu_get_flag(const nes_cpu_t *cpu, int flag)
+{
+	switch (flag) {
+	case FLAG_N:
+		return cpu->n_result >> 7;
+	case FLAG_Z:
+		return cpu->z_result == 0;
+	default:
+		return cpu->flags[flag];
+	}
+}
+
+static inline void cpu_set_flag(nes_cpu_t *cpu, int flag, bool enable)
+{
+	switch (flag) {
+	case FLAG_N:
+		cpu->n_result = enable << 7;
+		break;
+	case FLAG_Z:
+		cpu->z_result = !enable;
+		break;
+	default:
+		cpu->flags[flag] = enable;
+		break;
+	}
+}
+
+// N and Z as an instruction leaves them, from its 8 bit result
+static inline void cpu_set_nz(nes_cpu_t *cpu, uint8_t result)
+{
+	cpu->n_result = result;
+	cpu->z_result = result;
+}
+
+// Leaves N and Z the way cpu_set_flag would, so CPUs with the same flags
+// are also byte for byte the same
+static inline void cpu_normalize_nz(nes_cpu_t *cpu)
+{
+	cpu_set_flag(cpu, FLAG_N, cpu_get_flag(cpu, FLAG_N));
+	cpu_set_flag(cpu, FLAG_Z, cpu_get_flag(cpu, FLAG_Z));
+}
+
+// Instruction sizes and base cycle counts by opcode
+extern const uint8_t cpu_size_table[256];
+extern const uint8_t cpu_cycle_count_table[256];
+
+/*
+The threaded core translates straight-line code in PRG ROM into blocks of
+pre-decoded micro-ops, up to the next branch, indirect jump, JSR/RTS/RTI or
+CPU_BLOCK_MAX_OPS instructions (following JMP abs), and keeps them here keyed
+by the PC they start at. Pairs of instructions that often run back to back
+are fused into one micro-op. Like the decode cache, the blocks are thrown
+away whenever memory.shared_writes moves, which any write that could reach
+ROM does.
+*/
+#define CPU_BLOCK_CACHE_START 0x8000
+#define CPU_BLOCK_CACHE_SIZE (ADDRESS_SPACE_SIZE_6502 - CPU_BLOCK_CACHE_START)
+#define CPU_BLOCK_MAX_OPS 32
+#define CPU_BLOCK_CACHE_OPS 0x10000
+
+typedef struct {
+	// Opcode, or one of the fused / internal micro-ops in cpu_threaded.c
+	uint16_t id;
+	uint8_t op;
+	uint8_t cycles;
+	uint16_t imm16;
+	uint16_t pc;
+	uint16_t next_pc;
+} cpu_uop_t;
+
+typedef struct {
+	uint32_t start;
+	uint32_t generation;
+} cpu_block_entry_t;
+
+typedef struct {
+	// By PC - CPU_BLOCK_CACHE_START, valid when the generation matches
+	cpu_block_entry_t *blocks;
+
+	cpu_uop_t *ops;
+	uint32_t num_ops;
+
+	uint32_t generation;
+	// memory.shared_writes as of the current generation
+	uint32_t memory_writes;
+} cpu_block_cache_t;
+
+/*
+The JIT compiles the same PRG ROM blocks to native code, on x86-64 hosts with
+the System V ABI. Anywhere else cpu_jit_init fails and the threaded core has
+to be used instead.
+*/
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(NESEMU_LINUX) || defined(NESEMU_MACOS))
+#define CPU_JIT_AVAILABLE
+#endif
+
+typedef struct {
+	uint8_t *code;
+	size_t code_size;
+	size_t code_used;
+	// Where the entry / dispatcher / exit code in front of the blocks is, and where blocks start
+	size_t dispatch_offset;
+	size_t exit_offset;
+	size_t code_start;
+	// The code buffer is either writable or executable, never both
+	bool writable;
+
+	// By PC - CPU_BLOCK_CACHE_START, NULL until compiled
+	uint8_t **blocks;
+	// Also by PC, set where jit_compile gave up on the first instruction
+	bool *refused;
+
+	// memory.shared_writes and the mapper the blocks were compiled for
+	uint32_t memory_writes;
+	mmc_type_t mmc_type;
+} cpu_jit_t;
+
+/*
+A ROM-specific core can have the ROM's code compiled in ahead of time, as C
+written by nesemu-headless --recompile (see recompiler.h) with one function
+per basic block. Blocks are only run while 0x8000-0xffff still holds what
+they were compiled from.
+*/
+typedef struct {
+	uint8_t *mem;
+	uint64_t *dirty;
+	bool drop_writes;
+
+	uint32_t cycle;
+	uint32_t end_cycle;
+	// the cycle the last instruction started on, for nes_cpu_t.frame_cycle
+	uint32_t frame_cycle;
+
+	uint16_t pc;
+	uint8_t a, x, y, sp;
+	uint8_t fc, fz, fi, fd, fv, fn;
+} cpu_aot_regs_t;
+
+typedef void (*cpu_aot_block_t)(cpu_aot_regs_t *);
+
+typedef struct {
+	// hash_bytes of 0x8000-0xffff as the blocks were compiled from
+	uint64_t rom_hash;
+
+	// By PC - CPU_BLOCK_CACHE_START, NULL where there's no block
+	const cpu_aot_block_t *blocks;
+	uint32_t num_blocks;
+} cpu_aot_program_t;
+
+typedef struct {
+	const cpu_aot_program_t *program;
+
+	// memory.shared_writes when the ROM was last checked against the program
+	uint32_t memory_writes;
+	bool rom_matches;
+} cpu_aot_t;
+
+/*
+An idle loop waits for an interrupt or the PPU by reading the same things
+over and over without writing anything (see cpu_find_idle_loop). Once it has
+come round to its start twice with the registers the same, it keeps doing so
+until the next scheduled event changes something, so the frame loop skips
+straight to the last time round before that. The fast cores leave these
+loops to the reference handlers, where that happens.
+*/
+#define CPU_IDLE_LOOP_MAX_OPS 8
+
+typedef struct {
+	uint16_t pc;
+	// Cycles a time round takes when no other branch is taken
+	uint32_t cycles;
+	// PPUSTATUS only reads the same while sprite 0 hit can't change
+	bool reads_ppustatus;
+} cpu_idle_loop_t;
+
+void cpu_init(nes_cpu_t *, nes_memory_t *, nes_ppu_t *, nes_apu_t *, nes_scheduler_t *);
 void cpu_reset(nes_cpu_t *);
 void cpu_run_cycle(nes_cpu_t *);
 void cpu_check_interrupts(nes_cpu_t *);
@@ -70,6 +267,21 @@ uint32_t cpu_fetch_instruction(nes_cpu_t *);
 void cpu_execute_instruction(nes_cpu_t *, uint32_t);
 void cpu_update_registers(nes_cpu_t *, uint8_t);
 void cpu_cleanup(nes_cpu_t *);
+bool cpu_find_idle_loop(const uint8_t *, uint16_t, cpu_idle_loop_t *);
+
+// cpu_threaded.c
+bool cpu_block_cache_init(cpu_block_cache_t *);
+void cpu_block_cache_cleanup(cpu_block_cache_t *);
+uint32_t cpu_run_threaded(nes_cpu_t *, cpu_block_cache_t *, uint32_t, uint32_t);
+
+// cpu_jit.c
+bool cpu_jit_init(cpu_jit_t *);
+void cpu_jit_cleanup(cpu_jit_t *);
+uint32_t cpu_run_jit(nes_cpu_t *, cpu_jit_t *, cpu_block_cache_t *, uint32_t, uint32_t);
+
+// cpu_aot.c
+bool cpu_aot_init(cpu_aot_t *);
+uint32_t cpu_run_aot(nes_cpu_t *, cpu_aot_t *, cpu_block_cache_t *, uint32_t, uint32_t);
 
 uint8_t cpu_get_sr(nes_cpu_t *);
 void cpu_set_sr(nes_cpu_t *, uint8_t);
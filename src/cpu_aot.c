@@ -0,0 +1,111 @@
+#include "cpu.h"
+#include "utils.h"
+
+/*
+Runs a ROM's code from the blocks the recompiler wrote for it (see
+cpu.h / cpu_aot.h), and everything they don't cover through the threaded
+core. The blocks only exist in a core built with AOT_SRC (see the Makefile),
+otherwise cpu_aot_init fails.
+*/
+
+#ifdef CPU_AOT_PROGRAM
+extern const cpu_aot_program_t cpu_aot_program;
+#endif
+
+bool cpu_aot_init(cpu_aot_t *aot)
+{
+	#ifdef CPU_AOT_PROGRAM
+	aot->program = &cpu_aot_program;
+	aot->memory_writes = 0;
+	aot->rom_matches = false;
+	return true;
+	#else
+	aot->program = NULL;
+	return false;
+	#endif
+}
+
+static inline cpu_aot_block_t cpu_aot_lookup(const cpu_aot_program_t *program, uint16_t pc)
+{
+	if ((uint16_t)(pc - CPU_BLOCK_CACHE_START) >= CPU_BLOCK_CACHE_SIZE) {
+		return NULL;
+	}
+
+	return program->blocks[pc - CPU_BLOCK_CACHE_START];
+}
+
+/*
+Same contract as cpu_run_threaded. Blocks run back to back for as long as
+there's one for the PC and no interrupt is due, the rest is stepped through
+the threaded core until end_cycle or something only the reference handlers
+can run.
+*/
+uint32_t cpu_run_aot(nes_cpu_t *cpu, cpu_aot_t *aot, cpu_block_cache_t *cache, uint32_t cpu_cycle, uint32_t end_cycle)
+{
+	const cpu_aot_program_t *program = aot->program;
+	uint8_t *mem = cpu->mem->data;
+
+	// nothing run here writes outside RAM, so this can only change in between
+	if (aot->memory_writes != cpu->mem->shared_writes) {
+		aot->memory_writes = cpu->mem->shared_writes;
+		aot->rom_matches = hash_bytes(mem + CPU_BLOCK_CACHE_START, CPU_BLOCK_CACHE_SIZE) == program->rom_hash;
+	}
+
+	if (!aot->rom_matches) {
+		return cpu_run_threaded(cpu, cache, cpu_cycle, end_cycle);
+	}
+
+	while (cpu_cycle < end_cycle) {
+		bool interrupt_due = cpu->nmi_input || (cpu->irq_input && !cpu->flags[FLAG_I]);
+		cpu_aot_block_t block = interrupt_due ? NULL : cpu_aot_lookup(program, cpu->pc);
+
+		if (block) {
+			cpu_aot_regs_t regs = {
+				mem, cpu->mem->dirty, cpu->mmc_type == 1, cpu_cycle, end_cycle, cpu->frame_cycle, cpu->pc,
+				cpu->a, cpu->x, cpu->y, cpu->sp,
+				cpu->flags[FLAG_C], cpu_get_flag(cpu, FLAG_Z), cpu->flags[FLAG_I],
+				cpu->flags[FLAG_D], cpu->flags[FLAG_V], cpu_get_flag(cpu, FLAG_N)
+			};
+
+			// a block that makes no progress stopped on its first instruction
+			do {
+				uint32_t block_start = regs.cycle;
+				block(&regs);
+				if (regs.cycle == block_start || regs.cycle >= end_cycle) {
+					break;
+				}
+
+				interrupt_due = cpu->nmi_input || (cpu->irq_input && !regs.fi);
+				block = interrupt_due ? NULL : cpu_aot_lookup(program, regs.pc);
+			} while (block);
+
+			cpu->frame_cycle = regs.frame_cycle;
+			cpu->pc = regs.pc;
+			cpu->a = regs.a;
+			cpu->x = regs.x;
+			cpu->y = regs.y;
+			cpu->sp = regs.sp;
+			cpu->flags[FLAG_C] = regs.fc;
+			cpu_set_flag(cpu, FLAG_Z, regs.fz);
+			cpu->flags[FLAG_I] = regs.fi;
+			cpu->flags[FLAG_D] = regs.fd;
+			cpu->flags[FLAG_V] = regs.fv;
+			cpu_set_flag(cpu, FLAG_N, regs.fn);
+			cpu->total_cycles += regs.cycle - cpu_cycle;
+
+			if (regs.cycle != cpu_cycle) {
+				cpu_cycle = regs.cycle;
+				continue;
+			}
+		}
+
+		// one instruction (and interrupt) through the threaded core
+		uint32_t next_cycle = cpu_run_threaded(cpu, cache, cpu_cycle, cpu_cycle + 1);
+		if (next_cycle == cpu_cycle) {
+			break;
+		}
+		cpu_cycle = next_cycle;
+	}
+
+	return cpu_cycle;
+}
@@ -0,0 +1,65 @@
+#ifndef CPU_AOT_INCLUDE
+#define CPU_AOT_INCLUDE
+#include "cpu.h"
+#include "cpu_ops.h"
+
+/*
+What the C written by the recompiler is made of. A block is a function that
+takes the registers into locals (AOT_BLOCK_BEGIN), runs its instructions and
+hands the registers back with the PC to carry on from (AOT_BLOCK_END).
+Every instruction starts with AOT_INSTR, which stops the block once the
+cycles run out, followed by what it does in the macros of cpu_ops.h.
+
+Blocks don't check for interrupts, cpu_run_aot only runs them when none is
+due. An instruction that has to go through the reference handlers ends the
+block before it has changed anything, like in the threaded core.
+*/
+
+#define AOT_BLOCK_BEGIN() \
+	uint8_t *mem = r->mem; \
+	uint64_t *dirty = r->dirty; \
+	bool drop_writes = r->drop_writes; \
+	uint32_t cpu_cycle = r->cycle; \
+	uint32_t end_cycle = r->end_cycle; \
+	uint32_t frame_cycle = r->frame_cycle; \
+	uint16_t pc = r->pc, instr_pc = r->pc; \
+	uint8_t a = r->a, x = r->x, y = r->y, sp = r->sp; \
+	uint8_t fc = r->fc, fz = r->fz, fi = r->fi, fd = r->fd, fv = r->fv, fn = r->fn; \
+	uint8_t imm8, value, carry; \
+	uint16_t imm16, addr, result; \
+	uint32_t cycles
+
+// The PC after the instruction goes into pc up front, like the threaded core has it
+#define AOT_INSTR(at, next, base_cycles, operand) do { \
+	if (cpu_cycle >= end_cycle) { \
+		pc = (at); \
+		goto done; \
+	} \
+	frame_cycle = cpu_cycle; \
+	instr_pc = (at); \
+	pc = (next); \
+	cycles = (base_cycles); \
+	imm16 = (operand); \
+	imm8 = (uint8_t)imm16; \
+} while (0)
+
+#define AOT_BLOCK_END() \
+	goto done; \
+bail: \
+	pc = instr_pc; \
+done: \
+	r->cycle = cpu_cycle; \
+	r->frame_cycle = frame_cycle; \
+	r->pc = pc; \
+	r->a = a; \
+	r->x = x; \
+	r->y = y; \
+	r->sp = sp; \
+	r->fc = fc; \
+	r->fz = fz; \
+	r->fi = fi; \
+	r->fd = fd; \
+	r->fv = fv; \
+	r->fn = fn
+
+#endif // CPU_AOT_INCLUDE
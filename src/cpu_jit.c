@@ -0,0 +1,1287 @@
+#ifdef NESEMU_LINUX
+// MAP_ANONYMOUS is hidden by a strict -std=c23 build
+#define _DEFAULT_SOURCE
+#endif
+#include "cpu.h"
+#include "memory.h"
+#include "ppu.h"
+#include "cpu_ops.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+x86-64 backend for the threaded core. Blocks of PRG ROM code are compiled
+into native code that keeps A/X/Y/SP, C/Z/N and the cycle count in host
+registers, and blocks jump to each other through a small dispatcher at the
+start of the code buffer without coming back to C.
+
+The rules are the ones cpu_run_threaded follows: native code only touches
+RAM and ROM directly, and stops before anything that would reach the PPU,
+APU or controller registers or write outside internal RAM, so the reference
+handlers can run it (there's no calling back into mem_read_8 / mem_write_8
+from native code, those can't run in the middle of a run anyway). Native
+code never checks for interrupts. It's only entered when none is due, and
+the instructions that could make one due (CLI, PLP, RTI, BRK) aren't
+compiled. Those, JMP (ind), code in RAM and the illegal opcodes are stepped
+through cpu_run_threaded one at a time instead. Idle loops (see cpu.h) aren't
+compiled either, the threaded core leaves them to the frame loop.
+
+Like the block cache, all compiled code is thrown away whenever
+memory.shared_writes moves, which covers any write that could reach ROM.
+
+The code buffer is never writable and executable at the same time: jit_compile
+makes it writable, and it's made executable again before native code runs.
+Compiles in a row share one switch each way.
+*/
+
+#ifdef CPU_JIT_AVAILABLE
+
+#include <sys/mman.h>
+#ifdef NESEMU_MACOS
+#include <pthread.h>
+#endif
+
+#define JIT_CODE_SIZE (4 * 1024 * 1024)
+#define JIT_MAX_BLOCK_OPS 48
+// Worst case for one instruction, with room for its exit stub
+#define JIT_MAX_OP_BYTES 160
+
+// What native code sees, rdi points at it the whole time
+typedef struct {
+	uint8_t *mem;
+	uint64_t *dirty;
+	uint8_t **blocks;
+	uint32_t cycle;
+	uint32_t end_cycle;
+	// the cycle the last instruction started on, for nes_cpu_t.frame_cycle
+	uint32_t frame_cycle;
+	uint32_t pc;
+	uint8_t a, x, y, sp;
+	uint8_t fc, fz, fi, fd, fv, fn;
+} jit_regs_t;
+
+enum {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Where the 6502 state lives in native code
+#define REG_A R12
+#define REG_X R13
+#define REG_Y R14
+#define REG_SP R15
+#define REG_FC RBP
+#define REG_FZ R11
+#define REG_FN R10
+#define REG_CYCLES R9
+#define REG_DIRTY R8
+#define REG_MEM RBX
+#define REG_STATE RDI
+#define REG_PC RSI
+
+enum {
+	CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7
+};
+
+enum {
+	ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7
+};
+
+#define NO_INDEX -1
+
+// Addressing modes
+enum {
+	MODE_IMPLIED,
+	MODE_ACC,
+	MODE_IMM,
+	MODE_ZPG,
+	MODE_ZPG_X,
+	MODE_ZPG_Y,
+	MODE_ABS,
+	MODE_ABS_X,
+	MODE_ABS_Y,
+	MODE_X_IND,
+	MODE_IND_Y
+};
+
+static inline bool jit_in_range(uint16_t pc)
+{
+	return (uint16_t)(pc - CPU_BLOCK_CACHE_START) < CPU_BLOCK_CACHE_SIZE - 2;
+}
+
+/*
+Emitter. Only the handful of encodings the compiler needs, all 32-bit
+operations on zero-extended 8 / 16 bit values unless noted.
+*/
+
+static void jit_emit8(cpu_jit_t *jit, uint8_t value)
+{
+	jit->code[jit->code_used++] = value;
+}
+
+static void jit_emit32(cpu_jit_t *jit, uint32_t value)
+{
+	memcpy(&jit->code[jit->code_used], &value, sizeof(value));
+	jit->code_used += sizeof(value);
+}
+
+// REX prefix, always there for byte registers so SIL / DIL / BPL work
+static void jit_rex(cpu_jit_t *jit, bool wide, bool byte_regs, int reg, int index, int base)
+{
+	uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (((index < 0 ? 0 : index) >> 3) << 1) | (base >> 3);
+	if (rex != 0x40 || byte_regs) {
+		jit_emit8(jit, rex);
+	}
+}
+
+// opcode reg, [base + index * scale + disp]
+static void jit_op_mem(cpu_jit_t *jit, bool wide, bool byte_regs, uint32_t opcode, int opcode_len,
+	int reg, int base, int index, int scale, int32_t disp)
+{
+	jit_rex(jit, wide, byte_regs, reg, index, base);
+	for (int i = opcode_len - 1; i >= 0; i--) {
+		jit_emit8(jit, opcode >> (i * 8));
+	}
+
+	uint8_t mod;
+	if (disp == 0 && (base & 7) != RBP) {
+		mod = 0;
+	} else if (disp >= -128 && disp <= 127) {
+		mod = 1;
+	} else {
+		mod = 2;
+	}
+
+	if (index >= 0 || (base & 7) == RSP) {
+		static const uint8_t scale_bits[9] = {0, 0, 1, 0, 2, 0, 0, 0, 3};
+		jit_emit8(jit, (mod << 6) | ((reg & 7) << 3) | 4);
+		jit_emit8(jit, (scale_bits[scale] << 6) | ((index < 0 ? RSP : index) & 7) << 3 | (base & 7));
+	} else {
+		jit_emit8(jit, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+	}
+
+	if (mod == 1) {
+		jit_emit8(jit, disp);
+	} else if (mod == 2) {
+		jit_emit32(jit, disp);
+	}
+}
+
+// opcode reg, rm with both registers
+static void jit_op_reg(cpu_jit_t *jit, bool wide, bool byte_regs, uint32_t opcode, int opcode_len, int reg, int rm)
+{
+	jit_rex(jit, wide, byte_regs, reg, NO_INDEX, rm);
+	for (int i = opcode_len - 1; i >= 0; i--) {
+		jit_emit8(jit, opcode >> (i * 8));
+	}
+	jit_emit8(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void jit_mov(cpu_jit_t *jit, int dst, int src)
+{
+	jit_op_reg(jit, false, false, 0x89, 1, src, dst);
+}
+
+static void jit_mov_imm(cpu_jit_t *jit, int dst, uint32_t imm)
+{
+	jit_rex(jit, false, false, 0, NO_INDEX, dst);
+	jit_emit8(jit, 0xB8 + (dst & 7));
+	jit_emit32(jit, imm);
+}
+
+static void jit_movzx8(cpu_jit_t *jit, int dst, int src)
+{
+	jit_op_reg(jit, false, true, 0x0FB6, 2, dst, src);
+}
+
+static void jit_movzx16(cpu_jit_t *jit, int dst, int src)
+{
+	jit_op_reg(jit, false, false, 0x0FB7, 2, dst, src);
+}
+
+static void jit_load8(cpu_jit_t *jit, int dst, int base, int index, int32_t disp)
+{
+	jit_op_mem(jit, false, false, 0x0FB6, 2, dst, base, index, 1, disp);
+}
+
+static void jit_store8(cpu_jit_t *jit, int src, int base, int index, int32_t disp)
+{
+	jit_op_mem(jit, false, true, 0x88, 1, src, base, index, 1, disp);
+}
+
+static void jit_store8_imm(cpu_jit_t *jit, uint8_t imm, int base, int index, int32_t disp)
+{
+	jit_op_mem(jit, false, false, 0xC6, 1, 0, base, index, 1, disp);
+	jit_emit8(jit, imm);
+}
+
+static void jit_lea(cpu_jit_t *jit, int dst, int base, int32_t disp)
+{
+	jit_op_mem(jit, false, false, 0x8D, 1, dst, base, NO_INDEX, 1, disp);
+}
+
+// add / or / and / sub / xor / cmp dst, src
+static void jit_alu(cpu_jit_t *jit, int op, int dst, int src)
+{
+	jit_op_reg(jit, false, false, (op << 3) | 1, 1, src, dst);
+}
+
+static void jit_alu_imm(cpu_jit_t *jit, int op, int dst, int32_t imm)
+{
+	jit_op_reg(jit, false, false, 0x81, 1, op, dst);
+	jit_emit32(jit, imm);
+}
+
+static void jit_test8(cpu_jit_t *jit, int a, int b)
+{
+	jit_op_reg(jit, false, true, 0x84, 1, b, a);
+}
+
+static void jit_shl(cpu_jit_t *jit, int dst, uint8_t count)
+{
+	jit_op_reg(jit, false, false, 0xC1, 1, 4, dst);
+	jit_emit8(jit, count);
+}
+
+static void jit_shr(cpu_jit_t *jit, int dst, uint8_t count)
+{
+	jit_op_reg(jit, false, false, 0xC1, 1, 5, dst);
+	jit_emit8(jit, count);
+}
+
+static void jit_setcc(cpu_jit_t *jit, int cc, int dst)
+{
+	jit_op_reg(jit, false, true, 0x0F90 | cc, 2, 0, dst);
+}
+
+static void jit_inc8(cpu_jit_t *jit, int dst)
+{
+	jit_op_reg(jit, false, true, 0xFE, 1, 0, dst);
+}
+
+static void jit_dec8(cpu_jit_t *jit, int dst)
+{
+	jit_op_reg(jit, false, true, 0xFE, 1, 1, dst);
+}
+
+static void jit_add8_imm(cpu_jit_t *jit, int dst, uint8_t imm)
+{
+	jit_op_reg(jit, false, true, 0x80, 1, ALU_ADD, dst);
+	jit_emit8(jit, imm);
+}
+
+// Jumps return where their rel32 goes, for jit_patch
+static size_t jit_jcc(cpu_jit_t *jit, int cc)
+{
+	jit_emit8(jit, 0x0F);
+	jit_emit8(jit, 0x80 | cc);
+	jit_emit32(jit, 0);
+	return jit->code_used - 4;
+}
+
+static size_t jit_jmp(cpu_jit_t *jit)
+{
+	jit_emit8(jit, 0xE9);
+	jit_emit32(jit, 0);
+	return jit->code_used - 4;
+}
+
+static void jit_patch(cpu_jit_t *jit, size_t at, size_t target)
+{
+	int32_t rel = (int32_t)(target - (at + 4));
+	memcpy(&jit->code[at], &rel, sizeof(rel));
+}
+
+static void jit_push(cpu_jit_t *jit, int reg)
+{
+	jit_rex(jit, false, false, 0, NO_INDEX, reg);
+	jit_emit8(jit, 0x50 + (reg & 7));
+}
+
+static void jit_pop(cpu_jit_t *jit, int reg)
+{
+	jit_rex(jit, false, false, 0, NO_INDEX, reg);
+	jit_emit8(jit, 0x58 + (reg & 7));
+}
+
+// Operands for a field of the jit_regs_t, for the jit_load8 style / jit_op_mem helpers
+#define STATE(field) REG_STATE, NO_INDEX, offsetof(jit_regs_t, field)
+#define STATE_OP(field) REG_STATE, NO_INDEX, 1, offsetof(jit_regs_t, field)
+
+/*
+Block compiler
+*/
+
+typedef struct {
+	uint16_t pc;
+	size_t offset;
+} jit_label_t;
+
+// An exit to C with pc in REG_PC, for bails and the end of the run
+typedef struct {
+	size_t patch;
+	uint16_t pc;
+} jit_exit_t;
+
+typedef struct {
+	cpu_jit_t *jit;
+	const uint8_t *mem;
+	bool drop_writes;
+
+	jit_label_t labels[JIT_MAX_BLOCK_OPS];
+	int num_labels;
+
+	jit_exit_t exits[JIT_MAX_BLOCK_OPS * 4];
+	int num_exits;
+
+	// the current instruction
+	uint16_t pc;
+	uint8_t imm8;
+	uint16_t imm16;
+} jit_block_t;
+
+// Leaves the block for C with nothing about the current instruction done
+static void jit_bail_if(jit_block_t *b, int cc)
+{
+	b->exits[b->num_exits++] = (jit_exit_t){jit_jcc(b->jit, cc), b->pc};
+}
+
+static void jit_to_dispatch(jit_block_t *b, uint16_t pc)
+{
+	jit_mov_imm(b->jit, REG_PC, pc);
+	jit_patch(b->jit, jit_jmp(b->jit), b->jit->dispatch_offset);
+}
+
+static const jit_label_t *jit_find_label(jit_block_t *b, uint16_t pc)
+{
+	for (int i = 0; i < b->num_labels; i++) {
+		if (b->labels[i].pc == pc) {
+			return &b->labels[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void jit_add_cycles(jit_block_t *b, uint8_t cycles)
+{
+	jit_alu_imm(b->jit, ALU_ADD, REG_CYCLES, cycles);
+}
+
+// Adds the carry out of (low byte of base) + index to the cycles, via RCX
+static void jit_page_cross(jit_block_t *b, int index, uint8_t base_low)
+{
+	jit_lea(b->jit, RCX, index, base_low);
+	jit_shr(b->jit, RCX, 8);
+}
+
+static void jit_set_nz(jit_block_t *b, int reg)
+{
+	jit_test8(b->jit, reg, reg);
+	jit_setcc(b->jit, CC_E, REG_FZ);
+	jit_movzx8(b->jit, REG_FN, reg);
+	jit_shr(b->jit, REG_FN, 7);
+}
+
+// Bails if RDX is one of the I/O registers, using RAX
+static void jit_check_io(jit_block_t *b)
+{
+	jit_lea(b->jit, RAX, RDX, -PPUCTRL_ADDR);
+	jit_alu_imm(b->jit, ALU_CMP, RAX, PPUDATA_ADDR - PPUCTRL_ADDR);
+	jit_bail_if(b, CC_BE);
+	jit_lea(b->jit, RAX, RDX, -CPU_IO_START);
+	jit_alu_imm(b->jit, ALU_CMP, RAX, CPU_IO_SIZE);
+	jit_bail_if(b, CC_B);
+}
+
+// Bails unless RDX is in internal RAM
+static void jit_check_ram(jit_block_t *b)
+{
+	jit_alu_imm(b->jit, ALU_CMP, RDX, CPU_RAM_SIZE);
+	jit_bail_if(b, CC_AE);
+}
+
+// The 16-bit pointer at zero page (p), wrapping within the page, into RDX
+static void jit_zpg_pointer(jit_block_t *b, int p)
+{
+	jit_load8(b->jit, RDX, REG_MEM, p, 0);
+	jit_lea(b->jit, RAX, p, 1);
+	jit_movzx8(b->jit, RAX, RAX);
+	jit_load8(b->jit, RAX, REG_MEM, RAX, 0);
+	jit_shl(b->jit, RAX, 8);
+	jit_alu(b->jit, ALU_OR, RDX, RAX);
+}
+
+/*
+Operand of a read instruction into RAX, the READ_* macros of the threaded
+core. Returns false if it's known to need the reference handlers already.
+*/
+static bool jit_read(jit_block_t *b, int mode)
+{
+	cpu_jit_t *jit = b->jit;
+
+	switch (mode) {
+		case MODE_IMM:
+			jit_mov_imm(jit, RAX, b->imm8);
+			return true;
+		case MODE_ZPG:
+			jit_load8(jit, RAX, REG_MEM, NO_INDEX, b->imm8);
+			return true;
+		case MODE_ZPG_X:
+		case MODE_ZPG_Y:
+			jit_lea(jit, RDX, mode == MODE_ZPG_X ? REG_X : REG_Y, b->imm8);
+			jit_movzx8(jit, RDX, RDX);
+			jit_load8(jit, RAX, REG_MEM, RDX, 0);
+			return true;
+		case MODE_ABS:
+			if (cpu_is_io_register(b->imm16)) {
+				return false;
+			}
+			jit_load8(jit, RAX, REG_MEM, NO_INDEX, b->imm16);
+			return true;
+		case MODE_ABS_X:
+		case MODE_ABS_Y: {
+			int index = mode == MODE_ABS_X ? REG_X : REG_Y;
+			jit_lea(jit, RDX, index, b->imm16);
+			jit_movzx16(jit, RDX, RDX);
+			jit_check_io(b);
+			jit_page_cross(b, index, b->imm16 & 0xff);
+			jit_alu(jit, ALU_ADD, REG_CYCLES, RCX);
+			jit_load8(jit, RAX, REG_MEM, RDX, 0);
+			return true;
+		}
+		case MODE_X_IND:
+			jit_lea(jit, RCX, REG_X, b->imm8);
+			jit_movzx8(jit, RCX, RCX);
+			jit_zpg_pointer(b, RCX);
+			jit_check_io(b);
+			jit_load8(jit, RAX, REG_MEM, RDX, 0);
+			return true;
+		case MODE_IND_Y:
+			jit_mov_imm(jit, RCX, b->imm8);
+			jit_zpg_pointer(b, RCX);
+			jit_movzx8(jit, RCX, RDX);
+			jit_alu(jit, ALU_ADD, RCX, REG_Y);
+			jit_shr(jit, RCX, 8);
+			jit_alu(jit, ALU_ADD, RDX, REG_Y);
+			jit_movzx16(jit, RDX, RDX);
+			jit_check_io(b);
+			jit_alu(jit, ALU_ADD, REG_CYCLES, RCX);
+			jit_load8(jit, RAX, REG_MEM, RDX, 0);
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+Target of a store or read-modify-write into RDX, the ADDR_* macros plus the
+checks STORE / RMW_LOAD make. With rmw the old value is read into RAX.
+*/
+static bool jit_address(jit_block_t *b, int mode, bool rmw)
+{
+	cpu_jit_t *jit = b->jit;
+	bool check_ram = !b->drop_writes;
+	bool check_io = rmw;
+
+	switch (mode) {
+		case MODE_ZPG:
+			jit_mov_imm(jit, RDX, b->imm8);
+			check_ram = check_io = false;
+			break;
+		case MODE_ZPG_X:
+		case MODE_ZPG_Y: {
+			int index = mode == MODE_ZPG_X ? REG_X : REG_Y;
+			jit_page_cross(b, index, b->imm8);
+			jit_alu(jit, ALU_ADD, REG_CYCLES, RCX);
+			jit_lea(jit, RDX, index, b->imm8);
+			jit_movzx8(jit, RDX, RDX);
+			check_ram = check_io = false;
+			break;
+		}
+		case MODE_ABS:
+			if ((rmw && cpu_is_io_register(b->imm16)) || (check_ram && b->imm16 >= CPU_RAM_SIZE)) {
+				return false;
+			}
+			jit_mov_imm(jit, RDX, b->imm16);
+			check_ram = check_io = false;
+			break;
+		case MODE_ABS_X:
+		case MODE_ABS_Y: {
+			int index = mode == MODE_ABS_X ? REG_X : REG_Y;
+			jit_lea(jit, RDX, index, b->imm16);
+			jit_movzx16(jit, RDX, RDX);
+			break;
+		}
+		case MODE_X_IND:
+			jit_lea(jit, RCX, REG_X, b->imm8);
+			jit_movzx8(jit, RCX, RCX);
+			jit_zpg_pointer(b, RCX);
+			break;
+		case MODE_IND_Y:
+			jit_mov_imm(jit, RCX, b->imm8);
+			jit_zpg_pointer(b, RCX);
+			jit_alu(jit, ALU_ADD, RDX, REG_Y);
+			jit_movzx16(jit, RDX, RDX);
+			break;
+		default:
+			return false;
+	}
+
+	if (check_io) {
+		jit_check_io(b);
+	}
+	if (check_ram) {
+		jit_check_ram(b);
+	}
+
+	// the page crossing cycle only counts once nothing can bail any more
+	if (mode == MODE_ABS_X || mode == MODE_ABS_Y) {
+		int index = mode == MODE_ABS_X ? REG_X : REG_Y;
+		jit_page_cross(b, index, b->imm16 & 0xff);
+		jit_alu(jit, ALU_ADD, REG_CYCLES, RCX);
+	}
+
+	if (rmw) {
+		jit_load8(jit, RAX, REG_MEM, RDX, 0);
+	}
+
+	return true;
+}
+
+// MARK_DIRTY for the address in RDX, which is in RAM
+static void jit_mark_dirty(jit_block_t *b)
+{
+	cpu_jit_t *jit = b->jit;
+
+	jit_mov(jit, RCX, RDX);
+	jit_shr(jit, RCX, MEMORY_PAGE_SHIFT);
+	jit_mov_imm(jit, RDX, 1);
+	// shl edx, cl
+	jit_op_reg(jit, false, false, 0xD3, 1, 4, RDX);
+	// or [dirty], rdx
+	jit_op_mem(jit, true, false, 0x09, 1, RDX, REG_DIRTY, NO_INDEX, 1, 0);
+}
+
+static void jit_mark_dirty_page(jit_block_t *b, int page)
+{
+	// or qword [dirty], 1 << page
+	jit_op_mem(b->jit, true, false, 0x81, 1, ALU_OR, REG_DIRTY, NO_INDEX, 1, 0);
+	jit_emit32(b->jit, 1u << page);
+}
+
+// STORE / RMW_STORE of src to the address in RDX
+static void jit_write(jit_block_t *b, int src)
+{
+	if (b->drop_writes) {
+		return;
+	}
+
+	jit_store8(b->jit, src, REG_MEM, RDX, 0);
+	jit_mark_dirty(b);
+}
+
+static void jit_push8(jit_block_t *b, int src)
+{
+	if (!b->drop_writes) {
+		jit_store8(b->jit, src, REG_MEM, REG_SP, 0x100);
+		jit_mark_dirty_page(b, 0x100 >> MEMORY_PAGE_SHIFT);
+	}
+	jit_dec8(b->jit, REG_SP);
+}
+
+// ADC of RAX, clobbers RAX / RCX / RDX
+static void jit_adc(jit_block_t *b)
+{
+	cpu_jit_t *jit = b->jit;
+
+	jit_mov(jit, RCX, REG_A);
+	jit_alu(jit, ALU_ADD, RCX, RAX);
+	jit_alu(jit, ALU_ADD, RCX, REG_FC);
+	jit_set_nz(b, RCX);
+	jit_mov(jit, REG_FC, RCX);
+	jit_shr(jit, REG_FC, 8);
+	// fv = ((a ^ result) & (num ^ result) & 0x80) != 0
+	jit_mov(jit, RDX, REG_A);
+	jit_alu(jit, ALU_XOR, RDX, RCX);
+	jit_alu(jit, ALU_XOR, RAX, RCX);
+	jit_alu(jit, ALU_AND, RAX, RDX);
+	jit_shr(jit, RAX, 7);
+	jit_alu_imm(jit, ALU_AND, RAX, 1);
+	jit_store8(jit, RAX, STATE(fv));
+	jit_movzx8(jit, REG_A, RCX);
+}
+
+// COMPARE(reg, RAX)
+static void jit_compare(jit_block_t *b, int reg)
+{
+	jit_alu(b->jit, ALU_CMP, reg, RAX);
+	jit_setcc(b->jit, CC_AE, REG_FC);
+	jit_mov(b->jit, RCX, reg);
+	jit_alu(b->jit, ALU_SUB, RCX, RAX);
+	jit_set_nz(b, RCX);
+}
+
+// ASL / ROL / LSR / ROR of reg (by the 6502 aaa bits), leaving NZ alone
+static void jit_shift(jit_block_t *b, int aaa, int reg)
+{
+	cpu_jit_t *jit = b->jit;
+	bool rotate = aaa & 1;
+	bool left = aaa < 2;
+
+	if (rotate) {
+		jit_mov(jit, RCX, REG_FC);
+	}
+	jit_mov(jit, REG_FC, reg);
+	if (left) {
+		jit_shr(jit, REG_FC, 7);
+		jit_shl(jit, reg, 1);
+		if (rotate) {
+			jit_alu(jit, ALU_OR, reg, RCX);
+		}
+		jit_movzx8(jit, reg, reg);
+	} else {
+		jit_alu_imm(jit, ALU_AND, REG_FC, 1);
+		jit_shr(jit, reg, 1);
+		if (rotate) {
+			jit_shl(jit, RCX, 7);
+			jit_alu(jit, ALU_OR, reg, RCX);
+		}
+	}
+}
+
+// The addressing mode of an official opcode, from its aaabbbcc bits
+static int jit_mode(uint8_t op)
+{
+	int aaa = op >> 5;
+	int bbb = (op >> 2) & 7;
+
+	switch (op & 3) {
+		case 1: {
+			static const int modes[8] = {
+				MODE_X_IND, MODE_ZPG, MODE_IMM, MODE_ABS, MODE_IND_Y, MODE_ZPG_X, MODE_ABS_Y, MODE_ABS_X
+			};
+			return modes[bbb];
+		}
+		case 2: {
+			static const int modes[8] = {
+				MODE_IMM, MODE_ZPG, MODE_ACC, MODE_ABS, MODE_IMPLIED, MODE_ZPG_X, MODE_IMPLIED, MODE_ABS_X
+			};
+			// STX / LDX index with Y
+			if ((aaa == 4 || aaa == 5) && bbb == 5) {
+				return MODE_ZPG_Y;
+			}
+			if ((aaa == 4 || aaa == 5) && bbb == 7) {
+				return MODE_ABS_Y;
+			}
+			return modes[bbb];
+		}
+		case 0: {
+			static const int modes[8] = {
+				MODE_IMM, MODE_ZPG, MODE_IMPLIED, MODE_ABS, MODE_IMPLIED, MODE_ZPG_X, MODE_IMPLIED, MODE_ABS_X
+			};
+			return modes[bbb];
+		}
+		default:
+			return MODE_IMPLIED;
+	}
+}
+
+/*
+Compiles one instruction at b->pc. Returns false if it has to be left to
+cpu_run_threaded, before anything has been emitted for it.
+*/
+static bool jit_compile_op(jit_block_t *b, uint8_t op)
+{
+	cpu_jit_t *jit = b->jit;
+	int aaa = op >> 5;
+	int bbb = (op >> 2) & 7;
+	int mode = jit_mode(op);
+
+	switch (op) {
+		case 0xCA: jit_dec8(jit, REG_X); jit_set_nz(b, REG_X); return true;
+		case 0x88: jit_dec8(jit, REG_Y); jit_set_nz(b, REG_Y); return true;
+		case 0xE8: jit_inc8(jit, REG_X); jit_set_nz(b, REG_X); return true;
+		case 0xC8: jit_inc8(jit, REG_Y); jit_set_nz(b, REG_Y); return true;
+		case 0xAA: jit_mov(jit, REG_X, REG_A); jit_set_nz(b, REG_X); return true;
+		case 0xA8: jit_mov(jit, REG_Y, REG_A); jit_set_nz(b, REG_Y); return true;
+		case 0xBA: jit_mov(jit, REG_X, REG_SP); jit_set_nz(b, REG_X); return true;
+		case 0x8A: jit_mov(jit, REG_A, REG_X); jit_set_nz(b, REG_A); return true;
+		case 0x98: jit_mov(jit, REG_A, REG_Y); jit_set_nz(b, REG_A); return true;
+		case 0x9A: jit_mov(jit, REG_SP, REG_X); return true;
+
+		case 0x18: jit_alu(jit, ALU_XOR, REG_FC, REG_FC); return true;
+		case 0x38: jit_mov_imm(jit, REG_FC, 1); return true;
+		case 0xD8: jit_store8_imm(jit, 0, STATE(fd)); return true;
+		case 0xF8: jit_store8_imm(jit, 1, STATE(fd)); return true;
+		case 0x78: jit_store8_imm(jit, 1, STATE(fi)); return true;
+		case 0xB8: jit_store8_imm(jit, 0, STATE(fv)); return true;
+		case 0xEA: return true;
+
+		case 0x48: jit_push8(b, REG_A); return true;
+		case 0x68:
+			jit_inc8(jit, REG_SP);
+			jit_load8(jit, REG_A, REG_MEM, REG_SP, 0x100);
+			jit_set_nz(b, REG_A);
+			return true;
+		case 0x08:
+			// GET_SR() | 0b00110000
+			jit_mov(jit, RAX, REG_FC);
+			jit_lea(jit, RCX, REG_FZ, 0);
+			jit_shl(jit, RCX, 1);
+			jit_alu(jit, ALU_OR, RAX, RCX);
+			jit_load8(jit, RCX, STATE(fi));
+			jit_shl(jit, RCX, 2);
+			jit_alu(jit, ALU_OR, RAX, RCX);
+			jit_load8(jit, RCX, STATE(fd));
+			jit_shl(jit, RCX, 3);
+			jit_alu(jit, ALU_OR, RAX, RCX);
+			jit_load8(jit, RCX, STATE(fv));
+			jit_shl(jit, RCX, 6);
+			jit_alu(jit, ALU_OR, RAX, RCX);
+			jit_lea(jit, RCX, REG_FN, 0);
+			jit_shl(jit, RCX, 7);
+			jit_alu(jit, ALU_OR, RAX, RCX);
+			jit_alu_imm(jit, ALU_OR, RAX, 0b00110000);
+			jit_push8(b, RAX);
+			return true;
+
+		case 0x24:
+		case 0x2C:
+			if (!jit_read(b, mode)) {
+				return false;
+			}
+			jit_test8(jit, REG_A, RAX);
+			jit_setcc(jit, CC_E, REG_FZ);
+			jit_mov(jit, REG_FN, RAX);
+			jit_shr(jit, REG_FN, 7);
+			jit_shr(jit, RAX, 6);
+			jit_alu_imm(jit, ALU_AND, RAX, 1);
+			jit_store8(jit, RAX, STATE(fv));
+			return true;
+
+		case 0x0A: case 0x2A: case 0x4A: case 0x6A:
+			jit_shift(b, aaa, REG_A);
+			jit_set_nz(b, REG_A);
+			return true;
+	}
+
+	switch (op & 3) {
+		case 1:
+			// STA #imm is one of the illegal NOPs
+			if (op == 0x89) {
+				return false;
+			}
+
+			if (aaa == 4) {
+				if (!jit_address(b, mode, false)) {
+					return false;
+				}
+				jit_write(b, REG_A);
+				return true;
+			}
+
+			if (!jit_read(b, mode)) {
+				return false;
+			}
+			switch (aaa) {
+				case 0: jit_alu(jit, ALU_OR, REG_A, RAX); jit_set_nz(b, REG_A); break;
+				case 1: jit_alu(jit, ALU_AND, REG_A, RAX); jit_set_nz(b, REG_A); break;
+				case 2: jit_alu(jit, ALU_XOR, REG_A, RAX); jit_set_nz(b, REG_A); break;
+				case 3: jit_adc(b); break;
+				case 5: jit_mov(jit, REG_A, RAX); jit_set_nz(b, REG_A); break;
+				case 6: jit_compare(b, REG_A); break;
+				case 7: jit_alu_imm(jit, ALU_XOR, RAX, 0xff); jit_adc(b); break;
+			}
+			return true;
+
+		case 2:
+			if (mode == MODE_IMPLIED || mode == MODE_ACC ||
+				(mode == MODE_IMM && op != 0xA2) || op == 0x9E) {
+				return false;
+			}
+
+			if (aaa == 4) {
+				if (!jit_address(b, mode, false)) {
+					return false;
+				}
+				jit_write(b, REG_X);
+				return true;
+			}
+
+			if (aaa == 5) {
+				if (!jit_read(b, mode)) {
+					return false;
+				}
+				jit_mov(jit, REG_X, RAX);
+				jit_set_nz(b, REG_X);
+				return true;
+			}
+
+			// ASL / ROL / LSR / ROR / DEC / INC on memory
+			if (!jit_address(b, mode, true)) {
+				return false;
+			}
+			if (aaa == 6) {
+				jit_dec8(jit, RAX);
+			} else if (aaa == 7) {
+				jit_inc8(jit, RAX);
+			} else {
+				jit_shift(b, aaa, RAX);
+			}
+			jit_set_nz(b, RAX);
+			jit_write(b, RAX);
+			return true;
+
+		case 0: {
+			bool valid;
+			switch (aaa) {
+				case 1: valid = bbb == 1 || bbb == 3; break;
+				case 4: valid = bbb == 1 || bbb == 3 || bbb == 5; break;
+				case 5: valid = bbb != 2 && bbb != 4 && bbb != 6; break;
+				case 6: case 7: valid = bbb <= 1 || bbb == 3; break;
+				default: valid = false; break;
+			}
+			if (!valid) {
+				return false;
+			}
+
+			if (aaa == 4) {
+				if (!jit_address(b, mode, false)) {
+					return false;
+				}
+				jit_write(b, REG_Y);
+				return true;
+			}
+
+			if (!jit_read(b, mode)) {
+				return false;
+			}
+			switch (aaa) {
+				case 5: jit_mov(jit, REG_Y, RAX); jit_set_nz(b, REG_Y); break;
+				case 6: jit_compare(b, REG_Y); break;
+				case 7: jit_compare(b, REG_X); break;
+			}
+			return true;
+		}
+
+		default:
+			return false;
+	}
+}
+
+// Condition a branch opcode takes, as a flag register / slot and its value
+static void jit_branch_test(jit_block_t *b, uint8_t op, int *cc_taken)
+{
+	cpu_jit_t *jit = b->jit;
+
+	switch (op >> 6) {
+		case 0: jit_test8(jit, REG_FN, REG_FN); break;
+		case 1: jit_op_mem(jit, false, false, 0x80, 1, ALU_CMP, STATE_OP(fv)); jit_emit8(jit, 0); break;
+		case 2: jit_test8(jit, REG_FC, REG_FC); break;
+		case 3: jit_test8(jit, REG_FZ, REG_FZ); break;
+	}
+
+	// bit 5 says whether the branch is taken on a set flag
+	*cc_taken = op & 0x20 ? CC_NE : CC_E;
+}
+
+static void jit_reset(cpu_jit_t *jit)
+{
+	memset(jit->blocks, 0, CPU_BLOCK_CACHE_SIZE * sizeof(uint8_t *));
+	memset(jit->refused, 0, CPU_BLOCK_CACHE_SIZE * sizeof(bool));
+	jit->code_used = jit->code_start;
+}
+
+/*
+Switches the code buffer between writable and executable, if it isn't
+already. On macOS it's MAP_JIT memory, which is switched for the calling
+thread only.
+*/
+static bool jit_set_writable(cpu_jit_t *jit, bool writable)
+{
+	if (jit->writable == writable) {
+		return true;
+	}
+
+	#ifdef NESEMU_MACOS
+	pthread_jit_write_protect_np(!writable);
+	#else
+	int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+	if (mprotect(jit->code, jit->code_size, prot) != 0) {
+		return false;
+	}
+	#endif
+
+	jit->writable = writable;
+	return true;
+}
+
+/*
+Compiles the block starting at pc, following JMP abs / JSR and running on
+past branches. Returns NULL if the first instruction can't be compiled.
+*/
+static uint8_t *jit_compile_block(cpu_jit_t *jit, const uint8_t *mem, uint16_t pc, bool drop_writes)
+{
+	size_t max_size = JIT_MAX_BLOCK_OPS * JIT_MAX_OP_BYTES;
+	if (jit->code_used + max_size > jit->code_size) {
+		jit_reset(jit);
+	}
+
+	jit_block_t b;
+	b.jit = jit;
+	b.mem = mem;
+	b.drop_writes = drop_writes;
+	b.num_labels = 0;
+	b.num_exits = 0;
+
+	size_t start = jit->code_used;
+
+	for (int num_ops = 0; ; num_ops++) {
+		if (num_ops == JIT_MAX_BLOCK_OPS || !jit_in_range(pc)) {
+			jit_to_dispatch(&b, pc);
+			break;
+		}
+
+		const jit_label_t *label = jit_find_label(&b, pc);
+		if (label) {
+			jit_patch(jit, jit_jmp(jit), label->offset);
+			break;
+		}
+
+		// idle loops are left to the frame loop, through the threaded core
+		cpu_idle_loop_t loop;
+		if (cpu_find_idle_loop(mem, pc, &loop)) {
+			if (num_ops == 0) {
+				return NULL;
+			}
+			jit_to_dispatch(&b, pc);
+			break;
+		}
+
+		uint8_t op = mem[pc];
+		b.pc = pc;
+		b.imm8 = mem[pc + 1];
+		b.imm16 = b.imm8 | (mem[pc + 2] << 8);
+		uint16_t next_pc = pc + cpu_size_table[op];
+		uint8_t cycles = cpu_cycle_count_table[op];
+
+		size_t op_start = jit->code_used;
+		int op_exits = b.num_exits;
+		b.labels[b.num_labels++] = (jit_label_t){pc, op_start};
+
+		// cmp cycles, end_cycle; mov frame_cycle, cycles
+		jit_op_mem(jit, false, false, 0x3B, 1, REG_CYCLES, STATE_OP(end_cycle));
+		jit_bail_if(&b, CC_AE);
+		jit_op_mem(jit, false, false, 0x89, 1, REG_CYCLES, STATE_OP(frame_cycle));
+
+		if (op == 0x4C || op == 0x20) {
+			if (op == 0x20) {
+				// PUSH_16(pc - 1), the address is (sp - 1) + 0x100 before wrapping
+				uint16_t ret = next_pc - 1;
+				if (!drop_writes) {
+					jit_store8_imm(jit, ret & 0xff, REG_MEM, REG_SP, 0xff);
+					jit_store8_imm(jit, ret >> 8, REG_MEM, REG_SP, 0x100);
+					jit_mark_dirty_page(&b, 1);
+					jit_test8(jit, REG_SP, REG_SP);
+					size_t skip = jit_jcc(jit, CC_NE);
+					jit_mark_dirty_page(&b, 0);
+					jit_patch(jit, skip, jit->code_used);
+				}
+				jit_add8_imm(jit, REG_SP, 0xfe);
+			}
+			jit_add_cycles(&b, cycles);
+			pc = b.imm16;
+			continue;
+		}
+
+		if (op == 0x60) {
+			// POP_16(pc); pc++
+			jit_add8_imm(jit, REG_SP, 2);
+			jit_load8(jit, REG_PC, REG_MEM, REG_SP, 0xff);
+			jit_load8(jit, RAX, REG_MEM, REG_SP, 0x100);
+			jit_shl(jit, RAX, 8);
+			jit_alu(jit, ALU_OR, REG_PC, RAX);
+			jit_lea(jit, REG_PC, REG_PC, 1);
+			jit_movzx16(jit, REG_PC, REG_PC);
+			jit_add_cycles(&b, cycles);
+			jit_patch(jit, jit_jmp(jit), jit->dispatch_offset);
+			break;
+		}
+
+		if ((op & 0x1F) == 0x10) {
+			uint16_t target = next_pc + (int8_t)b.imm8;
+			uint8_t extra = (next_pc & 0xff) + b.imm8 > 0xff ? 2 : 1;
+
+			int cc_taken;
+			jit_branch_test(&b, op, &cc_taken);
+			size_t not_taken = jit_jcc(jit, cc_taken ^ 1);
+			jit_add_cycles(&b, cycles + extra);
+			label = jit_find_label(&b, target);
+			if (label) {
+				jit_patch(jit, jit_jmp(jit), label->offset);
+			} else {
+				jit_to_dispatch(&b, target);
+			}
+			jit_patch(jit, not_taken, jit->code_used);
+			jit_add_cycles(&b, cycles);
+			pc = next_pc;
+			continue;
+		}
+
+		if (!jit_compile_op(&b, op)) {
+			// leave it to the threaded core, from the dispatcher
+			jit->code_used = op_start;
+			b.num_exits = op_exits;
+			b.num_labels--;
+			if (num_ops == 0) {
+				return NULL;
+			}
+			jit_to_dispatch(&b, pc);
+			break;
+		}
+
+		jit_add_cycles(&b, cycles);
+		pc = next_pc;
+	}
+
+	for (int i = 0; i < b.num_exits; i++) {
+		jit_patch(jit, b.exits[i].patch, jit->code_used);
+		jit_mov_imm(jit, REG_PC, b.exits[i].pc);
+		jit_patch(jit, jit_jmp(jit), jit->exit_offset);
+	}
+
+	jit->blocks[b.labels[0].pc - CPU_BLOCK_CACHE_START] = &jit->code[start];
+	return &jit->code[start];
+}
+
+/*
+jit_compile_block with the code buffer made writable first. Where it gives up
+it's not tried again until the next reset, so the threaded core doesn't
+switch the buffer back and forth every time it steps through those.
+*/
+static uint8_t *jit_compile(cpu_jit_t *jit, const uint8_t *mem, uint16_t pc, bool drop_writes)
+{
+	if (jit->refused[pc - CPU_BLOCK_CACHE_START]) {
+		return NULL;
+	}
+
+	if (!jit_set_writable(jit, true)) {
+		log_event("Could not make the JIT code buffer writable!");
+		return NULL;
+	}
+
+	uint8_t *code = jit_compile_block(jit, mem, pc, drop_writes);
+	if (!code) {
+		jit->refused[pc - CPU_BLOCK_CACHE_START] = true;
+	}
+
+	return code;
+}
+
+/*
+Entry point at the start of the buffer, void entry(jit_regs_t *) in the
+System V ABI: loads the state into registers, runs blocks through the
+dispatcher until one isn't compiled or the cycles run out, and stores it back.
+*/
+static void jit_emit_entry(cpu_jit_t *jit)
+{
+	static const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+	for (size_t i = 0; i < sizeof(saved) / sizeof(saved[0]); i++) {
+		jit_push(jit, saved[i]);
+	}
+
+	// mov rbx, [rdi + mem]; mov r8, [rdi + dirty]
+	jit_op_mem(jit, true, false, 0x8B, 1, REG_MEM, STATE_OP(mem));
+	jit_op_mem(jit, true, false, 0x8B, 1, REG_DIRTY, STATE_OP(dirty));
+	jit_load8(jit, REG_A, STATE(a));
+	jit_load8(jit, REG_X, STATE(x));
+	jit_load8(jit, REG_Y, STATE(y));
+	jit_load8(jit, REG_SP, STATE(sp));
+	jit_load8(jit, REG_FC, STATE(fc));
+	jit_load8(jit, REG_FZ, STATE(fz));
+	jit_load8(jit, REG_FN, STATE(fn));
+	jit_op_mem(jit, false, false, 0x8B, 1, REG_CYCLES, STATE_OP(cycle));
+	jit_op_mem(jit, false, false, 0x8B, 1, REG_PC, STATE_OP(pc));
+
+	jit->dispatch_offset = jit->code_used;
+	jit_op_mem(jit, false, false, 0x3B, 1, REG_CYCLES, STATE_OP(end_cycle));
+	size_t out_of_cycles = jit_jcc(jit, CC_AE);
+	jit_lea(jit, RAX, REG_PC, -CPU_BLOCK_CACHE_START);
+	jit_alu_imm(jit, ALU_CMP, RAX, CPU_BLOCK_CACHE_SIZE - 2);
+	size_t out_of_range = jit_jcc(jit, CC_AE);
+	// mov rdx, [rdi + blocks]; mov rax, [rdx + rax * 8]; test rax, rax; jz exit; jmp rax
+	jit_op_mem(jit, true, false, 0x8B, 1, RDX, STATE_OP(blocks));
+	jit_op_mem(jit, true, false, 0x8B, 1, RAX, RDX, RAX, 8, 0);
+	jit_op_reg(jit, true, false, 0x85, 1, RAX, RAX);
+	size_t not_compiled = jit_jcc(jit, CC_E);
+	jit_op_reg(jit, false, false, 0xFF, 1, 4, RAX);
+
+	jit->exit_offset = jit->code_used;
+	jit_patch(jit, out_of_cycles, jit->exit_offset);
+	jit_patch(jit, out_of_range, jit->exit_offset);
+	jit_patch(jit, not_compiled, jit->exit_offset);
+	jit_store8(jit, REG_A, STATE(a));
+	jit_store8(jit, REG_X, STATE(x));
+	jit_store8(jit, REG_Y, STATE(y));
+	jit_store8(jit, REG_SP, STATE(sp));
+	jit_store8(jit, REG_FC, STATE(fc));
+	jit_store8(jit, REG_FZ, STATE(fz));
+	jit_store8(jit, REG_FN, STATE(fn));
+	jit_op_mem(jit, false, false, 0x89, 1, REG_CYCLES, STATE_OP(cycle));
+	jit_op_mem(jit, false, false, 0x89, 1, REG_PC, STATE_OP(pc));
+
+	for (int i = sizeof(saved) / sizeof(saved[0]) - 1; i >= 0; i--) {
+		jit_pop(jit, saved[i]);
+	}
+	jit_emit8(jit, 0xC3);
+
+	jit->code_start = jit->code_used;
+}
+
+bool cpu_jit_init(cpu_jit_t *jit)
+{
+	jit->code_size = JIT_CODE_SIZE;
+	#ifdef NESEMU_MACOS
+	// hardened runtimes only allow executable memory that is MAP_JIT
+	jit->code = mmap(NULL, jit->code_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+		MAP_PRIVATE | MAP_ANON | MAP_JIT, -1, 0);
+	#else
+	jit->code = mmap(NULL, jit->code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	#endif
+	if (jit->code == MAP_FAILED) {
+		jit->code = NULL;
+		return false;
+	}
+
+	jit->blocks = calloc(CPU_BLOCK_CACHE_SIZE, sizeof(uint8_t *));
+	jit->refused = calloc(CPU_BLOCK_CACHE_SIZE, sizeof(bool));
+	if (!jit->blocks || !jit->refused) {
+		cpu_jit_cleanup(jit);
+		return false;
+	}
+
+	// MAP_JIT memory starts out write protected for every thread
+	#ifdef NESEMU_MACOS
+	jit->writable = false;
+	#else
+	jit->writable = true;
+	#endif
+	if (!jit_set_writable(jit, true)) {
+		cpu_jit_cleanup(jit);
+		return false;
+	}
+	jit->code_used = 0;
+	jit_emit_entry(jit);
+	if (!jit_set_writable(jit, false)) {
+		cpu_jit_cleanup(jit);
+		return false;
+	}
+
+	jit->memory_writes = 0;
+	jit->mmc_type = 0;
+
+	return true;
+}
+
+void cpu_jit_cleanup(cpu_jit_t *jit)
+{
+	if (jit->code) {
+		munmap(jit->code, jit->code_size);
+	}
+	free(jit->blocks);
+	free(jit->refused);
+	jit->code = NULL;
+	jit->blocks = NULL;
+	jit->refused = NULL;
+}
+
+/*
+Same contract as cpu_run_threaded. Compiled blocks run until they reach code
+that isn't compiled (yet), which is then compiled or stepped through the
+threaded core, until end_cycle or something only the reference handlers can
+run.
+*/
+uint32_t cpu_run_jit(nes_cpu_t *cpu, cpu_jit_t *jit, cpu_block_cache_t *cache, uint32_t cpu_cycle, uint32_t end_cycle)
+{
+	uint8_t *mem = cpu->mem->data;
+	bool drop_writes = cpu->mmc_type == 1;
+
+	if (jit->memory_writes != cpu->mem->shared_writes || jit->mmc_type != cpu->mmc_type) {
+		jit->memory_writes = cpu->mem->shared_writes;
+		jit->mmc_type = cpu->mmc_type;
+		jit_reset(jit);
+	}
+
+	void (*entry)(jit_regs_t *);
+	uint8_t *code = jit->code;
+	memcpy(&entry, &code, sizeof(entry));
+
+	while (cpu_cycle < end_cycle) {
+		bool interrupt_due = cpu->nmi_input || (cpu->irq_input && !cpu->flags[FLAG_I]);
+
+		if (!interrupt_due && jit_in_range(cpu->pc) &&
+			(jit->blocks[cpu->pc - CPU_BLOCK_CACHE_START] || jit_compile(jit, mem, cpu->pc, drop_writes))) {
+			jit_regs_t regs = {
+				mem, cpu->mem->dirty, jit->blocks, cpu_cycle, end_cycle, cpu->frame_cycle, cpu->pc,
+				cpu->a, cpu->x, cpu->y, cpu->sp,
+				cpu->flags[FLAG_C], cpu_get_flag(cpu, FLAG_Z), cpu->flags[FLAG_I],
+				cpu->flags[FLAG_D], cpu->flags[FLAG_V], cpu_get_flag(cpu, FLAG_N)
+			};
+			// nothing can run from the buffer while it's writable
+			if (!jit_set_writable(jit, false)) {
+				log_event("Could not make the JIT code buffer executable!");
+				break;
+			}
+			entry(&regs);
+
+			cpu->frame_cycle = regs.frame_cycle;
+			cpu->pc = regs.pc;
+			cpu->a = regs.a;
+			cpu->x = regs.x;
+			cpu->y = regs.y;
+			cpu->sp = regs.sp;
+			cpu->flags[FLAG_C] = regs.fc;
+			cpu_set_flag(cpu, FLAG_Z, regs.fz);
+			cpu->flags[FLAG_I] = regs.fi;
+			cpu->flags[FLAG_D] = regs.fd;
+			cpu->flags[FLAG_V] = regs.fv;
+			cpu_set_flag(cpu, FLAG_N, regs.fn);
+			cpu->total_cycles += regs.cycle - cpu_cycle;
+
+			if (regs.cycle != cpu_cycle) {
+				cpu_cycle = regs.cycle;
+				continue;
+			}
+		}
+
+		// one instruction (and interrupt) through the threaded core
+		uint32_t next_cycle = cpu_run_threaded(cpu, cache, cpu_cycle, cpu_cycle + 1);
+		if (next_cycle == cpu_cycle) {
+			break;
+		}
+		cpu_cycle = next_cycle;
+	}
+
+	return cpu_cycle;
+}
+
+#else
+
+bool cpu_jit_init(cpu_jit_t *jit)
+{
+	jit->code = NULL;
+	return false;
+}
+
+void cpu_jit_cleanup(cpu_jit_t *jit)
+{
+}
+
+uint32_t cpu_run_jit(nes_cpu_t *cpu, cpu_jit_t *jit, cpu_block_cache_t *cache, uint32_t cpu_cycle, uint32_t end_cycle)
+{
+	return cpu_run_threaded(cpu, cache, cpu_cycle, end_cycle);
+}
+
+#endif
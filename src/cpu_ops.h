@@ -0,0 +1,146 @@
+#ifndef CPU_OPS_INCLUDE
+#define CPU_OPS_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+#include "ppu.h"
+
+/*
+Instruction semantics for code that runs 6502 instructions straight on
+memory.data, shared by the threaded core and the C the recompiler writes (see
+cpu_aot.h). They have to match the reference handlers in instructions.c
+exactly, quirks included.
+
+The macros work on locals the user declares: pc (already past the
+instruction), a, x, y, sp and fc, fz, fi, fd, fv, fn for the registers, imm8 /
+imm16 for the operand, cycles for what the instruction takes, addr, value,
+result and carry as scratch, and mem, dirty and drop_writes (mapper 1) for
+memory. Anything that has to go through mem_read_8 / mem_write_8 jumps to
+bail: before the instruction has changed anything.
+*/
+
+// The PPU registers and the APU / controller ones
+static inline bool cpu_is_io_register(uint16_t address)
+{
+	return (uint16_t)(address - PPUCTRL_ADDR) <= PPUDATA_ADDR - PPUCTRL_ADDR ||
+		(uint16_t)(address - CPU_IO_START) < CPU_IO_SIZE;
+}
+
+#define SET_NZ(v) do { fz = (uint8_t)(v) == 0; fn = (uint8_t)(v) >> 7; } while (0)
+#define GET_SR() (fc | (fz << 1) | (fi << 2) | (fd << 3) | (fv << 6) | (fn << 7))
+#define SET_SR(v) do { \
+	fc = (v) & 1; fz = ((v) >> 1) & 1; fi = ((v) >> 2) & 1; \
+	fd = ((v) >> 3) & 1; fv = ((v) >> 6) & 1; fn = (v) >> 7; \
+} while (0)
+
+// The reference helpers charge a cycle whenever base + index leaves the page
+#define PAGE_CROSS(base, index) (cycles += ((base) & 0xff) + (index) > 0xff)
+#define ZPG_POINTER(p) (mem[(uint8_t)(p)] | (mem[(uint8_t)((p) + 1)] << 8))
+
+#define MARK_DIRTY(address) \
+	(dirty[((address) >> MEMORY_PAGE_SHIFT) / 64] |= 1ULL << (((address) >> MEMORY_PAGE_SHIFT) % 64))
+
+// Reads address into value, unless it is an I/O register
+#define LOAD(address) do { \
+	addr = (address); \
+	if (cpu_is_io_register(addr)) { \
+		goto bail; \
+	} \
+	value = mem[addr]; \
+} while (0)
+
+// Operand of a read instruction into value
+#define READ_IMM() (value = imm8)
+#define READ_ZPG() (value = mem[imm8])
+#define READ_ZPG_X() (value = mem[(uint8_t)(imm8 + x)])
+#define READ_ZPG_Y() (value = mem[(uint8_t)(imm8 + y)])
+#define READ_ABS() LOAD(imm16)
+#define READ_ABS_X() do { PAGE_CROSS(imm16, x); LOAD(imm16 + x); } while (0)
+#define READ_ABS_Y() do { PAGE_CROSS(imm16, y); LOAD(imm16 + y); } while (0)
+#define READ_IND_Y() do { addr = ZPG_POINTER(imm8); PAGE_CROSS(addr, y); LOAD(addr + y); } while (0)
+#define READ_X_IND() LOAD(ZPG_POINTER(imm8 + x))
+
+// Target of a store or read-modify-write into addr
+#define ADDR_ZPG() (addr = imm8)
+#define ADDR_ZPG_X() do { PAGE_CROSS(imm8, x); addr = (uint8_t)(imm8 + x); } while (0)
+#define ADDR_ZPG_Y() do { PAGE_CROSS(imm8, y); addr = (uint8_t)(imm8 + y); } while (0)
+#define ADDR_ABS() (addr = imm16)
+#define ADDR_ABS_X() do { PAGE_CROSS(imm16, x); addr = imm16 + x; } while (0)
+#define ADDR_ABS_Y() do { PAGE_CROSS(imm16, y); addr = imm16 + y; } while (0)
+#define ADDR_IND_Y() (addr = ZPG_POINTER(imm8) + y)
+#define ADDR_X_IND() (addr = ZPG_POINTER(imm8 + x))
+
+// Mapper 1 writes go nowhere (see mem_write_8)
+#define STORE(v) do { \
+	if (!drop_writes) { \
+		if (addr >= CPU_RAM_SIZE) { \
+			goto bail; \
+		} \
+		mem[addr] = (v); \
+		MARK_DIRTY(addr); \
+	} \
+} while (0)
+
+// Reads addr into value for a read-modify-write, which needs the write to go through as well
+#define RMW_LOAD() do { \
+	if (cpu_is_io_register(addr) || (!drop_writes && addr >= CPU_RAM_SIZE)) { \
+		goto bail; \
+	} \
+	value = mem[addr]; \
+} while (0)
+
+#define RMW_STORE() do { \
+	if (!drop_writes) { \
+		mem[addr] = value; \
+		MARK_DIRTY(addr); \
+	} \
+} while (0)
+
+// The stack always lies in internal RAM
+#define PUSH_8(v) do { \
+	if (!drop_writes) { \
+		uint16_t push_addr_ = sp + 0x100; \
+		mem[push_addr_] = (v); \
+		MARK_DIRTY(push_addr_); \
+	} \
+	sp--; \
+} while (0)
+
+#define PUSH_16(v) do { \
+	if (!drop_writes) { \
+		uint16_t push_addr_ = (sp - 1) + 0x100; \
+		mem[push_addr_] = (v) & 0xff; \
+		mem[push_addr_ + 1] = (v) >> 8; \
+		MARK_DIRTY(push_addr_); \
+		MARK_DIRTY(push_addr_ + 1); \
+	} \
+	sp -= 2; \
+} while (0)
+
+#define POP_8(dst) do { sp++; (dst) = mem[sp + 0x100]; } while (0)
+#define POP_16(dst) do { sp += 2; (dst) = mem[(sp - 1) + 0x100] | (mem[sp + 0x100] << 8); } while (0)
+
+#define ADC(num) do { \
+	result = a + (num) + fc; \
+	fz = (uint8_t)result == 0; \
+	fc = (result >> 8) & 1; \
+	fn = (uint8_t)result >> 7; \
+	fv = ((a ^ (uint8_t)result) & ((num) ^ (uint8_t)result) & 0x80) == 0x80; \
+	a = (uint8_t)result; \
+} while (0)
+
+#define COMPARE(reg, num) do { fc = (reg) >= (num); SET_NZ((reg) - (num)); } while (0)
+
+#define ASL(v) do { fc = (v) >> 7; (v) <<= 1; } while (0)
+#define LSR(v) do { fc = (v) & 1; (v) >>= 1; } while (0)
+#define ROL(v) do { carry = fc; fc = (v) >> 7; (v) = ((v) << 1) | carry; } while (0)
+#define ROR(v) do { carry = fc; fc = (v) & 1; (v) = ((v) >> 1) | (carry << 7); } while (0)
+
+#define BRANCH(cond) do { \
+	if (cond) { \
+		cycles += (pc & 0xff) + imm8 > 0xff ? 2 : 1; \
+		pc += (int8_t)imm8; \
+	} \
+} while (0)
+
+#endif // CPU_OPS_INCLUDE
@@ -0,0 +1,695 @@
+#include "cpu.h"
+#include "memory.h"
+#include "ppu.h"
+#include "cpu_ops.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Threaded-code alternative to cpu_run_cycle, for the stretches of a frame where
+the CPU only runs plain code. A/X/Y/SP/PC and the flags live in locals for the
+whole run and every opcode jumps straight to the next one, using computed goto
+where the compiler has it (GCC / Clang) and a switch otherwise; define
+CPU_THREADED_USE_SWITCH to build the switch version anyway.
+
+Code in PRG ROM runs from the block cache (see cpu.h), everything else is
+decoded as it goes. Only RAM and ROM are accessed directly. Anything that
+would touch the PPU or APU / controller registers, write outside internal
+RAM, or is one of the unstable illegal opcodes stops the run before the
+instruction has changed anything, so the caller can run it through the
+reference handlers in instructions.c (which these have to match exactly,
+quirks included).
+*/
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(CPU_THREADED_USE_SWITCH)
+	#define CPU_THREADED_COMPUTED_GOTO
+	// label addresses and goto * are GNU extensions
+	#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define NOINLINE __attribute__((noinline))
+	// Keeps GCC from merging the byte stores in FLUSH_REGISTERS into one wide
+	// store, the value of which it then rebuilds after every instruction
+	#define STORE_BARRIER() __asm__ volatile("" ::: "memory")
+#elif defined(_MSC_VER)
+	#define NOINLINE __declspec(noinline)
+	#define STORE_BARRIER()
+#else
+	#define NOINLINE
+	#define STORE_BARRIER()
+#endif
+
+// Micro-ops past the 256 opcodes
+enum {
+	UOP_BLOCK_END = 256,
+	// Stands in for a block that's an idle loop, which the frame loop skips
+	UOP_IDLE_LOOP,
+
+	// Fused pairs, see cpu_block_fuse
+	UOP_LDA_ZPG_BEQ,
+	UOP_LDA_ZPG_BNE,
+	UOP_LDA_ZPG_AND_IMM,
+	UOP_AND_IMM_BEQ,
+	UOP_AND_IMM_BNE,
+	UOP_CMP_IMM_BEQ,
+	UOP_CMP_IMM_BNE,
+	UOP_DEX_BNE,
+	UOP_DEX_BPL,
+	UOP_DEY_BNE,
+	UOP_DEY_BPL,
+	UOP_CLC_ADC_IMM,
+
+	NUM_UOPS
+};
+
+#ifdef CPU_THREADED_COMPUTED_GOTO
+	#define DISPATCH(op) goto *dispatch_table[op];
+	#define OP(n) op_##n
+	#define OP_DEFAULT op_default
+#else
+	#define DISPATCH(op) switch (op)
+	#define OP(n) case n
+	#define OP_DEFAULT default
+#endif
+
+// Whether any of the 3 bytes from address on is an I/O register
+static inline bool threaded_window_is_io(uint16_t address)
+{
+	return (uint16_t)(address - (PPUCTRL_ADDR - 2)) <= PPUDATA_ADDR - PPUCTRL_ADDR + 2 ||
+		(uint16_t)(address - (CPU_IO_START - 2)) < CPU_IO_SIZE + 2;
+}
+
+#define FLUSH_REGISTERS() do { \
+	cpu->pc = pc; \
+	cpu->a = a; \
+	cpu->x = x; \
+	cpu->y = y; \
+	cpu->sp = sp; \
+	STORE_BARRIER(); \
+	cpu->flags[FLAG_C] = fc; \
+	cpu_set_flag(cpu, FLAG_Z, fz); \
+	cpu->flags[FLAG_I] = fi; \
+	cpu->flags[FLAG_D] = fd; \
+	cpu->flags[FLAG_V] = fv; \
+	cpu_set_flag(cpu, FLAG_N, fn); \
+	cpu->total_cycles = total_base + cpu_cycle; \
+} while (0)
+
+#define LOAD_REGISTERS() do { \
+	pc = cpu->pc; \
+	a = cpu->a; \
+	x = cpu->x; \
+	y = cpu->y; \
+	sp = cpu->sp; \
+	fc = cpu->flags[FLAG_C]; \
+	fz = cpu_get_flag(cpu, FLAG_Z); \
+	fi = cpu->flags[FLAG_I]; \
+	fd = cpu->flags[FLAG_D]; \
+	fv = cpu->flags[FLAG_V]; \
+	fn = cpu_get_flag(cpu, FLAG_N); \
+	total_base = cpu->total_cycles - cpu_cycle; \
+} while (0)
+
+#define INTERRUPT_PENDING() (cpu->nmi_input || (cpu->irq_input && !fi))
+
+/*
+The interrupt lines don't change during a run, so when no interrupt is due
+before the first half of a pair it isn't due after it either. Otherwise the
+first half runs on its own.
+*/
+#define FUSED_FIRST() do { \
+	if (INTERRUPT_PENDING()) { \
+		id = uop->op; \
+		goto dispatch; \
+	} \
+} while (0)
+
+// Finishes the first half like next would and loads the second
+#define FUSED_SECOND() do { \
+	cpu_cycle += cycles; \
+	uop++; \
+	if (cpu_cycle >= end_cycle) { \
+		goto done; \
+	} \
+	cpu->frame_cycle = cpu_cycle; \
+	instr_pc = uop->pc; \
+	imm16 = uop->imm16; \
+	imm8 = (uint8_t)imm16; \
+	pc = uop->next_pc; \
+	cycles = uop->cycles; \
+} while (0)
+
+bool cpu_block_cache_init(cpu_block_cache_t *cache)
+{
+	cache->blocks = calloc(CPU_BLOCK_CACHE_SIZE, sizeof(cpu_block_entry_t));
+	cache->ops = malloc(CPU_BLOCK_CACHE_OPS * sizeof(cpu_uop_t));
+	if (!cache->blocks || !cache->ops) {
+		cpu_block_cache_cleanup(cache);
+		return false;
+	}
+
+	cache->num_ops = 0;
+	cache->generation = 1;
+	cache->memory_writes = 0;
+
+	return true;
+}
+
+void cpu_block_cache_cleanup(cpu_block_cache_t *cache)
+{
+	free(cache->blocks);
+	free(cache->ops);
+	cache->blocks = NULL;
+	cache->ops = NULL;
+}
+
+static void cpu_block_cache_clear(cpu_block_cache_t *cache)
+{
+	cache->num_ops = 0;
+	cache->generation++;
+
+	// generations are about to repeat, so clear out the old entries
+	if (cache->generation == 0) {
+		memset(cache->blocks, 0, CPU_BLOCK_CACHE_SIZE * sizeof(cpu_block_entry_t));
+		cache->generation = 1;
+	}
+}
+
+static bool cpu_block_ends_with(uint8_t op)
+{
+	switch (op) {
+		// branches, JMP (ind), JSR, RTS, RTI and BRK. Blocks carry on at the
+		// target of a JMP abs
+		case 0x10: case 0x30: case 0x50: case 0x70:
+		case 0x90: case 0xB0: case 0xD0: case 0xF0:
+		case 0x6C: case 0x20: case 0x60: case 0x40: case 0x00:
+			return true;
+		default:
+			// KIL doesn't move on at all
+			return cpu_size_table[op] == 0;
+	}
+}
+
+/*
+Micro-op for the pair first, second, or 0 if they don't make one. These are
+the pairs that came up most in the test ROMs: polling loops, loop counters and
+bit tests. The first half can't stop the run or change I.
+*/
+static uint16_t cpu_block_fuse(uint8_t first, uint8_t second)
+{
+	switch ((first << 8) | second) {
+		case 0xA5F0: return UOP_LDA_ZPG_BEQ;
+		case 0xA5D0: return UOP_LDA_ZPG_BNE;
+		case 0xA529: return UOP_LDA_ZPG_AND_IMM;
+		case 0x29F0: return UOP_AND_IMM_BEQ;
+		case 0x29D0: return UOP_AND_IMM_BNE;
+		case 0xC9F0: return UOP_CMP_IMM_BEQ;
+		case 0xC9D0: return UOP_CMP_IMM_BNE;
+		case 0xCAD0: return UOP_DEX_BNE;
+		case 0xCA10: return UOP_DEX_BPL;
+		case 0x88D0: return UOP_DEY_BNE;
+		case 0x8810: return UOP_DEY_BPL;
+		case 0x1869: return UOP_CLC_ADC_IMM;
+		default: return 0;
+	}
+}
+
+// Decodes the block starting at pc, which has to be in the cached range
+NOINLINE
+static const cpu_uop_t *cpu_block_translate(cpu_block_cache_t *cache, const uint8_t *mem, uint16_t pc)
+{
+	if (cache->num_ops + CPU_BLOCK_MAX_OPS + 1 > CPU_BLOCK_CACHE_OPS) {
+		cpu_block_cache_clear(cache);
+	}
+
+	uint32_t start = cache->num_ops;
+	cpu_uop_t *block = &cache->ops[start];
+	cache->blocks[pc - CPU_BLOCK_CACHE_START] = (cpu_block_entry_t){start, cache->generation};
+
+	uint32_t num_ops = 0;
+	bool second_half = false;
+	for (;;) {
+		// idle loops are left to the frame loop, blocks stop short of them
+		cpu_idle_loop_t loop;
+		if (cpu_find_idle_loop(mem, pc, &loop)) {
+			if (num_ops == 0) {
+				block[num_ops++] = (cpu_uop_t){UOP_IDLE_LOOP, 0, 0, 0, pc, pc};
+			}
+			break;
+		}
+
+		uint8_t op = mem[pc];
+		uint16_t imm16 = mem[pc + 1] | (mem[pc + 2] << 8);
+		uint16_t next_pc = pc + cpu_size_table[op];
+
+		block[num_ops++] = (cpu_uop_t){op, op, cpu_cycle_count_table[op], imm16, pc, next_pc};
+		pc = op == 0x4C ? imm16 : next_pc;
+
+		// the second half of a pair keeps its own entry, which the pair reads
+		// its operands from and the plain first half falls through to
+		uint16_t fused = 0;
+		if (num_ops >= 2 && !second_half) {
+			fused = cpu_block_fuse(block[num_ops - 2].op, op);
+			if (fused) {
+				block[num_ops - 2].id = fused;
+			}
+		}
+		second_half = fused != 0;
+
+		// the next instruction's operand bytes have to stay below 0x10000
+		if (cpu_block_ends_with(op) || num_ops == CPU_BLOCK_MAX_OPS ||
+			(uint16_t)(pc - CPU_BLOCK_CACHE_START) >= CPU_BLOCK_CACHE_SIZE - 2) {
+			break;
+		}
+	}
+
+	block[num_ops++] = (cpu_uop_t){UOP_BLOCK_END, 0, 0, 0, pc, pc};
+	cache->num_ops += num_ops;
+
+	return block;
+}
+
+static inline const cpu_uop_t *cpu_block_lookup(cpu_block_cache_t *cache, const uint8_t *mem, uint16_t pc)
+{
+	cpu_block_entry_t entry = cache->blocks[pc - CPU_BLOCK_CACHE_START];
+	if (entry.generation == cache->generation) {
+		return &cache->ops[entry.start];
+	}
+
+	return cpu_block_translate(cache, mem, pc);
+}
+
+/*
+Runs instructions from cpu_cycle (within the frame) until one would start on
+or after end_cycle, or needs the reference handlers. Returns the cycle the CPU
+got to, which can be past end_cycle by the last instruction's cycles (the
+caller carries them into wait_cycles). The CPU has to be between instructions
+without wait cycles, and nothing may be scheduled before end_cycle.
+*/
+uint32_t cpu_run_threaded(nes_cpu_t *cpu, cpu_block_cache_t *cache, uint32_t cpu_cycle, uint32_t end_cycle)
+{
+	uint8_t *mem = cpu->mem->data;
+	uint64_t *dirty = cpu->mem->dirty;
+	bool drop_writes = cpu->mmc_type == 1;
+
+	// nothing run here writes outside RAM, so this can only change in between
+	if (cache->memory_writes != cpu->mem->shared_writes) {
+		cache->memory_writes = cpu->mem->shared_writes;
+		cpu_block_cache_clear(cache);
+	}
+	const cpu_uop_t *uop = NULL;
+
+	uint16_t pc;
+	uint8_t a, x, y, sp;
+	uint8_t fc, fz, fi, fd, fv, fn;
+	// total_cycles - cpu_cycle, which only interrupts change
+	uint32_t total_base;
+	LOAD_REGISTERS();
+
+	uint16_t instr_pc, id;
+	uint8_t op, imm8;
+	uint16_t imm16, addr, result;
+	uint8_t value, carry;
+	uint32_t cycles;
+
+	#ifdef CPU_THREADED_COMPUTED_GOTO
+	static const void *const dispatch_table[NUM_UOPS] = {
+		&&op_0x00, &&op_0x01, &&op_default, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07, &&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+		&&op_0x10, &&op_0x11, &&op_default, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17, &&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+		&&op_0x20, &&op_0x21, &&op_default, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27, &&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+		&&op_0x30, &&op_0x31, &&op_default, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37, &&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+		&&op_0x40, &&op_0x41, &&op_default, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47, &&op_0x48, &&op_0x49, &&op_0x4A, &&op_default, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+		&&op_0x50, &&op_0x51, &&op_default, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57, &&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+		&&op_0x60, &&op_0x61, &&op_default, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67, &&op_0x68, &&op_0x69, &&op_0x6A, &&op_default, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+		&&op_0x70, &&op_0x71, &&op_default, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77, &&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+		&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87, &&op_0x88, &&op_0x89, &&op_0x8A, &&op_default, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+		&&op_0x90, &&op_0x91, &&op_default, &&op_default, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97, &&op_0x98, &&op_0x99, &&op_0x9A, &&op_default, &&op_default, &&op_0x9D, &&op_default, &&op_default,
+		&&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7, &&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+		&&op_0xB0, &&op_0xB1, &&op_default, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7, &&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_default, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+		&&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7, &&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_default, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+		&&op_0xD0, &&op_0xD1, &&op_default, &&op_0xD3, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7, &&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_0xDD, &&op_0xDE, &&op_0xDF,
+		&&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7, &&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_0xED, &&op_0xEE, &&op_0xEF,
+		&&op_0xF0, &&op_0xF1, &&op_default, &&op_0xF3, &&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7, &&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_0xFD, &&op_0xFE, &&op_0xFF,
+		&&op_UOP_BLOCK_END, &&op_UOP_IDLE_LOOP,
+		&&op_UOP_LDA_ZPG_BEQ, &&op_UOP_LDA_ZPG_BNE, &&op_UOP_LDA_ZPG_AND_IMM,
+		&&op_UOP_AND_IMM_BEQ, &&op_UOP_AND_IMM_BNE, &&op_UOP_CMP_IMM_BEQ, &&op_UOP_CMP_IMM_BNE,
+		&&op_UOP_DEX_BNE, &&op_UOP_DEX_BPL, &&op_UOP_DEY_BNE, &&op_UOP_DEY_BPL,
+		&&op_UOP_CLC_ADC_IMM
+	};
+	#endif
+
+	goto fetch;
+
+next:
+	// what cpu_run_cycle and nes_skip_cpu_wait do after every instruction.
+	// Interrupt cycles don't count towards total_cycles
+	cpu_cycle += cycles;
+	if (INTERRUPT_PENDING()) {
+		FLUSH_REGISTERS();
+		cpu->wait_cycles = cycles;
+		cpu_check_interrupts(cpu);
+		cpu_cycle += cpu->wait_cycles - cycles;
+		cpu->wait_cycles = 0;
+		LOAD_REGISTERS();
+	}
+
+	// carry on with the block, unless the instruction jumped somewhere else
+	if (uop) {
+		uop++;
+		if (uop->pc == pc && uop->id != UOP_BLOCK_END && cpu_cycle < end_cycle) {
+			goto run_uop;
+		}
+	}
+
+fetch:
+	if (cpu_cycle >= end_cycle) {
+		goto done;
+	}
+
+	if ((uint16_t)(pc - CPU_BLOCK_CACHE_START) < CPU_BLOCK_CACHE_SIZE - 2) {
+		uop = cpu_block_lookup(cache, mem, pc);
+		goto run_uop;
+	}
+
+	uop = NULL;
+	if (threaded_window_is_io(pc)) {
+		goto done;
+	}
+
+	cpu->frame_cycle = cpu_cycle;
+	instr_pc = pc;
+	op = mem[pc];
+	imm8 = mem[(uint16_t)(pc + 1)];
+	imm16 = imm8 | (mem[(uint16_t)(pc + 2)] << 8);
+	pc += cpu_size_table[op];
+	cycles = cpu_cycle_count_table[op];
+	id = op;
+	goto dispatch;
+
+run_uop:
+	cpu->frame_cycle = cpu_cycle;
+	instr_pc = uop->pc;
+	imm16 = uop->imm16;
+	imm8 = (uint8_t)imm16;
+	pc = uop->next_pc;
+	cycles = uop->cycles;
+	id = uop->id;
+
+dispatch:
+	DISPATCH(id) {
+		OP(0x69): READ_IMM(); ADC(value); goto next;
+		OP(0x65): READ_ZPG(); ADC(value); goto next;
+		OP(0x75): READ_ZPG_X(); ADC(value); goto next;
+		OP(0x6D): READ_ABS(); ADC(value); goto next;
+		OP(0x7D): READ_ABS_X(); ADC(value); goto next;
+		OP(0x79): READ_ABS_Y(); ADC(value); goto next;
+		OP(0x61): READ_X_IND(); ADC(value); goto next;
+		OP(0x71): READ_IND_Y(); ADC(value); goto next;
+
+		OP(0x29): READ_IMM(); a &= value; SET_NZ(a); goto next;
+		OP(0x25): READ_ZPG(); a &= value; SET_NZ(a); goto next;
+		OP(0x35): READ_ZPG_X(); a &= value; SET_NZ(a); goto next;
+		OP(0x2D): READ_ABS(); a &= value; SET_NZ(a); goto next;
+		OP(0x3D): READ_ABS_X(); a &= value; SET_NZ(a); goto next;
+		OP(0x39): READ_ABS_Y(); a &= value; SET_NZ(a); goto next;
+		OP(0x21): READ_X_IND(); a &= value; SET_NZ(a); goto next;
+		OP(0x31): READ_IND_Y(); a &= value; SET_NZ(a); goto next;
+
+		OP(0x0B):
+		OP(0x2B): a &= imm8; SET_NZ(a); fc = fn; goto next;
+
+		OP(0x0A): ASL(a); SET_NZ(a); goto next;
+		OP(0x06): ADDR_ZPG(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x16): ADDR_ZPG_X(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x0E): ADDR_ABS(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x1E): ADDR_ABS_X(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE(); goto next;
+
+		OP(0x90): BRANCH(!fc); goto next;
+		OP(0xB0): BRANCH(fc); goto next;
+		OP(0xF0): BRANCH(fz); goto next;
+		OP(0x30): BRANCH(fn); goto next;
+		OP(0xD0): BRANCH(!fz); goto next;
+		OP(0x10): BRANCH(!fn); goto next;
+		OP(0x50): BRANCH(!fv); goto next;
+		OP(0x70): BRANCH(fv); goto next;
+
+		OP(0x24): READ_ZPG(); fz = (a & value) == 0; fn = value >> 7; fv = (value >> 6) & 1; goto next;
+		OP(0x2C): READ_ABS(); fz = (a & value) == 0; fn = value >> 7; fv = (value >> 6) & 1; goto next;
+
+		// BRK doesn't jump anywhere in the reference either
+		OP(0x00): PUSH_16(pc); PUSH_8(GET_SR() | 0b00110000); fi = 1; goto next;
+
+		OP(0x18): fc = 0; goto next;
+		OP(0xD8): fd = 0; goto next;
+		OP(0x58): fi = 0; goto next;
+		OP(0xB8): fv = 0; goto next;
+
+		OP(0xC9): READ_IMM(); COMPARE(a, value); goto next;
+		OP(0xC5): READ_ZPG(); COMPARE(a, value); goto next;
+		OP(0xD5): READ_ZPG_X(); COMPARE(a, value); goto next;
+		OP(0xCD): READ_ABS(); COMPARE(a, value); goto next;
+		OP(0xDD): READ_ABS_X(); COMPARE(a, value); goto next;
+		OP(0xD9): READ_ABS_Y(); COMPARE(a, value); goto next;
+		OP(0xC1): READ_X_IND(); COMPARE(a, value); goto next;
+		OP(0xD1): READ_IND_Y(); COMPARE(a, value); goto next;
+
+		OP(0xE0): READ_IMM(); COMPARE(x, value); goto next;
+		OP(0xE4): READ_ZPG(); COMPARE(x, value); goto next;
+		OP(0xEC): READ_ABS(); COMPARE(x, value); goto next;
+		OP(0xC0): READ_IMM(); COMPARE(y, value); goto next;
+		OP(0xC4): READ_ZPG(); COMPARE(y, value); goto next;
+		OP(0xCC): READ_ABS(); COMPARE(y, value); goto next;
+
+		OP(0xC7): ADDR_ZPG(); RMW_LOAD(); value--; RMW_STORE(); COMPARE(a, value); goto next;
+		OP(0xD7): ADDR_ZPG_X(); RMW_LOAD(); value--; RMW_STORE(); COMPARE(a, value); goto next;
+		OP(0xCF): ADDR_ABS(); RMW_LOAD(); value--; RMW_STORE(); COMPARE(a, value); goto next;
+		OP(0xDF): ADDR_ABS_X(); RMW_LOAD(); value--; RMW_STORE(); COMPARE(a, value); goto next;
+		OP(0xDB): ADDR_ABS_Y(); RMW_LOAD(); value--; RMW_STORE(); COMPARE(a, value); goto next;
+		OP(0xC3): ADDR_X_IND(); RMW_LOAD(); value--; RMW_STORE(); COMPARE(a, value); goto next;
+		OP(0xD3): ADDR_IND_Y(); RMW_LOAD(); value--; RMW_STORE(); COMPARE(a, value); goto next;
+
+		OP(0xC6): ADDR_ZPG(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xD6): ADDR_ZPG_X(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xCE): ADDR_ABS(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xDE): ADDR_ABS_X(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xCA): x--; SET_NZ(x); goto next;
+		OP(0x88): y--; SET_NZ(y); goto next;
+
+		OP(0x49): READ_IMM(); a ^= value; SET_NZ(a); goto next;
+		OP(0x45): READ_ZPG(); a ^= value; SET_NZ(a); goto next;
+		OP(0x55): READ_ZPG_X(); a ^= value; SET_NZ(a); goto next;
+		OP(0x4D): READ_ABS(); a ^= value; SET_NZ(a); goto next;
+		OP(0x5D): READ_ABS_X(); a ^= value; SET_NZ(a); goto next;
+		OP(0x59): READ_ABS_Y(); a ^= value; SET_NZ(a); goto next;
+		OP(0x41): READ_X_IND(); a ^= value; SET_NZ(a); goto next;
+		OP(0x51): READ_IND_Y(); a ^= value; SET_NZ(a); goto next;
+
+		OP(0xE6): ADDR_ZPG(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xF6): ADDR_ZPG_X(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xEE): ADDR_ABS(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xFE): ADDR_ABS_X(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE(); goto next;
+		OP(0xE8): x++; SET_NZ(x); goto next;
+		OP(0xC8): y++; SET_NZ(y); goto next;
+
+		OP(0xE7): ADDR_ZPG(); RMW_LOAD(); value++; RMW_STORE(); ADC((uint8_t)~value); goto next;
+		OP(0xF7): ADDR_ZPG_X(); RMW_LOAD(); value++; RMW_STORE(); ADC((uint8_t)~value); goto next;
+		OP(0xEF): ADDR_ABS(); RMW_LOAD(); value++; RMW_STORE(); ADC((uint8_t)~value); goto next;
+		OP(0xFF): ADDR_ABS_X(); RMW_LOAD(); value++; RMW_STORE(); ADC((uint8_t)~value); goto next;
+		OP(0xFB): ADDR_ABS_Y(); RMW_LOAD(); value++; RMW_STORE(); ADC((uint8_t)~value); goto next;
+		OP(0xE3): ADDR_X_IND(); RMW_LOAD(); value++; RMW_STORE(); ADC((uint8_t)~value); goto next;
+		OP(0xF3): ADDR_IND_Y(); RMW_LOAD(); value++; RMW_STORE(); ADC((uint8_t)~value); goto next;
+
+		OP(0x4C): pc = imm16; goto next;
+		OP(0x6C):
+			LOAD(imm16);
+			carry = value;
+			LOAD((imm16 & 0xff00) | (uint8_t)((imm16 & 0xff) + 1));
+			pc = (value << 8) | carry;
+			goto next;
+		OP(0x20): PUSH_16((uint16_t)(pc - 1)); pc = imm16; goto next;
+
+		OP(0xA7): READ_ZPG(); a = x = value; SET_NZ(a); goto next;
+		OP(0xB7): READ_ZPG_Y(); a = x = value; SET_NZ(a); goto next;
+		OP(0xAF): READ_ABS(); a = x = value; SET_NZ(a); goto next;
+		OP(0xBF): READ_ABS_Y(); a = x = value; SET_NZ(a); goto next;
+		OP(0xA3): READ_X_IND(); a = x = value; SET_NZ(a); goto next;
+		OP(0xB3): READ_IND_Y(); a = x = value; SET_NZ(a); goto next;
+		OP(0xAB): READ_IMM(); a = x = value; SET_NZ(a); goto next;
+
+		OP(0xA9): READ_IMM(); a = value; SET_NZ(a); goto next;
+		OP(0xA5): READ_ZPG(); a = value; SET_NZ(a); goto next;
+		OP(0xB5): READ_ZPG_X(); a = value; SET_NZ(a); goto next;
+		OP(0xAD): READ_ABS(); a = value; SET_NZ(a); goto next;
+		OP(0xBD): READ_ABS_X(); a = value; SET_NZ(a); goto next;
+		OP(0xB9): READ_ABS_Y(); a = value; SET_NZ(a); goto next;
+		OP(0xA1): READ_X_IND(); a = value; SET_NZ(a); goto next;
+		OP(0xB1): READ_IND_Y(); a = value; SET_NZ(a); goto next;
+
+		OP(0xA2): READ_IMM(); x = value; SET_NZ(x); goto next;
+		OP(0xA6): READ_ZPG(); x = value; SET_NZ(x); goto next;
+		OP(0xB6): READ_ZPG_Y(); x = value; SET_NZ(x); goto next;
+		OP(0xAE): READ_ABS(); x = value; SET_NZ(x); goto next;
+		OP(0xBE): READ_ABS_Y(); x = value; SET_NZ(x); goto next;
+
+		OP(0xA0): READ_IMM(); y = value; SET_NZ(y); goto next;
+		OP(0xA4): READ_ZPG(); y = value; SET_NZ(y); goto next;
+		OP(0xB4): READ_ZPG_X(); y = value; SET_NZ(y); goto next;
+		OP(0xAC): READ_ABS(); y = value; SET_NZ(y); goto next;
+		OP(0xBC): READ_ABS_X(); y = value; SET_NZ(y); goto next;
+
+		OP(0x4A): LSR(a); SET_NZ(a); goto next;
+		OP(0x46): ADDR_ZPG(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x56): ADDR_ZPG_X(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x4E): ADDR_ABS(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x5E): ADDR_ABS_X(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE(); goto next;
+
+		// NOPs, the illegal ones with an operand don't even read it
+		OP(0xEA):
+		OP(0x1A): OP(0x3A): OP(0x5A): OP(0x7A): OP(0xDA): OP(0xFA):
+		OP(0x80): OP(0x82): OP(0x89): OP(0xC2): OP(0xE2):
+		OP(0x04): OP(0x44): OP(0x64):
+		OP(0x14): OP(0x34): OP(0x54): OP(0x74): OP(0xD4): OP(0xF4):
+		OP(0x0C):
+		OP(0x1C): OP(0x3C): OP(0x5C): OP(0x7C): OP(0xDC): OP(0xFC):
+			goto next;
+
+		OP(0x09): READ_IMM(); a |= value; SET_NZ(a); goto next;
+		OP(0x05): READ_ZPG(); a |= value; SET_NZ(a); goto next;
+		OP(0x15): READ_ZPG_X(); a |= value; SET_NZ(a); goto next;
+		OP(0x0D): READ_ABS(); a |= value; SET_NZ(a); goto next;
+		OP(0x1D): READ_ABS_X(); a |= value; SET_NZ(a); goto next;
+		OP(0x19): READ_ABS_Y(); a |= value; SET_NZ(a); goto next;
+		OP(0x01): READ_X_IND(); a |= value; SET_NZ(a); goto next;
+		OP(0x11): READ_IND_Y(); a |= value; SET_NZ(a); goto next;
+
+		OP(0x48): PUSH_8(a); goto next;
+		OP(0x08): PUSH_8(GET_SR() | 0b00110000); goto next;
+		OP(0x68): POP_8(a); SET_NZ(a); goto next;
+		OP(0x28): POP_8(value); SET_SR(value); goto next;
+
+		OP(0x27): ADDR_ZPG(); RMW_LOAD(); ROL(value); RMW_STORE(); a &= value; SET_NZ(a); goto next;
+		OP(0x37): ADDR_ZPG_X(); RMW_LOAD(); ROL(value); RMW_STORE(); a &= value; SET_NZ(a); goto next;
+		OP(0x2F): ADDR_ABS(); RMW_LOAD(); ROL(value); RMW_STORE(); a &= value; SET_NZ(a); goto next;
+		OP(0x3F): ADDR_ABS_X(); RMW_LOAD(); ROL(value); RMW_STORE(); a &= value; SET_NZ(a); goto next;
+		OP(0x3B): ADDR_ABS_Y(); RMW_LOAD(); ROL(value); RMW_STORE(); a &= value; SET_NZ(a); goto next;
+		OP(0x23): ADDR_X_IND(); RMW_LOAD(); ROL(value); RMW_STORE(); a &= value; SET_NZ(a); goto next;
+		OP(0x33): ADDR_IND_Y(); RMW_LOAD(); ROL(value); RMW_STORE(); a &= value; SET_NZ(a); goto next;
+
+		OP(0x2A): ROL(a); SET_NZ(a); goto next;
+		OP(0x26): ADDR_ZPG(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x36): ADDR_ZPG_X(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x2E): ADDR_ABS(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x3E): ADDR_ABS_X(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE(); goto next;
+
+		OP(0x6A): ROR(a); SET_NZ(a); goto next;
+		OP(0x66): ADDR_ZPG(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x76): ADDR_ZPG_X(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x6E): ADDR_ABS(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE(); goto next;
+		OP(0x7E): ADDR_ABS_X(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE(); goto next;
+
+		OP(0x67): ADDR_ZPG(); RMW_LOAD(); ROR(value); RMW_STORE(); ADC(value); goto next;
+		OP(0x77): ADDR_ZPG_X(); RMW_LOAD(); ROR(value); RMW_STORE(); ADC(value); goto next;
+		OP(0x6F): ADDR_ABS(); RMW_LOAD(); ROR(value); RMW_STORE(); ADC(value); goto next;
+		OP(0x7F): ADDR_ABS_X(); RMW_LOAD(); ROR(value); RMW_STORE(); ADC(value); goto next;
+		OP(0x7B): ADDR_ABS_Y(); RMW_LOAD(); ROR(value); RMW_STORE(); ADC(value); goto next;
+		OP(0x63): ADDR_X_IND(); RMW_LOAD(); ROR(value); RMW_STORE(); ADC(value); goto next;
+		OP(0x73): ADDR_IND_Y(); RMW_LOAD(); ROR(value); RMW_STORE(); ADC(value); goto next;
+
+		OP(0x40): POP_8(value); SET_SR(value); POP_16(pc); goto next;
+		OP(0x60): POP_16(pc); pc++; goto next;
+
+		OP(0x87): ADDR_ZPG(); STORE(a & x); goto next;
+		OP(0x97): ADDR_ZPG_Y(); STORE(a & x); goto next;
+		OP(0x8F): ADDR_ABS(); STORE(a & x); goto next;
+		OP(0x83): ADDR_X_IND(); STORE(a & x); goto next;
+
+		OP(0xE9):
+		OP(0xEB): READ_IMM(); ADC((uint8_t)~value); goto next;
+		OP(0xE5): READ_ZPG(); ADC((uint8_t)~value); goto next;
+		OP(0xF5): READ_ZPG_X(); ADC((uint8_t)~value); goto next;
+		OP(0xED): READ_ABS(); ADC((uint8_t)~value); goto next;
+		OP(0xFD): READ_ABS_X(); ADC((uint8_t)~value); goto next;
+		OP(0xF9): READ_ABS_Y(); ADC((uint8_t)~value); goto next;
+		OP(0xE1): READ_X_IND(); ADC((uint8_t)~value); goto next;
+		OP(0xF1): READ_IND_Y(); ADC((uint8_t)~value); goto next;
+
+		OP(0x38): fc = 1; goto next;
+		OP(0xF8): fd = 1; goto next;
+		OP(0x78): fi = 1; goto next;
+
+		OP(0x07): ADDR_ZPG(); RMW_LOAD(); ASL(value); RMW_STORE(); a |= value; SET_NZ(a); goto next;
+		OP(0x17): ADDR_ZPG_X(); RMW_LOAD(); ASL(value); RMW_STORE(); a |= value; SET_NZ(a); goto next;
+		OP(0x0F): ADDR_ABS(); RMW_LOAD(); ASL(value); RMW_STORE(); a |= value; SET_NZ(a); goto next;
+		OP(0x1F): ADDR_ABS_X(); RMW_LOAD(); ASL(value); RMW_STORE(); a |= value; SET_NZ(a); goto next;
+		OP(0x1B): ADDR_ABS_Y(); RMW_LOAD(); ASL(value); RMW_STORE(); a |= value; SET_NZ(a); goto next;
+		OP(0x03): ADDR_X_IND(); RMW_LOAD(); ASL(value); RMW_STORE(); a |= value; SET_NZ(a); goto next;
+		OP(0x13): ADDR_IND_Y(); RMW_LOAD(); ASL(value); RMW_STORE(); a |= value; SET_NZ(a); goto next;
+
+		OP(0x47): ADDR_ZPG(); RMW_LOAD(); LSR(value); RMW_STORE(); a ^= value; SET_NZ(a); goto next;
+		OP(0x57): ADDR_ZPG_X(); RMW_LOAD(); LSR(value); RMW_STORE(); a ^= value; SET_NZ(a); goto next;
+		OP(0x4F): ADDR_ABS(); RMW_LOAD(); LSR(value); RMW_STORE(); a ^= value; SET_NZ(a); goto next;
+		OP(0x5F): ADDR_ABS_X(); RMW_LOAD(); LSR(value); RMW_STORE(); a ^= value; SET_NZ(a); goto next;
+		OP(0x5B): ADDR_ABS_Y(); RMW_LOAD(); LSR(value); RMW_STORE(); a ^= value; SET_NZ(a); goto next;
+		OP(0x43): ADDR_X_IND(); RMW_LOAD(); LSR(value); RMW_STORE(); a ^= value; SET_NZ(a); goto next;
+		OP(0x53): ADDR_IND_Y(); RMW_LOAD(); LSR(value); RMW_STORE(); a ^= value; SET_NZ(a); goto next;
+
+		OP(0x85): ADDR_ZPG(); STORE(a); goto next;
+		OP(0x95): ADDR_ZPG_X(); STORE(a); goto next;
+		OP(0x8D): ADDR_ABS(); STORE(a); goto next;
+		OP(0x9D): ADDR_ABS_X(); STORE(a); goto next;
+		OP(0x99): ADDR_ABS_Y(); STORE(a); goto next;
+		OP(0x81): ADDR_X_IND(); STORE(a); goto next;
+		OP(0x91): ADDR_IND_Y(); STORE(a); goto next;
+
+		OP(0x86): ADDR_ZPG(); STORE(x); goto next;
+		OP(0x96): ADDR_ZPG_Y(); STORE(x); goto next;
+		OP(0x8E): ADDR_ABS(); STORE(x); goto next;
+		OP(0x84): ADDR_ZPG(); STORE(y); goto next;
+		OP(0x94): ADDR_ZPG_X(); STORE(y); goto next;
+		OP(0x8C): ADDR_ABS(); STORE(y); goto next;
+
+		OP(0xAA): x = a; SET_NZ(x); goto next;
+		OP(0xA8): y = a; SET_NZ(y); goto next;
+		OP(0xBA): x = sp; SET_NZ(x); goto next;
+		OP(0x8A): a = x; SET_NZ(a); goto next;
+		OP(0x9A): sp = x; goto next;
+		OP(0x98): a = y; SET_NZ(a); goto next;
+
+		// falling off the end of a block, continue with the next one
+		OP(UOP_BLOCK_END):
+			pc = instr_pc;
+			goto fetch;
+
+		OP(UOP_IDLE_LOOP):
+			pc = instr_pc;
+			goto done;
+
+		OP(UOP_LDA_ZPG_BEQ): FUSED_FIRST(); READ_ZPG(); a = value; SET_NZ(a); FUSED_SECOND(); BRANCH(fz); goto next;
+		OP(UOP_LDA_ZPG_BNE): FUSED_FIRST(); READ_ZPG(); a = value; SET_NZ(a); FUSED_SECOND(); BRANCH(!fz); goto next;
+		OP(UOP_LDA_ZPG_AND_IMM):
+			FUSED_FIRST(); READ_ZPG(); a = value; SET_NZ(a);
+			FUSED_SECOND(); READ_IMM(); a &= value; SET_NZ(a); goto next;
+		OP(UOP_AND_IMM_BEQ): FUSED_FIRST(); READ_IMM(); a &= value; SET_NZ(a); FUSED_SECOND(); BRANCH(fz); goto next;
+		OP(UOP_AND_IMM_BNE): FUSED_FIRST(); READ_IMM(); a &= value; SET_NZ(a); FUSED_SECOND(); BRANCH(!fz); goto next;
+		OP(UOP_CMP_IMM_BEQ): FUSED_FIRST(); READ_IMM(); COMPARE(a, value); FUSED_SECOND(); BRANCH(fz); goto next;
+		OP(UOP_CMP_IMM_BNE): FUSED_FIRST(); READ_IMM(); COMPARE(a, value); FUSED_SECOND(); BRANCH(!fz); goto next;
+		OP(UOP_DEX_BNE): FUSED_FIRST(); x--; SET_NZ(x); FUSED_SECOND(); BRANCH(!fz); goto next;
+		OP(UOP_DEX_BPL): FUSED_FIRST(); x--; SET_NZ(x); FUSED_SECOND(); BRANCH(!fn); goto next;
+		OP(UOP_DEY_BNE): FUSED_FIRST(); y--; SET_NZ(y); FUSED_SECOND(); BRANCH(!fz); goto next;
+		OP(UOP_DEY_BPL): FUSED_FIRST(); y--; SET_NZ(y); FUSED_SECOND(); BRANCH(!fn); goto next;
+		OP(UOP_CLC_ADC_IMM): FUSED_FIRST(); fc = 0; FUSED_SECOND(); READ_IMM(); ADC(value); goto next;
+
+		// KIL and the unstable / unfinished illegal opcodes
+		OP_DEFAULT:
+			goto bail;
+	}
+
+bail:
+	// leave the instruction to the reference handlers
+	pc = instr_pc;
+
+done:
+	FLUSH_REGISTERS();
+	return cpu_cycle;
+}
@@ -0,0 +1,173 @@
+#if defined NESEMU_LINUX || defined NESEMU_MACOS
+// fork / pipe / poll are POSIX, which a strict -std=c23 build hides
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "explore.h"
+#include "utils.h"
+#include <string.h>
+
+#if defined NESEMU_LINUX || defined NESEMU_MACOS
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef struct {
+	pid_t pid;
+	int fd;
+	uint32_t branch;
+} explore_child_t;
+
+// Runs in the child, which never returns from here
+static void explore_branch(nes_t *nes, const explore_options_t *opts, uint32_t branch, int fd)
+{
+	// nothing is shown, so nothing needs to be drawn
+	nes->callbacks = (nes_callbacks_t){0};
+
+	for (uint32_t i = 0; i < opts->depth; i++) {
+		nes->key_state = branch;
+		nes->skip_render = true;
+		nes_do_frame_cycle(nes);
+	}
+
+	explore_result_t result = {
+		branch,
+		branch,
+		nes->memory.data[opts->score_addr],
+		true,
+		hash_bytes(nes->memory.data, CPU_RAM_SIZE)
+	};
+
+	// smaller than PIPE_BUF, so the write can't be split
+	bool code = write(fd, &result, sizeof(result)) == sizeof(result);
+	close(fd);
+
+	// _exit so the parent's stdio buffers aren't flushed a second time
+	_exit(code ? 0 : 1);
+}
+
+static bool explore_spawn(nes_t *nes, const explore_options_t *opts, uint32_t branch, explore_child_t *child)
+{
+	int fds[2];
+	if (pipe(fds) != 0) {
+		log_event("Could not create pipe: %s", strerror(errno));
+		return false;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		log_event("Could not fork: %s", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		explore_branch(nes, opts, branch, fds[1]);
+	}
+
+	close(fds[1]);
+	child->pid = pid;
+	child->fd = fds[0];
+	child->branch = branch;
+	return true;
+}
+
+static void explore_collect(explore_child_t *child, explore_result_t *results)
+{
+	explore_result_t result;
+	ssize_t size;
+	do {
+		size = read(child->fd, &result, sizeof(result));
+	} while (size < 0 && errno == EINTR);
+
+	if (size == sizeof(result)) {
+		results[child->branch] = result;
+	} else {
+		log_event("Branch %u died without a result", child->branch);
+		results[child->branch] = (explore_result_t){child->branch, child->branch, 0, false, 0};
+	}
+
+	close(child->fd);
+	waitpid(child->pid, NULL, 0);
+}
+
+/*
+Runs num_branches branches (branch n holds key_state n) from the current
+state of nes, at most opts->workers at a time, and fills results indexed by
+branch. nes itself isn't advanced.
+*/
+bool explore_run(nes_t *nes, const explore_options_t *opts, explore_result_t *results, uint32_t num_branches)
+{
+	if (num_branches > EXPLORE_MAX_BRANCHES || opts->workers == 0) {
+		log_event("Invalid exploration options!");
+		return false;
+	}
+
+	explore_child_t children[EXPLORE_MAX_BRANCHES];
+	struct pollfd fds[EXPLORE_MAX_BRANCHES];
+	uint32_t running = 0;
+	uint32_t next_branch = 0;
+	uint32_t done = 0;
+	bool code = true;
+
+	// buffered output would otherwise be written once per child
+	fflush(NULL);
+
+	while (done < num_branches) {
+		while (code && running < opts->workers && next_branch < num_branches) {
+			if (!explore_spawn(nes, opts, next_branch, &children[running])) {
+				code = false;
+				break;
+			}
+			next_branch++;
+			running++;
+		}
+
+		if (running == 0) {
+			break;
+		}
+
+		for (uint32_t i = 0; i < running; i++) {
+			fds[i].fd = children[i].fd;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+
+		if (poll(fds, running, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			log_event("poll failed: %s", strerror(errno));
+			code = false;
+			// collecting below blocks on every child in turn
+			for (uint32_t i = 0; i < running; i++) {
+				fds[i].revents = POLLIN;
+			}
+		}
+
+		// collect finished children, moving the last running one into the gap
+		for (uint32_t i = running; i-- > 0;) {
+			if (fds[i].revents == 0) {
+				continue;
+			}
+
+			explore_collect(&children[i], results);
+			children[i] = children[running - 1];
+			running--;
+			done++;
+		}
+	}
+
+	return code && done == num_branches;
+}
+#else
+bool explore_run(nes_t *nes, const explore_options_t *opts, explore_result_t *results, uint32_t num_branches)
+{
+	log_event("Exploration needs fork(), which isn't available on this platform");
+	return false;
+}
+#endif
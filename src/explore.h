@@ -0,0 +1,37 @@
+#ifndef EXPLORE_INCLUDE
+#define EXPLORE_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include "nes.h"
+
+// One branch per possible controller state
+#define EXPLORE_MAX_BRANCHES 256
+
+/*
+Explores what the next frames do under every input from one warmed up
+machine. Each branch runs in a fork()ed child, so the kernel shares the
+warmed up state copy-on-write and only the pages a branch dirties get copied;
+results come back to the coordinating parent over a pipe per child. POSIX
+only.
+*/
+typedef struct {
+	// Frames each branch runs for
+	uint32_t depth;
+
+	// Branches running at once
+	uint32_t workers;
+
+	// The score of a branch is the RAM byte at this address once it's done
+	uint16_t score_addr;
+} explore_options_t;
+
+typedef struct {
+	uint32_t branch;
+	uint8_t key_state;
+	uint8_t score;
+	bool ok;
+	uint64_t ram_hash;
+} explore_result_t;
+
+bool explore_run(nes_t *, const explore_options_t *, explore_result_t *, uint32_t);
+#endif // EXPLORE_INCLUDE
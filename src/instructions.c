@@ -54,16 +54,6 @@ static inline void oper_branch_offset(nes_cpu_t *cpu, int8_t offset)
 	cpu->pc += offset;
 }
 
-inline void set_flag(nes_cpu_t *cpu, uint8_t flag, int enable)
-{
-	cpu->flags[flag] = enable;
-}
-
-inline bool get_flag(nes_cpu_t *cpu, int flag)
-{
-	return cpu->flags[flag];
-}
-
 void oper_push_16(nes_cpu_t *cpu, uint16_t value)
 {
 	mem_write_16(cpu, (cpu->sp - 1) + 0x100, value);
@@ -266,14 +256,13 @@ Generic implementations of many instructions
 NOINLINE
 void _instr_ADC(nes_cpu_t *cpu, uint8_t num)
 {
-	int c_flag = get_flag(cpu, FLAG_C);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
 
 	uint16_t result = cpu->a + num + c_flag;
 
-	set_flag(cpu, FLAG_Z, (uint8_t)result == 0);
-	set_flag(cpu, FLAG_C, (result & 0x100) == 0x100);
-	set_flag(cpu, FLAG_N, __is_negative(result));
-	set_flag(cpu, FLAG_V, ((cpu->a ^ (uint8_t)result) & (num ^ (uint8_t)result) & 0x80) == 0x80);
+	cpu_set_nz(cpu, (uint8_t)result);
+	cpu_set_flag(cpu, FLAG_C, (result & 0x100) == 0x100);
+	cpu_set_flag(cpu, FLAG_V, ((cpu->a ^ (uint8_t)result) & (num ^ (uint8_t)result) & 0x80) == 0x80);
 	cpu->a = (uint8_t)result;
 }
 
@@ -282,8 +271,7 @@ void _instr_AND(nes_cpu_t *cpu, uint8_t num)
 {
 	cpu->a &= num;
 
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 NOINLINE
@@ -291,9 +279,8 @@ void _instr_CMP(nes_cpu_t *cpu, uint8_t num)
 {
 	uint8_t result = cpu->a - num;
 
-	set_flag(cpu, FLAG_C, cpu->a >= num);
-	set_flag(cpu, FLAG_Z, result == 0);
-	set_flag(cpu, FLAG_N, __is_negative(result));
+	cpu_set_flag(cpu, FLAG_C, cpu->a >= num);
+	cpu_set_nz(cpu, result);
 }
 
 NOINLINE
@@ -301,9 +288,8 @@ void _instr_CPX(nes_cpu_t *cpu, uint8_t num)
 {
 	uint8_t result = cpu->x - num;
 
-	set_flag(cpu, FLAG_C, cpu->x >= num);
-	set_flag(cpu, FLAG_Z, result == 0);
-	set_flag(cpu, FLAG_N, __is_negative(result));
+	cpu_set_flag(cpu, FLAG_C, cpu->x >= num);
+	cpu_set_nz(cpu, result);
 }
 
 NOINLINE
@@ -311,9 +297,8 @@ void _instr_CPY(nes_cpu_t *cpu, uint8_t num)
 {
 	uint8_t result = cpu->y - num;
 
-	set_flag(cpu, FLAG_C, cpu->y >= num);
-	set_flag(cpu, FLAG_Z, result == 0);
-	set_flag(cpu, FLAG_N, __is_negative(result));
+	cpu_set_flag(cpu, FLAG_C, cpu->y >= num);
+	cpu_set_nz(cpu, result);
 }
 
 NOINLINE
@@ -321,8 +306,7 @@ void _instr_EOR(nes_cpu_t *cpu, uint8_t num)
 {
 	cpu->a ^= num;
 
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 NOINLINE
@@ -330,8 +314,7 @@ void _instr_LDA(nes_cpu_t *cpu, uint8_t num)
 {
 	cpu->a = num;
 
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 NOINLINE
@@ -339,8 +322,7 @@ void _instr_LDX(nes_cpu_t *cpu, uint8_t num)
 {
 	cpu->x = num;
 
-	set_flag(cpu, FLAG_Z, cpu->x == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->x));
+	cpu_set_nz(cpu, cpu->x);
 }
 
 NOINLINE
@@ -348,8 +330,7 @@ void _instr_LDY(nes_cpu_t *cpu, uint8_t num)
 {
 	cpu->y = num;
 
-	set_flag(cpu, FLAG_Z, cpu->y == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->y));
+	cpu_set_nz(cpu, cpu->y);
 }
 
 NOINLINE
@@ -357,8 +338,7 @@ void _instr_ORA(nes_cpu_t *cpu, uint8_t num)
 {
 	cpu->a |= num;
 
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 /*
@@ -478,12 +458,11 @@ void instr_AND_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 void instr_ASL_A(nes_cpu_t *cpu, uint32_t instr)
 {
 	int status = __get_bit_8(cpu->a, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	cpu->a <<= 1;
 	
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 void instr_ASL_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -492,11 +471,10 @@ void instr_ASL_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_abs(cpu, addr);
 	int status = __get_bit_8(num, 7);
 
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 	num <<= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs(cpu, addr, num);
 }
@@ -507,11 +485,10 @@ void instr_ASL_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 	int status = __get_bit_8(num, 7);
 
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 	num <<= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs_x(cpu, addr, num);
 }
@@ -522,11 +499,10 @@ void instr_ASL_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_zpg(cpu, addr);
 	int status = __get_bit_8(num, 7);
 
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 	num <<= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg(cpu, addr, num);
 }
@@ -537,18 +513,17 @@ void instr_ASL_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 	int status = __get_bit_8(num, 7);
 
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 	num <<= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg_x(cpu, addr, num);
 }
 
 void instr_BCC(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_C);
+	bool flag = cpu_get_flag(cpu, FLAG_C);
 
 	if (!flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -557,7 +532,7 @@ void instr_BCC(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_BCS(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_C);
+	bool flag = cpu_get_flag(cpu, FLAG_C);
 
 	if (flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -566,7 +541,7 @@ void instr_BCS(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_BEQ(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_Z);
+	bool flag = cpu_get_flag(cpu, FLAG_Z);
 
 	if (flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -579,9 +554,9 @@ void instr_BIT_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs(cpu, addr);
 
-	set_flag(cpu, FLAG_Z, (cpu->a & num) == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
-	set_flag(cpu, FLAG_V, __get_bit_8(num, 6));
+	cpu->n_result = num;
+	cpu->z_result = cpu->a & num;
+	cpu_set_flag(cpu, FLAG_V, __get_bit_8(num, 6));
 }
 
 void instr_BIT_zpg(nes_cpu_t *cpu, uint32_t instr)
@@ -589,14 +564,14 @@ void instr_BIT_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg(cpu, addr);
 
-	set_flag(cpu, FLAG_Z, (cpu->a & num) == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
-	set_flag(cpu, FLAG_V, __get_bit_8(num, 6));
+	cpu->n_result = num;
+	cpu->z_result = cpu->a & num;
+	cpu_set_flag(cpu, FLAG_V, __get_bit_8(num, 6));
 }
 
 void instr_BMI(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_N);
+	bool flag = cpu_get_flag(cpu, FLAG_N);
 
 	if (flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -605,7 +580,7 @@ void instr_BMI(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_BNE(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_Z);
+	bool flag = cpu_get_flag(cpu, FLAG_Z);
 
 	if (!flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -614,7 +589,7 @@ void instr_BNE(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_BPL(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_N);
+	bool flag = cpu_get_flag(cpu, FLAG_N);
 
 	if (!flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -632,13 +607,13 @@ void instr_BRK(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t copy = cpu_get_sr(cpu) | 0b00110000;
 	oper_push_8(cpu, copy);
 
-	set_flag(cpu, FLAG_I, 1);
+	cpu_set_flag(cpu, FLAG_I, 1);
 }
 
 
 void instr_BVC(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_V);
+	bool flag = cpu_get_flag(cpu, FLAG_V);
 
 	if (!flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -647,7 +622,7 @@ void instr_BVC(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_BVS(nes_cpu_t *cpu, uint32_t instr)
 {
-	bool flag = get_flag(cpu, FLAG_V);
+	bool flag = cpu_get_flag(cpu, FLAG_V);
 
 	if (flag) {
 		oper_branch_offset(cpu, (int8_t)__get_imm8_from_opcode(instr));
@@ -656,22 +631,22 @@ void instr_BVS(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_CLC(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_C, 0);
+	cpu_set_flag(cpu, FLAG_C, 0);
 }
 
 void instr_CLD(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_D, 0);
+	cpu_set_flag(cpu, FLAG_D, 0);
 }
 
 void instr_CLI(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_I, 0);
+	cpu_set_flag(cpu, FLAG_I, 0);
 }
 
 void instr_CLV(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_V, 0);
+	cpu_set_flag(cpu, FLAG_V, 0);
 }
 
 void instr_CMP_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -776,8 +751,7 @@ void instr_DEC_abs(nes_cpu_t *cpu, uint32_t instr)
 
 	num--;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs(cpu, addr, num);
 }
@@ -789,8 +763,7 @@ void instr_DEC_abs_x(nes_cpu_t *cpu, uint32_t instr)
 
 	num--;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs_x(cpu, addr, num);
 }
@@ -802,8 +775,7 @@ void instr_DEC_zpg(nes_cpu_t *cpu, uint32_t instr)
 
 	num--;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg(cpu, addr, num);
 }
@@ -815,8 +787,7 @@ void instr_DEC_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 
 	num--;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg_x(cpu, addr, num);
 }
@@ -824,15 +795,13 @@ void instr_DEC_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 void instr_DEX(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->x--;
-	set_flag(cpu, FLAG_Z, cpu->x == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->x));
+	cpu_set_nz(cpu, cpu->x);
 }
 
 void instr_DEY(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->y--;
-	set_flag(cpu, FLAG_Z, cpu->y == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->y));
+	cpu_set_nz(cpu, cpu->y);
 }
 
 void instr_EOR_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -897,8 +866,7 @@ void instr_INC_abs(nes_cpu_t *cpu, uint32_t instr)
 
 	num++;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs(cpu, addr, num);
 }
@@ -910,8 +878,7 @@ void instr_INC_abs_x(nes_cpu_t *cpu, uint32_t instr)
 
 	num++;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs_x(cpu, addr, num);
 }
@@ -923,8 +890,7 @@ void instr_INC_zpg(nes_cpu_t *cpu, uint32_t instr)
 
 	num++;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg(cpu, addr, num);
 }
@@ -936,8 +902,7 @@ void instr_INC_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 
 	num++;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg_x(cpu, addr, num);
 }
@@ -945,15 +910,13 @@ void instr_INC_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 void instr_INX(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->x++;
-	set_flag(cpu, FLAG_Z, cpu->x == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->x));
+	cpu_set_nz(cpu, cpu->x);
 }
 
 void instr_INY(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->y++;
-	set_flag(cpu, FLAG_Z, cpu->y == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->y));
+	cpu_set_nz(cpu, cpu->y);
 }
 
 void instr_JMP_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -1102,12 +1065,11 @@ void instr_LDY_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_LSR_A(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_C, cpu->a & 1);
+	cpu_set_flag(cpu, FLAG_C, cpu->a & 1);
 
 	cpu->a >>= 1;
 
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, 0);
+	cpu_set_nz(cpu, cpu->a);
 }
 
 void instr_LSR_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -1115,12 +1077,11 @@ void instr_LSR_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs(cpu, addr);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, 0);
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs(cpu, addr, num);
 }
@@ -1130,12 +1091,11 @@ void instr_LSR_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, 0);
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs_x(cpu, addr, num);
 }
@@ -1144,12 +1104,11 @@ void instr_LSR_zpg(nes_cpu_t *cpu, uint32_t instr)
 {
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg(cpu, addr);
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, 0);
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg(cpu, addr, num);
 }
@@ -1159,12 +1118,11 @@ void instr_LSR_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, 0);
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg_x(cpu, addr, num);
 }
@@ -1245,8 +1203,7 @@ void instr_PHP(nes_cpu_t *cpu, uint32_t instr)
 void instr_PLA(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->a = oper_pop_8(cpu);
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 void instr_PLP(nes_cpu_t *cpu, uint32_t instr)
@@ -1257,13 +1214,12 @@ void instr_PLP(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_ROL_A(nes_cpu_t *cpu, uint32_t instr)
 {
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(cpu->a, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(cpu->a, 7));
 
 	cpu->a = (cpu->a << 1) | c_flag;
 
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 void instr_ROL_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -1271,13 +1227,12 @@ void instr_ROL_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs(cpu, addr, num);
 }
@@ -1287,13 +1242,12 @@ void instr_ROL_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C,  __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C,  __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs_x(cpu, addr, num);
 }
@@ -1303,13 +1257,12 @@ void instr_ROL_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C,  __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C,  __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg(cpu, addr, num);
 }
@@ -1319,26 +1272,24 @@ void instr_ROL_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C,  __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C,  __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg_x(cpu, addr, num);
 }
 
 void instr_ROR_A(nes_cpu_t *cpu, uint32_t instr)
 {
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, cpu->a & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, cpu->a & 1);
 
 	cpu->a = (cpu->a >> 1) | (c_flag << 7);
 
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 void instr_ROR_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -1346,13 +1297,12 @@ void instr_ROR_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs(cpu, addr, num);
 }
@@ -1362,13 +1312,12 @@ void instr_ROR_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_abs_x(cpu, addr, num);
 }
@@ -1378,13 +1327,12 @@ void instr_ROR_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg(cpu, addr, num);
 }
@@ -1394,13 +1342,12 @@ void instr_ROR_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
-	set_flag(cpu, FLAG_Z, num == 0);
-	set_flag(cpu, FLAG_N, __is_negative(num));
+	cpu_set_nz(cpu, num);
 
 	__set_value_zpg_x(cpu, addr, num);
 }
@@ -1475,17 +1422,17 @@ void instr_SBC_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 
 void instr_SEC(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_C, 1);
+	cpu_set_flag(cpu, FLAG_C, 1);
 }
 
 void instr_SED(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_D, 1);
+	cpu_set_flag(cpu, FLAG_D, 1);
 }
 
 void instr_SEI(nes_cpu_t *cpu, uint32_t instr)
 {
-	set_flag(cpu, FLAG_I, 1);
+	cpu_set_flag(cpu, FLAG_I, 1);
 }
 
 void instr_STA_abs(nes_cpu_t *cpu, uint32_t instr)
@@ -1569,29 +1516,25 @@ void instr_STY_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 void instr_TAX(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->x = cpu->a;
-	set_flag(cpu, FLAG_Z, cpu->x == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->x));
+	cpu_set_nz(cpu, cpu->x);
 }
 
 void instr_TAY(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->y = cpu->a;
-	set_flag(cpu, FLAG_Z, cpu->y == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->y));
+	cpu_set_nz(cpu, cpu->y);
 }
 
 void instr_TSX(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->x = cpu->sp;
-	set_flag(cpu, FLAG_Z, cpu->x == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->x));
+	cpu_set_nz(cpu, cpu->x);
 }
 
 void instr_TXA(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->a = cpu->x;
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 void instr_TXS(nes_cpu_t *cpu, uint32_t instr)
@@ -1602,8 +1545,7 @@ void instr_TXS(nes_cpu_t *cpu, uint32_t instr)
 void instr_TYA(nes_cpu_t *cpu, uint32_t instr)
 {
 	cpu->a = cpu->y;
-	set_flag(cpu, FLAG_Z, cpu->a == 0);
-	set_flag(cpu, FLAG_N, __is_negative(cpu->a));
+	cpu_set_nz(cpu, cpu->a);
 }
 
 
@@ -1627,7 +1569,7 @@ void iinstr_ALR_imm(nes_cpu_t *cpu, uint32_t instr)
 void iinstr_ANC_imm(nes_cpu_t *cpu, uint32_t instr)
 {
 	instr_AND_imm(cpu, instr);
-	set_flag(cpu, FLAG_C, __is_negative(cpu->a));
+	cpu_set_flag(cpu, FLAG_C, __is_negative(cpu->a));
 }
 
 void iinstr_ARR_imm(nes_cpu_t *cpu, uint32_t instr)
@@ -1883,8 +1825,8 @@ void iinstr_RLA_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
@@ -1897,8 +1839,8 @@ void iinstr_RLA_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
@@ -1911,8 +1853,8 @@ void iinstr_RLA_abs_y(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_y(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
@@ -1925,8 +1867,8 @@ void iinstr_RLA_ind_y(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_ind_y(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
@@ -1939,8 +1881,8 @@ void iinstr_RLA_x_ind(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_x_ind(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
@@ -1953,8 +1895,8 @@ void iinstr_RLA_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
@@ -1967,8 +1909,8 @@ void iinstr_RLA_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, __get_bit_8(num, 7));
 
 	num = (num << 1) | c_flag;
 
@@ -1981,8 +1923,8 @@ void iinstr_RRA_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
@@ -1995,8 +1937,8 @@ void iinstr_RRA_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
@@ -2009,8 +1951,8 @@ void iinstr_RRA_abs_y(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_y(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
@@ -2023,8 +1965,8 @@ void iinstr_RRA_ind_y(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_ind_y(cpu, addr, false);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
@@ -2037,8 +1979,8 @@ void iinstr_RRA_x_ind(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_x_ind(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
@@ -2051,8 +1993,8 @@ void iinstr_RRA_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
@@ -2065,8 +2007,8 @@ void iinstr_RRA_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 
-	int c_flag = get_flag(cpu, FLAG_C);
-	set_flag(cpu, FLAG_C, num & 1);
+	int c_flag = cpu_get_flag(cpu, FLAG_C);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num = (num >> 1) | (c_flag << 7);
 
@@ -2127,7 +2069,7 @@ void iinstr_SLO_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_abs(cpu, addr);
 
 	int status = __get_bit_8(num, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	num <<= 1;
 	__set_value_abs(cpu, addr, num);
@@ -2141,7 +2083,7 @@ void iinstr_SLO_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 
 	int status = __get_bit_8(num, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	num <<= 1;
 	__set_value_abs_x(cpu, addr, num);
@@ -2154,7 +2096,7 @@ void iinstr_SLO_abs_y(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_abs_y(cpu, addr, false);
 
 	int status = __get_bit_8(num, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	num <<= 1;
 	__set_value_abs_y(cpu, addr, num);
@@ -2167,7 +2109,7 @@ void iinstr_SLO_ind_y(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_ind_y(cpu, addr, false);
 
 	int status = __get_bit_8(num, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	num <<= 1;
 	__set_value_ind_y(cpu, addr, num);
@@ -2180,7 +2122,7 @@ void iinstr_SLO_x_ind(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_x_ind(cpu, addr);
 
 	int status = __get_bit_8(num, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	num <<= 1;
 	__set_value_x_ind(cpu, addr, num);
@@ -2193,7 +2135,7 @@ void iinstr_SLO_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_zpg(cpu, addr);
 
 	int status = __get_bit_8(num, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	num <<= 1;
 	__set_value_zpg(cpu, addr, num);
@@ -2206,7 +2148,7 @@ void iinstr_SLO_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 
 	int status = __get_bit_8(num, 7);
-	set_flag(cpu, FLAG_C, status);
+	cpu_set_flag(cpu, FLAG_C, status);
 
 	num <<= 1;
 	__set_value_zpg_x(cpu, addr, num);
@@ -2218,7 +2160,7 @@ void iinstr_SRE_abs(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs(cpu, addr);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 	__set_value_abs(cpu, addr, num);
@@ -2230,7 +2172,7 @@ void iinstr_SRE_abs_x(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_x(cpu, addr, false);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 	__set_value_abs_x(cpu, addr, num);
@@ -2242,7 +2184,7 @@ void iinstr_SRE_abs_y(nes_cpu_t *cpu, uint32_t instr)
 	uint16_t addr = __get_imm16_from_opcode(instr);
 	uint8_t num = __get_value_abs_y(cpu, addr, false);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 	__set_value_abs_y(cpu, addr, num);
@@ -2254,7 +2196,7 @@ void iinstr_SRE_ind_y(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_ind_y(cpu, addr, false);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 	__set_value_ind_y(cpu, addr, num);
@@ -2266,7 +2208,7 @@ void iinstr_SRE_x_ind(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_x_ind(cpu, addr);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 	__set_value_x_ind(cpu, addr, num);
@@ -2278,7 +2220,7 @@ void iinstr_SRE_zpg(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg(cpu, addr);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 	__set_value_zpg(cpu, addr, num);
@@ -2290,7 +2232,7 @@ void iinstr_SRE_zpg_x(nes_cpu_t *cpu, uint32_t instr)
 	uint8_t addr = __get_imm8_from_opcode(instr);
 	uint8_t num = __get_value_zpg_x(cpu, addr);
 
-	set_flag(cpu, FLAG_C, num & 1);
+	cpu_set_flag(cpu, FLAG_C, num & 1);
 
 	num >>= 1;
 	__set_value_zpg_x(cpu, addr, num);
@@ -9,9 +9,6 @@ void oper_push_16(nes_cpu_t *cpu, uint16_t value);
 uint8_t oper_pop_8(nes_cpu_t *cpu);
 uint16_t oper_pop_16(nes_cpu_t *cpu);
 
-void set_flag(nes_cpu_t *cpu, uint8_t flag, int enable);
-bool get_flag(nes_cpu_t *cpu, int flag);
-
 void instr_ADC_abs(nes_cpu_t *cpu, uint32_t instr);
 void instr_ADC_abs_x(nes_cpu_t *cpu, uint32_t instr);
 void instr_ADC_abs_y(nes_cpu_t *cpu, uint32_t instr);
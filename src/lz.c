@@ -0,0 +1,222 @@
+#include "lz.h"
+#include <string.h>
+
+#define LZ_HASH_BITS 14
+
+// Lengths of 15 and up continue into extra bytes
+#define LZ_RUN_MASK 15
+
+// Matches are searched less often the longer nothing has been found
+#define LZ_SKIP_SHIFT 5
+
+static inline uint32_t lz_read_32(const uint8_t *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t lz_read_64(const uint8_t *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t lz_hash(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Worst case size of a compressed block: every byte a literal
+size_t lz_compress_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+static uint8_t *lz_write_length(uint8_t *out, size_t length)
+{
+	while (length >= 255) {
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = length;
+
+	return out;
+}
+
+static uint8_t *lz_write_literals(uint8_t *out, uint8_t *token, const uint8_t *literals, size_t count)
+{
+	if (count >= LZ_RUN_MASK) {
+		*token = LZ_RUN_MASK << 4;
+		out = lz_write_length(out, count - LZ_RUN_MASK);
+	} else {
+		*token = count << 4;
+	}
+
+	memcpy(out, literals, count);
+	return out + count;
+}
+
+static size_t lz_match_length(const uint8_t *src, size_t size, size_t match, size_t pos)
+{
+	size_t length = LZ_MIN_MATCH;
+
+	while (pos + length + sizeof(uint64_t) <= size &&
+		lz_read_64(src + match + length) == lz_read_64(src + pos + length)) {
+		length += sizeof(uint64_t);
+	}
+
+	while (pos + length < size && src[match + length] == src[pos + length]) {
+		length++;
+	}
+
+	return length;
+}
+
+/*
+Greedy compression with a single entry hash table of the last position
+every 4 byte sequence was seen at. dst has to hold lz_compress_bound(size)
+bytes, returns the size of the block
+*/
+size_t lz_compress(const uint8_t *src, size_t size, uint8_t *dst)
+{
+	// positions + 1, 0 is empty
+	uint32_t table[1 << LZ_HASH_BITS] = {0};
+
+	uint8_t *out = dst;
+	size_t anchor = 0;
+	size_t pos = 0;
+
+	while (pos + LZ_MIN_MATCH <= size) {
+		uint32_t sequence = lz_read_32(src + pos);
+		uint32_t hash = lz_hash(sequence);
+		size_t candidate = table[hash];
+		table[hash] = pos + 1;
+
+		if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET ||
+			lz_read_32(src + candidate - 1) != sequence) {
+			pos += 1 + ((pos - anchor) >> LZ_SKIP_SHIFT);
+			continue;
+		}
+
+		size_t match = candidate - 1;
+		size_t length = lz_match_length(src, size, match, pos);
+		uint16_t offset = pos - match;
+
+		uint8_t *token = out++;
+		out = lz_write_literals(out, token, src + anchor, pos - anchor);
+
+		*out++ = offset & 0xff;
+		*out++ = offset >> 8;
+
+		size_t extra = length - LZ_MIN_MATCH;
+		if (extra >= LZ_RUN_MASK) {
+			*token |= LZ_RUN_MASK;
+			out = lz_write_length(out, extra - LZ_RUN_MASK);
+		} else {
+			*token |= extra;
+		}
+
+		pos += length;
+		anchor = pos;
+	}
+
+	uint8_t *token = out++;
+	out = lz_write_literals(out, token, src + anchor, size - anchor);
+
+	return out - dst;
+}
+
+static bool lz_read_length(const uint8_t **in, const uint8_t *end, size_t *length, size_t limit)
+{
+	uint8_t byte;
+	do {
+		if (*in == end || *length > limit) {
+			return false;
+		}
+		byte = *(*in)++;
+		*length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+// Copies a match that may overlap the bytes it produces
+static inline void lz_copy_match(uint8_t *out, size_t offset, size_t length)
+{
+	const uint8_t *match = out - offset;
+
+	if (offset == 1) {
+		memset(out, *match, length);
+	} else if (offset >= length) {
+		memcpy(out, match, length);
+	} else if (offset >= sizeof(uint64_t)) {
+		// every 8 byte step only reads bytes written before it
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+			memcpy(out + i, match + i, sizeof(uint64_t));
+		}
+		for (; i < length; i++) {
+			out[i] = match[i];
+		}
+	} else {
+		for (size_t i = 0; i < length; i++) {
+			out[i] = match[i];
+		}
+	}
+}
+
+/*
+Decompresses a block that has to expand to exactly dst_size bytes. Returns
+false for a malformed block, which never reads or writes out of bounds
+*/
+bool lz_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size)
+{
+	const uint8_t *in = src;
+	const uint8_t *end = src + size;
+	uint8_t *out = dst;
+
+	while (in < end) {
+		uint8_t token = *in++;
+		size_t room = dst_size - (out - dst);
+
+		size_t literals = token >> 4;
+		if (literals == LZ_RUN_MASK && !lz_read_length(&in, end, &literals, room)) {
+			return false;
+		}
+		if (literals > (size_t)(end - in) || literals > room) {
+			return false;
+		}
+		memcpy(out, in, literals);
+		out += literals;
+		in += literals;
+		room -= literals;
+
+		// the last sequence has no match
+		if (in == end) {
+			break;
+		}
+
+		if (end - in < 2) {
+			return false;
+		}
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+
+		size_t length = token & LZ_RUN_MASK;
+		if (length == LZ_RUN_MASK && !lz_read_length(&in, end, &length, room)) {
+			return false;
+		}
+		length += LZ_MIN_MATCH;
+
+		if (offset == 0 || offset > (size_t)(out - dst) || length > room) {
+			return false;
+		}
+
+		lz_copy_match(out, offset, length);
+		out += length;
+	}
+
+	return out == dst + dst_size;
+}
@@ -0,0 +1,24 @@
+#ifndef LZ_INCLUDE
+#define LZ_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+A small LZ77 block codec in the style of LZ4, for savestates and snapshot
+archives: NES state is mostly long zero runs and repeated tiles, which this
+compresses well, and decoding is little more than memcpy.
+
+A block is a series of sequences. Each sequence is a token byte (literal
+count in the high nibble, match length - LZ_MIN_MATCH in the low one, 15
+meaning more length bytes follow, each added until one is below 255), the
+literals, and a u16 little endian match offset. The last sequence of a block
+stops after its literals.
+*/
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xffff
+
+size_t lz_compress_bound(size_t);
+size_t lz_compress(const uint8_t *, size_t, uint8_t *);
+bool lz_decompress(const uint8_t *, size_t, uint8_t *, size_t);
+#endif // LZ_INCLUDE
@@ -3,16 +3,272 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <SDL3/SDL.h>
 #include "utils.h"
 #include "nes.h"
+#include "state.h"
+#include "rewind.h"
+#include "movie.h"
+#include "pacer.h"
+#include "triple_buffer.h"
 
 #define APP_NAME "NESEMU"
 
+#define FRAME_SIZE (INTERNAL_VIDEO_WIDTH * INTERNAL_VIDEO_HEIGHT * sizeof(uint32_t))
+
+// Speed while tab is held, 0 runs as fast as the host allows
+#define DEFAULT_FAST_FORWARD_SPEED 0.0
+
+static const char *usage =
+	"Usage: nesemu <rom path> [--speed X] [--fast-forward X] [--run-ahead N] [--rewind-mb N]\n"
+	"              [--state <file>] [--record <file>] [--cpu interpreter|threaded|jit|aot]";
+
+// F5 saves to the state file, F9 loads it
+typedef enum {
+	STATE_REQUEST_NONE = 0,
+	STATE_REQUEST_SAVE,
+	STATE_REQUEST_LOAD
+} state_request_t;
+
+/*
+The emulator runs (and paces itself) on its own thread. The main thread only
+polls input and presents whatever frame was finished last, handed over through
+a triple buffer so neither thread ever waits on the other.
+*/
+typedef struct {
+	nes_t nes;
+	frame_pacer_t pacer;
+	triple_buffer_t frames;
+	SDL_AudioStream *audio_stream;
+
+	// Speed multipliers, 0 is unlimited. Fixed once the emulation thread runs
+	double speed;
+	double fast_forward_speed;
+
+	// Frames to run ahead of the real one, and the state it's rewound from
+	uint32_t run_ahead;
+	nes_state_t run_ahead_state;
+
+	// Held with backspace, only when rewind_enabled
+	rewind_t rewind;
+	bool rewind_enabled;
+
+	const char *state_path;
+
+	// --record writes every frame's input, from power-on
+	movie_recorder_t recorder;
+	bool recording;
+
+	// Only touched by the emulation thread
+	double current_speed;
+
+	// Written by the main thread, read by the emulation thread
+	_Atomic uint8_t key_state;
+	atomic_bool fast_forward;
+	atomic_bool rewinding;
+	atomic_int state_request;
+	atomic_bool quit;
+} frontend_t;
+
+// Called on the emulation thread
+static void frontend_publish_frame(void *userdata, const uint32_t *frame_data)
+{
+	frontend_t *frontend = userdata;
+
+	memcpy(triple_buffer_back(&frontend->frames), frame_data, FRAME_SIZE);
+	triple_buffer_publish(&frontend->frames);
+}
+
+static void present_frame(SDL_Renderer *renderer, SDL_Texture *video_texture, const uint32_t *frame_data)
+{
+	static const SDL_FRect video_display_rect = {
+		0,
+		0, 
+		INTERNAL_VIDEO_WIDTH * VIDEO_SCALE, 
+		INTERNAL_VIDEO_HEIGHT * VIDEO_SCALE
+	};
+
+	SDL_UpdateTexture(video_texture, NULL, frame_data, INTERNAL_VIDEO_WIDTH * sizeof(uint32_t));
+	SDL_RenderTexture(renderer, video_texture, NULL, &video_display_rect);
+	SDL_RenderPresent(renderer);
+}
+
+static void frontend_queue_audio(void *userdata, const float *samples, size_t num_samples)
+{
+	frontend_t *frontend = userdata;
+
+	// audio at any other speed would only pile up in the stream
+	if (frontend->audio_stream && frontend->current_speed == 1.0) {
+		SDL_PutAudioStreamData(frontend->audio_stream, samples, num_samples * sizeof(float));
+	}
+}
+
+static void handle_keypress(SDL_Event *event, uint8_t *key_state)
+{
+	static const SDL_Keycode keys[] = {SDLK_A, SDLK_S, SDLK_O, SDLK_P, SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT};
+	
+	SDL_Keycode pressed_key = event->key.key;
+	bool key_down = event->key.type == SDL_EVENT_KEY_DOWN;
+
+	uint8_t temp_key_state = *key_state;
+
+	for (int idx = 0; idx < 8; idx++) {
+		if (pressed_key == keys[idx]) {
+			temp_key_state ^= (-key_down ^ temp_key_state) & (1UL << idx);
+			break;
+		}
+	}
+
+	*key_state = temp_key_state;
+}
+
+static void frontend_record_frame(frontend_t *frontend)
+{
+	if (frontend->rewind_enabled) {
+		rewind_record_frame(&frontend->rewind, &frontend->nes);
+	}
+
+	if (frontend->recording && !movie_record_frame(&frontend->recorder, frontend->nes.key_state)) {
+		log_event("Could not write movie, stopped recording");
+		movie_record_finish(&frontend->recorder);
+		frontend->recording = false;
+	}
+}
+
+static int emulation_thread(void *userdata)
+{
+	frontend_t *frontend = userdata;
+
+	while (!atomic_load(&frontend->quit)) {
+		state_request_t request = atomic_exchange(&frontend->state_request, STATE_REQUEST_NONE);
+		if (request == STATE_REQUEST_SAVE) {
+			if (nes_save_state(&frontend->nes, frontend->state_path)) {
+				log_event("Saved state to %s", frontend->state_path);
+			}
+		} else if (request == STATE_REQUEST_LOAD) {
+			if (frontend->recording) {
+				log_event("Can't load a state while recording a movie");
+			} else if (nes_load_state(&frontend->nes, frontend->state_path)) {
+				log_event("Loaded state from %s", frontend->state_path);
+				if (frontend->rewind_enabled) {
+					rewind_reset(&frontend->rewind);
+				}
+			}
+		}
+
+		double speed = atomic_load(&frontend->fast_forward) ?
+			frontend->fast_forward_speed : frontend->speed;
+		#ifdef UNLIMITED_SPEED
+		speed = 0;
+		#endif
+
+		if (speed != frontend->current_speed) {
+			if (speed > 0) {
+				pacer_set_speed(&frontend->pacer, speed);
+			}
+			frontend->current_speed = speed;
+		}
+
+		// frames that can't be shown in time are run without rendering
+		bool paced = speed > 0;
+		bool render = pacer_should_render(&frontend->pacer, paced);
+
+		frontend->nes.key_state = atomic_load(&frontend->key_state);
+		if (frontend->rewind_enabled && atomic_load(&frontend->rewinding)) {
+			rewind_step_back(&frontend->rewind, &frontend->nes);
+		} else if (frontend->run_ahead > 0) {
+			frontend->nes.skip_render = true;
+			nes_do_frame_cycle(&frontend->nes);
+			frontend_record_frame(frontend);
+			if (render) {
+				nes_run_ahead(&frontend->nes, &frontend->run_ahead_state, frontend->run_ahead);
+			}
+		} else {
+			frontend->nes.skip_render = !render;
+			nes_do_frame_cycle(&frontend->nes);
+			frontend_record_frame(frontend);
+		}
+
+		if (paced) {
+			pacer_wait(&frontend->pacer);
+		}
+	}
+
+	return 0;
+}
+
+static double parse_speed(const char *arg)
+{
+	char *end;
+	double speed = strtod(arg, &end);
+	if (*end != '\0' || speed < 0) {
+		exit_with_error(2, "Invalid speed: %s", arg);
+	}
+
+	return speed;
+}
+
 int main(int argc, char **argv)
 {
-	if (argc < 2) {
-		exit_with_error(2, "Usage: nesemu <rom path>");
+	const char *rom_path = NULL;
+	double speed = 1.0;
+	double fast_forward_speed = DEFAULT_FAST_FORWARD_SPEED;
+	uint32_t run_ahead = 0;
+	size_t rewind_budget = REWIND_DEFAULT_BUDGET;
+	const char *state_path = NULL;
+	const char *record_path = NULL;
+	nes_cpu_core_t cpu_core = NES_CPU_INTERPRETER;
+
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+
+		if (strcmp(argv[i], "--speed") == 0 && has_value) {
+			speed = parse_speed(argv[++i]);
+		} else if (strcmp(argv[i], "--fast-forward") == 0 && has_value) {
+			fast_forward_speed = parse_speed(argv[++i]);
+		} else if (strcmp(argv[i], "--run-ahead") == 0 && has_value) {
+			char *end;
+			run_ahead = strtoul(argv[++i], &end, 10);
+			if (*end != '\0') {
+				exit_with_error(2, "Invalid run-ahead frame count: %s", argv[i]);
+			}
+		} else if (strcmp(argv[i], "--rewind-mb") == 0 && has_value) {
+			char *end;
+			rewind_budget = strtoul(argv[++i], &end, 10) * 1024 * 1024;
+			if (*end != '\0') {
+				exit_with_error(2, "Invalid rewind buffer size: %s", argv[i]);
+			}
+		} else if (strcmp(argv[i], "--state") == 0 && has_value) {
+			state_path = argv[++i];
+		} else if (strcmp(argv[i], "--record") == 0 && has_value) {
+			record_path = argv[++i];
+		} else if (strcmp(argv[i], "--cpu") == 0 && has_value) {
+			if (!nes_cpu_core_from_name(argv[++i], &cpu_core)) {
+				exit_with_error(2, "Unknown CPU core: %s", argv[i]);
+			}
+		} else if (argv[i][0] != '-' && !rom_path) {
+			rom_path = argv[i];
+		} else {
+			exit_with_error(2, "%s", usage);
+		}
+	}
+
+	if (!rom_path) {
+		exit_with_error(2, "%s", usage);
+	}
+
+	// a movie has to play back the same frames, which rewinding would break
+	if (record_path && rewind_budget > 0) {
+		log_event("Rewind is disabled while recording a movie");
+		rewind_budget = 0;
+	}
+
+	// defaults to <rom path>.state
+	char default_state_path[1024];
+	if (!state_path) {
+		snprintf(default_state_path, sizeof(default_state_path), "%s.state", rom_path);
+		state_path = default_state_path;
 	}
 
 	printf("%s v0.1\n", APP_NAME);
@@ -53,45 +309,110 @@ int main(int argc, char **argv)
 	}
 	SDL_SetTextureScaleMode(video_texture, SDL_SCALEMODE_NEAREST);
 
-	nes_render_context_t render_ctx = {
-		renderer,
-		video_texture
+	SDL_AudioSpec audio_spec;
+	audio_spec.freq = APU_SAMPLE_RATE;
+	audio_spec.format = SDL_AUDIO_F32;
+	audio_spec.channels = 1;
+
+	// the emulator still runs without sound if there is no audio device
+	SDL_AudioStream *audio_stream = SDL_OpenAudioDeviceStream(
+		SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
+		&audio_spec,
+		NULL,
+		NULL
+	);
+	if (audio_stream) {
+		SDL_ResumeAudioStreamDevice(audio_stream);
+	} else {
+		log_event("Could not open audio device: %s", SDL_GetError());
+	}
+
+	static frontend_t frontend = {0};
+	frontend.audio_stream = audio_stream;
+	frontend.speed = speed;
+	frontend.fast_forward_speed = fast_forward_speed;
+	frontend.current_speed = 1.0;
+	frontend.run_ahead = run_ahead;
+	frontend.rewind_enabled = rewind_budget > 0;
+	frontend.state_path = state_path;
+	atomic_init(&frontend.key_state, 0);
+	atomic_init(&frontend.fast_forward, false);
+	atomic_init(&frontend.rewinding, false);
+	atomic_init(&frontend.state_request, STATE_REQUEST_NONE);
+	atomic_init(&frontend.quit, false);
+
+	if (!triple_buffer_init(&frontend.frames, FRAME_SIZE)) {
+		exit_with_error(3, "Could not allocate frame buffers!");
+	}
+
+	if (frontend.rewind_enabled && !rewind_init(&frontend.rewind, rewind_budget, REWIND_DEFAULT_INTERVAL)) {
+		exit_with_error(3, "Could not allocate rewind buffer!");
+	}
+
+	nes_callbacks_t callbacks = {
+		frontend_publish_frame,
+		frontend_queue_audio,
+		&frontend
 	};
 
-	nes_t nes = {0};
-	if (!nes_init(&nes, &render_ctx)) {
+	nes_t *nes = &frontend.nes;
+	if (!nes_init(nes, &callbacks)) {
 		exit_with_error(3, "Could not create main NES data!");
 	}
+	if (!nes_set_cpu_core(nes, cpu_core)) {
+		exit_with_error(3, "Could not set up the CPU core!");
+	}
 
-	if (!nes_load_rom(&nes, argv[1])) {
+	if (!nes_load_rom(nes, rom_path)) {
 		exit_with_error(4, "Could not load NES rom!");
 	}
 
-	int pitch;
-	SDL_LockTexture(video_texture, NULL, (void **)&nes.video_data, &pitch);
-	nes_clear_screen(&nes);
+	nes_clear_screen(nes);
 
-	bool unlimited_speed = false;
-	while (true) {
+	if (record_path) {
+		if (!movie_record_start(&frontend.recorder, record_path, nes)) {
+			exit_with_error(9, "Could not start recording!");
+		}
+		frontend.recording = true;
+	}
+
+	pacer_init(&frontend.pacer, NES_FRAMES_PER_SECOND);
+
+	SDL_Thread *thread = SDL_CreateThread(emulation_thread, "emulation", &frontend);
+	if (!thread) {
+		exit_with_error(8, "Could not create emulation thread: %s", SDL_GetError());
+	}
+
+	uint8_t key_state = 0;
+	bool dump_memory = false;
+	while (!atomic_load(&frontend.quit)) {
 		SDL_Event event;
 		while (SDL_PollEvent(&event)) {
 			switch (event.type) {
 				case SDL_EVENT_QUIT: {
-					goto main_cleanup;
+					atomic_store(&frontend.quit, true);
 					break;
 				}
 				case SDL_EVENT_KEY_DOWN:
 				case SDL_EVENT_KEY_UP: {
 					if (event.key.key == SDLK_D) {
-						nes_dump_memory(&nes, "debug/mem.bin");
-						nes_dump_vmemory(&nes, "debug/vmem.bin");
-						log_event("Dumping RAM / VRAM. Exiting...");
-
-						goto main_cleanup;
+						dump_memory = true;
+						atomic_store(&frontend.quit, true);
 					} else if (event.key.key == SDLK_TAB) {
-						unlimited_speed = event.key.type == SDL_EVENT_KEY_DOWN;
+						atomic_store(&frontend.fast_forward, event.key.type == SDL_EVENT_KEY_DOWN);
+					} else if (event.key.key == SDLK_BACKSPACE) {
+						atomic_store(&frontend.rewinding, event.key.type == SDL_EVENT_KEY_DOWN);
+					} else if (event.key.key == SDLK_F5) {
+						if (event.key.type == SDL_EVENT_KEY_DOWN) {
+							atomic_store(&frontend.state_request, STATE_REQUEST_SAVE);
+						}
+					} else if (event.key.key == SDLK_F9) {
+						if (event.key.type == SDL_EVENT_KEY_DOWN) {
+							atomic_store(&frontend.state_request, STATE_REQUEST_LOAD);
+						}
 					} else {
-						handle_keypress(&event, &nes.key_state);
+						handle_keypress(&event, &key_state);
+						atomic_store(&frontend.key_state, key_state);
 					}
 					break;
 				}
@@ -99,15 +420,37 @@ int main(int argc, char **argv)
 			}
 		}
 
-		nes_do_frame_cycle(&nes);
-		if (!unlimited_speed) {
-			nes_delay_if_necessary(&nes);
+		if (triple_buffer_acquire(&frontend.frames)) {
+			present_frame(renderer, video_texture, triple_buffer_front(&frontend.frames));
+		} else {
+			// nothing new to show, sleep until input arrives or for at most 1ms
+			SDL_WaitEventTimeout(NULL, 1);
 		}
 	}
 
-main_cleanup:
-	nes_cleanup(&nes);
+	SDL_WaitThread(thread, NULL);
 
+	if (dump_memory) {
+		nes_dump_memory(nes, "debug/mem.bin");
+		nes_dump_vmemory(nes, "debug/vmem.bin");
+		log_event("Dumping RAM / VRAM. Exiting...");
+	}
+
+	pacer_report(&frontend.pacer, stdout);
+	if (frontend.rewind_enabled) {
+		rewind_report(&frontend.rewind, stdout);
+		rewind_cleanup(&frontend.rewind);
+	}
+	if (frontend.recording) {
+		movie_record_finish(&frontend.recorder);
+		log_event("Recorded %llu frames to %s", (unsigned long long)frontend.recorder.num_frames, record_path);
+	}
+	nes_cleanup(nes);
+	triple_buffer_cleanup(&frontend.frames);
+
+	if (audio_stream) {
+		SDL_DestroyAudioStream(audio_stream);
+	}
 	SDL_DestroyTexture(video_texture);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
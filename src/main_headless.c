@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "utils.h"
+#include "utils_platform.h"
+#include "nes.h"
+#include "state.h"
+#include "rewind.h"
+#include "explore.h"
+#include "recompiler.h"
+#include "movie.h"
+#include "page_store.h"
+#include "pacer.h"
+
+#define APP_NAME "NESEMU (headless)"
+#define DEFAULT_FRAME_COUNT 600
+
+static const char *usage =
+	"Usage: nesemu-headless [--rom] <rom path> [--frames N] [--dump-frame <file.ppm>] [--realtime] [--speed X] [--skip-render]\n"
+	"                       [--run-ahead N] [--rewind N] [--load-state <file>] [--save-state <file>]\n"
+	"                       [--record <file>] [--replay <file> [--seek FRAME] [--index <file>] [--keyframe-interval N]\n"
+	"                       [--compress-keyframes]] [--page-store] [--cpu interpreter|threaded|jit|aot]\n"
+	"                       [--explore DEPTH [--workers N] [--score-addr ADDR]] [--recompile <file.c>]";
+
+#define DEFAULT_EXPLORE_WORKERS 8
+
+typedef struct {
+	uint64_t frames_presented;
+} headless_state_t;
+
+static void headless_frame(void *userdata, const uint32_t *frame_data)
+{
+	headless_state_t *state = userdata;
+	state->frames_presented++;
+}
+
+typedef struct {
+	const char *rom_path;
+	const char *dump_frame_path;
+	uint64_t frames;
+	bool frames_given;
+	bool realtime;
+	double speed;
+	bool skip_render;
+	uint32_t run_ahead;
+	uint64_t rewind_frames;
+	const char *load_state_path;
+	const char *save_state_path;
+	const char *record_path;
+	const char *replay_path;
+	uint64_t seek_frame;
+	const char *index_path;
+	uint32_t keyframe_interval;
+	bool compress_keyframes;
+	bool page_store;
+	nes_cpu_core_t cpu_core;
+	explore_options_t explore;
+	const char *recompile_path;
+} headless_options_t;
+
+static void parse_options(int argc, char **argv, headless_options_t *opts)
+{
+	opts->rom_path = NULL;
+	opts->dump_frame_path = NULL;
+	opts->frames = DEFAULT_FRAME_COUNT;
+	opts->frames_given = false;
+	opts->realtime = false;
+	opts->speed = 1.0;
+	opts->skip_render = false;
+	opts->run_ahead = 0;
+	opts->rewind_frames = 0;
+	opts->load_state_path = NULL;
+	opts->save_state_path = NULL;
+	opts->record_path = NULL;
+	opts->replay_path = NULL;
+	opts->seek_frame = 0;
+	opts->index_path = NULL;
+	opts->keyframe_interval = MOVIE_KEYFRAME_INTERVAL;
+	opts->compress_keyframes = false;
+	opts->page_store = false;
+	opts->cpu_core = NES_CPU_INTERPRETER;
+	opts->explore = (explore_options_t){0, DEFAULT_EXPLORE_WORKERS, 0};
+	opts->recompile_path = NULL;
+	bool cpu_given = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (strcmp(arg, "--rom") == 0 && has_value) {
+			opts->rom_path = argv[++i];
+		} else if (strcmp(arg, "--frames") == 0 && has_value) {
+			char *end;
+			opts->frames = strtoull(argv[++i], &end, 10);
+			if (*end != '\0' || opts->frames == 0) {
+				exit_with_error(2, "Invalid frame count: %s", argv[i]);
+			}
+			opts->frames_given = true;
+		} else if (strcmp(arg, "--dump-frame") == 0 && has_value) {
+			opts->dump_frame_path = argv[++i];
+		} else if (strcmp(arg, "--realtime") == 0) {
+			opts->realtime = true;
+		} else if (strcmp(arg, "--speed") == 0 && has_value) {
+			char *end;
+			opts->speed = strtod(argv[++i], &end);
+			if (*end != '\0' || opts->speed <= 0) {
+				exit_with_error(2, "Invalid speed: %s", argv[i]);
+			}
+		} else if (strcmp(arg, "--skip-render") == 0) {
+			opts->skip_render = true;
+		} else if (strcmp(arg, "--run-ahead") == 0 && has_value) {
+			char *end;
+			opts->run_ahead = strtoul(argv[++i], &end, 10);
+			if (*end != '\0') {
+				exit_with_error(2, "Invalid run-ahead frame count: %s", argv[i]);
+			}
+		} else if (strcmp(arg, "--rewind") == 0 && has_value) {
+			char *end;
+			opts->rewind_frames = strtoull(argv[++i], &end, 10);
+			if (*end != '\0') {
+				exit_with_error(2, "Invalid rewind frame count: %s", argv[i]);
+			}
+		} else if (strcmp(arg, "--load-state") == 0 && has_value) {
+			opts->load_state_path = argv[++i];
+		} else if (strcmp(arg, "--save-state") == 0 && has_value) {
+			opts->save_state_path = argv[++i];
+		} else if (strcmp(arg, "--record") == 0 && has_value) {
+			opts->record_path = argv[++i];
+		} else if (strcmp(arg, "--replay") == 0 && has_value) {
+			opts->replay_path = argv[++i];
+		} else if (strcmp(arg, "--seek") == 0 && has_value) {
+			char *end;
+			opts->seek_frame = strtoull(argv[++i], &end, 10);
+			if (*end != '\0') {
+				exit_with_error(2, "Invalid seek frame: %s", argv[i]);
+			}
+		} else if (strcmp(arg, "--index") == 0 && has_value) {
+			opts->index_path = argv[++i];
+		} else if (strcmp(arg, "--page-store") == 0) {
+			opts->page_store = true;
+		} else if (strcmp(arg, "--cpu") == 0 && has_value) {
+			if (!nes_cpu_core_from_name(argv[++i], &opts->cpu_core)) {
+				exit_with_error(2, "Unknown CPU core: %s", argv[i]);
+			}
+			cpu_given = true;
+		} else if (strcmp(arg, "--compress-keyframes") == 0) {
+			opts->compress_keyframes = true;
+		} else if (strcmp(arg, "--keyframe-interval") == 0 && has_value) {
+			char *end;
+			opts->keyframe_interval = strtoul(argv[++i], &end, 10);
+			if (*end != '\0' || opts->keyframe_interval == 0) {
+				exit_with_error(2, "Invalid keyframe interval: %s", argv[i]);
+			}
+		} else if (strcmp(arg, "--explore") == 0 && has_value) {
+			char *end;
+			opts->explore.depth = strtoul(argv[++i], &end, 10);
+			if (*end != '\0' || opts->explore.depth == 0) {
+				exit_with_error(2, "Invalid exploration depth: %s", argv[i]);
+			}
+		} else if (strcmp(arg, "--workers") == 0 && has_value) {
+			char *end;
+			opts->explore.workers = strtoul(argv[++i], &end, 10);
+			if (*end != '\0' || opts->explore.workers == 0 || opts->explore.workers > EXPLORE_MAX_BRANCHES) {
+				exit_with_error(2, "Invalid worker count: %s", argv[i]);
+			}
+		} else if (strcmp(arg, "--score-addr") == 0 && has_value) {
+			char *end;
+			unsigned long addr = strtoul(argv[++i], &end, 0);
+			if (*end != '\0' || addr >= CPU_RAM_SIZE) {
+				exit_with_error(2, "Invalid score address: %s", argv[i]);
+			}
+			opts->explore.score_addr = addr;
+		} else if (strcmp(arg, "--recompile") == 0 && has_value) {
+			opts->recompile_path = argv[++i];
+		} else if (arg[0] != '-' && !opts->rom_path) {
+			opts->rom_path = arg;
+		} else {
+			exit_with_error(2, "%s", usage);
+		}
+	}
+
+	if (!opts->rom_path) {
+		exit_with_error(2, "%s", usage);
+	}
+
+	// movies always start from power-on
+	if (opts->load_state_path && (opts->record_path || opts->replay_path)) {
+		exit_with_error(2, "--load-state can't be combined with --record or --replay");
+	}
+
+	if ((opts->seek_frame > 0 || opts->index_path) && !opts->replay_path) {
+		exit_with_error(2, "--seek and --index need --replay");
+	}
+
+	// a recording has to start from power-on
+	if (opts->seek_frame > 0 && opts->record_path) {
+		exit_with_error(2, "--seek can't be combined with --record");
+	}
+
+	// only the threaded core fills the block cache the recompiler takes
+	// its blocks from, with any other the output misses most of the code
+	if (opts->recompile_path) {
+		if (cpu_given && opts->cpu_core != NES_CPU_THREADED) {
+			exit_with_error(2, "--recompile needs --cpu threaded");
+		}
+		opts->cpu_core = NES_CPU_THREADED;
+	}
+}
+
+// Writes the last finished frame as a binary PPM
+static bool dump_frame(const uint32_t *frame, const char *path)
+{
+	FILE *dump = fopen(path, "wb");
+	if (!dump) {
+		log_event("couldn't open frame dump file!");
+		return false;
+	}
+
+	fprintf(dump, "P6\n%d %d\n255\n", INTERNAL_VIDEO_WIDTH, INTERNAL_VIDEO_HEIGHT);
+
+	for (int i = 0; i < INTERNAL_VIDEO_WIDTH * INTERNAL_VIDEO_HEIGHT; i++) {
+		uint8_t rgb[3] = {
+			(frame[i] >> 16) & 0xff,
+			(frame[i] >> 8) & 0xff,
+			frame[i] & 0xff
+		};
+		fwrite(rgb, sizeof(uint8_t), 3, dump);
+	}
+
+	fclose(dump);
+	return true;
+}
+
+static double seconds_between(precise_time_t start, precise_time_t end)
+{
+	return (double)(end.time - start.time) + ((double)end.nanoseconds - (double)start.nanoseconds) / 1e9;
+}
+
+// --seek: jumps to a frame of the replayed movie through its keyframes
+static bool seek_movie(nes_t *nes, const movie_t *movie, movie_index_t *index, uint64_t frame)
+{
+	uint64_t keyframes = index->num_keyframes;
+
+	precise_time_t start = get_precise_time();
+	bool code = movie_seek(nes, movie, index, frame);
+	double elapsed = seconds_between(start, get_precise_time());
+	if (!code) {
+		return false;
+	}
+
+	printf("Seeked to frame %llu in %.3f ms (%llu keyframes, %llu new, every %u frames)\n",
+		(unsigned long long)frame, elapsed * MILLISECONDS_PER_SECOND,
+		(unsigned long long)index->num_keyframes, (unsigned long long)(index->num_keyframes - keyframes),
+		index->interval);
+	printf("  keyframes take %.1f KiB each on average\n",
+		index->keyframe_bytes / 1024.0 / index->num_keyframes);
+
+	return true;
+}
+
+// --explore: tries every input from where the run ended
+static bool explore(nes_t *nes, const explore_options_t *opts)
+{
+	static explore_result_t results[EXPLORE_MAX_BRANCHES];
+
+	precise_time_t start = get_precise_time();
+	bool code = explore_run(nes, opts, results, EXPLORE_MAX_BRANCHES);
+	double elapsed = seconds_between(start, get_precise_time());
+	if (!code) {
+		return false;
+	}
+
+	uint32_t distinct = 0;
+	uint32_t best = 0;
+	for (uint32_t i = 0; i < EXPLORE_MAX_BRANCHES; i++) {
+		bool seen = false;
+		for (uint32_t j = 0; j < i && !seen; j++) {
+			seen = results[j].ram_hash == results[i].ram_hash;
+		}
+		distinct += !seen;
+
+		if (results[i].score > results[best].score) {
+			best = i;
+		}
+	}
+
+	printf("Explored %u branches of %u frames in %.3f s (%.1f branches/s, %u workers)\n",
+		EXPLORE_MAX_BRANCHES, opts->depth, elapsed, EXPLORE_MAX_BRANCHES / elapsed, opts->workers);
+	printf("  %u distinct RAM outcomes, best score %u ($%04x) with input %02x\n",
+		distinct, results[best].score, opts->score_addr, results[best].key_state);
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	headless_options_t opts;
+	parse_options(argc, argv, &opts);
+
+	printf("%s v0.1\n", APP_NAME);
+
+	headless_state_t state = {0};
+	nes_callbacks_t callbacks = {
+		headless_frame,
+		NULL,
+		&state
+	};
+
+	nes_t *nes = nes_create(&callbacks);
+	if (!nes) {
+		exit_with_error(3, "Could not create main NES data!");
+	}
+	if (!nes_set_cpu_core(nes, opts.cpu_core)) {
+		exit_with_error(3, "Could not set up the CPU core!");
+	}
+
+	if (!nes_load_rom(nes, opts.rom_path)) {
+		exit_with_error(4, "Could not load NES rom!");
+	}
+
+	nes_clear_screen(nes);
+
+	if (opts.load_state_path && !nes_load_state(nes, opts.load_state_path)) {
+		exit_with_error(6, "Could not load state!");
+	}
+
+	// --replay runs every frame of the movie, as fast as possible unless
+	// --realtime is given
+	movie_t movie;
+	if (opts.replay_path) {
+		if (!movie_open(&movie, opts.replay_path)) {
+			exit_with_error(8, "Could not open movie!");
+		}
+		if (!movie_matches(&movie, nes)) {
+			exit_with_error(8, "Movie doesn't match the ROM!");
+		}
+		if (opts.seek_frame >= movie.num_frames) {
+			exit_with_error(8, "Movie has only %llu frames!", (unsigned long long)movie.num_frames);
+		}
+	}
+
+	// --seek and --index keep keyframes of the replay, --index loads them
+	// from (when it exists yet) and saves them to a sidecar file
+	movie_index_t index;
+	bool indexing = opts.replay_path && (opts.seek_frame > 0 || opts.index_path);
+	uint64_t loaded_keyframes = 0;
+	if (indexing) {
+		if (!movie_index_init(&index, &movie, opts.keyframe_interval, opts.compress_keyframes)) {
+			exit_with_error(3, "Could not allocate movie index!");
+		}
+		if (opts.index_path && movie_index_load(&index, opts.index_path)) {
+			loaded_keyframes = index.num_keyframes;
+		}
+		movie_index_record(&index, nes, 0);
+
+		if (opts.seek_frame > 0 && !seek_movie(nes, &movie, &index, opts.seek_frame)) {
+			exit_with_error(8, "Could not seek!");
+		}
+	}
+
+	// the rest of the movie, or --frames of it
+	if (opts.replay_path) {
+		uint64_t remaining = movie.num_frames - opts.seek_frame;
+		if (!opts.frames_given || opts.frames > remaining) {
+			opts.frames = remaining;
+		}
+	}
+
+	movie_recorder_t recorder;
+	if (opts.record_path && !movie_record_start(&recorder, opts.record_path, nes)) {
+		exit_with_error(8, "Could not start recording!");
+	}
+
+	// --realtime paces frames like the SDL frontend does, mostly useful to
+	// measure the pacer itself
+	frame_pacer_t pacer;
+	pacer_init(&pacer, NES_FRAMES_PER_SECOND);
+	pacer_set_speed(&pacer, opts.speed);
+
+	static nes_state_t run_ahead_state;
+
+	// --rewind records history while running and steps back through it at
+	// the end, the dumped frame is then the one rewound to
+	rewind_t rewind;
+	if (opts.rewind_frames > 0 && !rewind_init(&rewind, REWIND_DEFAULT_BUDGET, REWIND_DEFAULT_INTERVAL)) {
+		exit_with_error(3, "Could not allocate rewind buffer!");
+	}
+
+	// --page-store keeps a snapshot of every frame in a page store, to see
+	// how well they deduplicate
+	page_store_t store;
+	page_store_state_t *snapshots = NULL;
+	uint64_t num_snapshots = 0;
+	uint64_t store_ns = 0;
+	if (opts.page_store) {
+		snapshots = malloc(opts.frames * sizeof(page_store_state_t));
+		if (!snapshots || !page_store_init(&store)) {
+			exit_with_error(3, "Could not allocate page store!");
+		}
+	}
+
+	uint64_t first_frame = nes->frames;
+	precise_time_t start = get_precise_time();
+	for (uint64_t i = 0; i < opts.frames; i++) {
+		// --skip-render still renders the frame finished in the last call,
+		// so there is one to dump
+		bool render = true;
+		if (opts.skip_render) {
+			render = i + 2 >= opts.frames;
+		} else if (opts.realtime) {
+			render = pacer_should_render(&pacer, true);
+		}
+
+		if (opts.replay_path) {
+			nes->key_state = movie.inputs[opts.seek_frame + i];
+		}
+
+		if (opts.run_ahead > 0) {
+			nes->skip_render = true;
+			nes_do_frame_cycle(nes);
+			if (opts.rewind_frames > 0) {
+				rewind_record_frame(&rewind, nes);
+			}
+			if (render) {
+				nes_run_ahead(nes, &run_ahead_state, opts.run_ahead);
+			}
+		} else {
+			nes->skip_render = !render;
+			nes_do_frame_cycle(nes);
+			if (opts.rewind_frames > 0) {
+				rewind_record_frame(&rewind, nes);
+			}
+		}
+
+		if (opts.record_path) {
+			movie_record_frame(&recorder, nes->key_state);
+		}
+		if (indexing) {
+			movie_index_record(&index, nes, opts.seek_frame + i + 1);
+		}
+		if (opts.page_store) {
+			uint64_t store_start = get_monotonic_ns();
+			if (page_store_save(&store, &snapshots[num_snapshots], nes)) {
+				num_snapshots++;
+			}
+			store_ns += get_monotonic_ns() - store_start;
+		}
+
+		if (opts.realtime) {
+			pacer_wait(&pacer);
+		}
+	}
+	precise_time_t end = get_precise_time();
+	uint64_t frames_run = nes->frames - first_frame;
+
+	int code = 0;
+	if (indexing) {
+		if (opts.index_path && index.num_keyframes > loaded_keyframes &&
+			!movie_index_save(&index, opts.index_path)) {
+			code = 8;
+		}
+		movie_index_cleanup(&index);
+	}
+	if (opts.replay_path) {
+		movie_close(&movie);
+	}
+	if (opts.record_path && !movie_record_finish(&recorder)) {
+		code = 8;
+	}
+
+	if (opts.page_store) {
+		page_store_report(&store, stdout);
+		printf("  %llu snapshots, %.1f us per snapshot\n", (unsigned long long)num_snapshots,
+			num_snapshots ? store_ns / 1e3 / num_snapshots : 0.0);
+		page_store_cleanup(&store);
+		free(snapshots);
+	}
+
+	if (opts.rewind_frames > 0) {
+		precise_time_t rewind_start = get_precise_time();
+		uint64_t steps = 0;
+		while (steps < opts.rewind_frames && rewind_step_back(&rewind, nes)) {
+			steps++;
+		}
+		double rewind_elapsed = seconds_between(rewind_start, get_precise_time());
+
+		rewind_report(&rewind, stdout);
+		printf("  rewound %llu frames in %.3f ms, %.3f ms/step\n", (unsigned long long)steps,
+			rewind_elapsed * MILLISECONDS_PER_SECOND,
+			steps ? rewind_elapsed * MILLISECONDS_PER_SECOND / steps : 0.0);
+		rewind_cleanup(&rewind);
+	}
+
+	if (opts.save_state_path && !nes_save_state(nes, opts.save_state_path)) {
+		code = 6;
+	}
+
+	if (opts.explore.depth > 0 && !explore(nes, &opts.explore)) {
+		code = 7;
+	}
+
+	// --recompile writes the ROM's code out as C for a core built for it,
+	// after the run (always on the threaded core) so the blocks it found are
+	// in there too
+	if (opts.recompile_path) {
+		recompiler_stats_t stats;
+		if (recompiler_write(nes, opts.recompile_path, &stats)) {
+			printf("Recompiled %u blocks, %u instructions to %s\n",
+				stats.blocks, stats.instructions, opts.recompile_path);
+		} else {
+			code = 9;
+		}
+	}
+
+	if (opts.dump_frame_path) {
+		// nes->frame_data holds the last finished frame
+		if (state.frames_presented == 0) {
+			log_event("no frame was finished, nothing to dump");
+			code = 5;
+		} else if (!dump_frame(nes->frame_data, opts.dump_frame_path)) {
+			code = 5;
+		}
+	}
+
+	double elapsed = seconds_between(start, end);
+	printf("Frames emulated: %llu (%llu presented)\n",
+		(unsigned long long)frames_run, (unsigned long long)state.frames_presented);
+	printf("Elapsed: %.3f s, %.1f fps, %.3f ms/frame, %.2fx real time\n",
+		elapsed,
+		frames_run / elapsed,
+		elapsed * MILLISECONDS_PER_SECOND / frames_run,
+		frames_run / elapsed / NES_FRAMES_PER_SECOND);
+	if (opts.realtime) {
+		pacer_report(&pacer, stdout);
+	}
+
+	nes_destroy(nes);
+	return code;
+}
@@ -20,6 +20,17 @@ bool memory_init(nes_memory_t *memory)
 		printf("error allocating memory!\n");
 		return false;
 	}
+	memory->shared_writes = 0;
+	memory_mark_dirty(memory->dirty, 0, ADDRESS_SPACE_SIZE_6502);
+
+	memory->decoded = calloc(DECODE_CACHE_SIZE, sizeof(decoded_instr_t));
+	if (!memory->decoded) {
+		printf("error allocating decode cache!\n");
+		free(memory->data);
+		return false;
+	}
+	memory->decode_generation = 1;
+	memory->decode_writes = memory->shared_writes;
 
 	return true;
 }
@@ -27,6 +38,7 @@ bool memory_init(nes_memory_t *memory)
 
 void memory_cleanup(nes_memory_t *memory)
 {
+	free(memory->decoded);
 	free(memory->data);
 }
 
@@ -37,6 +49,8 @@ bool vmemory_init(nes_vmemory_t *vmemory)
 		printf("error allocating video memory!\n");
 		return false;
 	}
+	vmemory->shared_writes = 0;
+	memory_mark_dirty(vmemory->dirty, 0, ADDRESS_SPACE_SIZE_2C02);
 
 	return true;
 }
@@ -46,6 +60,39 @@ void vmemory_cleanup(nes_vmemory_t *vmemory)
 	free(vmemory->data);
 }
 
+// Marks every page overlapping [start, start + size)
+void memory_mark_dirty(uint64_t *dirty, uint32_t start, uint32_t size)
+{
+	if (size == 0) {
+		return;
+	}
+
+	uint32_t last = (start + size - 1) >> MEMORY_PAGE_SHIFT;
+	for (uint32_t page = start >> MEMORY_PAGE_SHIFT; page <= last; page++) {
+		dirty[page / 64] |= 1ULL << (page % 64);
+	}
+}
+
+bool memory_page_dirty(const uint64_t *dirty, uint32_t page)
+{
+	return (dirty[page / 64] >> (page % 64)) & 1;
+}
+
+// Copies the bitmap into out and clears it
+void memory_take_dirty(uint64_t *dirty, uint64_t *out, uint32_t words)
+{
+	for (uint32_t i = 0; i < words; i++) {
+		out[i] = dirty[i];
+		dirty[i] = 0;
+	}
+}
+
+static inline void __mark_page_dirty(uint64_t *dirty, uint16_t address)
+{
+	uint32_t page = address >> MEMORY_PAGE_SHIFT;
+	dirty[page / 64] |= 1ULL << (page % 64);
+}
+
 static inline void set_bit(uint8_t *byte, int bit, int status)
 {
 	*byte ^= (-status ^ *byte) & (1UL << bit);
@@ -56,6 +103,22 @@ static inline uint8_t __get_bit_8(uint8_t byte, int bit)
 	return (byte >> bit) & 1;
 }
 
+static inline bool __is_ppu_address(uint16_t address)
+{
+	return (address >= PPUCTRL_ADDR && address <= PPUDATA_ADDR) || address == OAMDMA_ADDR;
+}
+
+/*
+The PPU runs behind the CPU and is only caught up to the dot the current
+instruction started on when its state is about to be observed or changed
+*/
+static inline void __sync_ppu(nes_cpu_t *cpu, uint16_t address)
+{
+	if (__is_ppu_address(address)) {
+		ppu_run(cpu->ppu, cpu->frame_cycle * PPU_DOTS_PER_CPU_CYCLE + 1);
+	}
+}
+
 void mem_write_8_mmc1(nes_cpu_t *cpu, uint16_t address, uint8_t value)
 {
 	/*uint8_t *mem = cpu->mem->data;
@@ -102,6 +165,8 @@ void mem_write_8(nes_cpu_t *cpu, uint16_t address, uint8_t value)
 	if (cpu->mmc_type == 1) {
 		mem_write_8_mmc1(cpu, address, value);
 	} else {
+		__sync_ppu(cpu, address);
+
 		switch (address) {
 			case PPUCTRL_ADDR: {
 				ppu->PPUCTRL = value;
@@ -113,6 +178,7 @@ void mem_write_8(nes_cpu_t *cpu, uint16_t address, uint8_t value)
 				ppu->PPUADDR_increment_amount = __get_bit_8(value, 2) ? 0x20 : 0x1;
 				ppu->NMI_output = __get_bit_8(value, 7);
 				ppu->triggered_NMI = !ppu->NMI_output;
+				cpu->nmi_input = ppu_nmi_asserted(ppu);
 				break;
 			}
 			case PPUMASK_ADDR: {
@@ -182,13 +248,24 @@ void mem_write_8(nes_cpu_t *cpu, uint16_t address, uint8_t value)
 					}
 				}
 		
+				if (addr < PPU_NAMETABLES_START ||
+					(addr >= PPU_NAMETABLES_START + PPU_NAMETABLES_SIZE && addr < PPU_PALETTE_START)) {
+					ppu->vmem->shared_writes++;
+				}
 				ppu->vmem->data[addr] = value;
+				__mark_page_dirty(ppu->vmem->dirty, addr);
 				break;
 			}
 			case OAMDMA_ADDR: {
 				//log_event("OAM DMA event. Copy source: 0x%04x", value * 0x100);
 				memcpy(ppu->oam, &mem[value * 0x100], 0x100);
-				cpu->wait_cycles = 513;
+
+				// the CPU is halted (with the rest of this instruction's cycles
+				// still to go) until the DMA end event
+				cpu->halted = true;
+				cpu->total_cycles += OAM_DMA_CYCLES;
+				scheduler_add(cpu->scheduler, EVENT_OAM_DMA_END,
+					scheduler_cpu_clock(cpu->scheduler, cpu->frame_cycle + OAM_DMA_CYCLES));
 
 				break;
 			}
@@ -239,7 +316,22 @@ void mem_write_8(nes_cpu_t *cpu, uint16_t address, uint8_t value)
 				break;
 			}
 			case APU_FRAME_COUNTER: {
-				log_event("writing to apu frame counter=%i", value);
+				apu->frame_five_step = __get_bit_8(value, 7);
+				apu->frame_irq_inhibit = __get_bit_8(value, 6);
+				if (apu->frame_irq_inhibit) {
+					apu->frame_irq = false;
+				}
+
+				// writing restarts the frame sequence, only the 4-step sequence
+				// can raise the frame IRQ
+				if (!apu->frame_five_step && !apu->frame_irq_inhibit) {
+					scheduler_add(cpu->scheduler, EVENT_APU_FRAME_IRQ,
+						scheduler_cpu_clock(cpu->scheduler, cpu->frame_cycle + APU_FRAME_IRQ_CYCLES));
+				} else {
+					scheduler_cancel(cpu->scheduler, EVENT_APU_FRAME_IRQ);
+				}
+
+				cpu->irq_input = apu->frame_irq;
 				break;
 			}
 			case CONTROLLER_IO_ADDR: {
@@ -252,7 +344,11 @@ void mem_write_8(nes_cpu_t *cpu, uint16_t address, uint8_t value)
 			}
 
 			default:
+				if (address >= CPU_RAM_SIZE && (uint16_t)(address - CPU_IO_START) >= CPU_IO_SIZE) {
+					cpu->mem->shared_writes++;
+				}
 				mem[address] = value;
+				__mark_page_dirty(cpu->mem->dirty, address);
 		}
 	}
 }
@@ -270,6 +366,9 @@ uint8_t mem_read_8(nes_cpu_t *cpu, uint16_t address)
 
 	uint8_t *mem = cpu->mem->data;
 	nes_ppu_t *ppu = cpu->ppu;
+	nes_apu_t *apu = cpu->apu;
+
+	__sync_ppu(cpu, address);
 	
 	switch (address) {
 		case PPUCTRL_ADDR: {
@@ -285,6 +384,7 @@ uint8_t mem_read_8(nes_cpu_t *cpu, uint16_t address)
 
 			ppu->in_vblank = false;
 			ppu->W_toggle = false;
+			cpu->nmi_input = ppu_nmi_asserted(ppu);
 
 			return copy;
 			break;
@@ -318,6 +418,15 @@ uint8_t mem_read_8(nes_cpu_t *cpu, uint16_t address)
 			return 0;
 			break;
 		}
+		case APU_STATUS: {
+			// reading acknowledges the frame IRQ
+			uint8_t status = (uint8_t)apu->frame_irq << 6;
+			apu->frame_irq = false;
+			cpu->irq_input = false;
+
+			return status;
+			break;
+		}
 		case CONTROLLER_IO_ADDR: {
 			if (!cpu->strobe_keys) {
 				bool bit = (cpu->key_state >> cpu->strobe_keys_write_no) & 1;
@@ -12,14 +12,70 @@
 
 #define CONTROLLER_IO_ADDR 0x4016
 
+/*
+The parts of either address space games keep changing: internal RAM and the
+I/O registers, the nametables and palettes. nes_clone only copies these, a
+write anywhere else (ROM, SRAM, pattern tables, unmirrored mirrors) bumps
+shared_writes so the next clone knows to copy everything.
+*/
+#define CPU_RAM_SIZE 0x800
+#define CPU_IO_START 0x4000
+#define CPU_IO_SIZE 0x20
+#define PPU_NAMETABLES_START 0x2000
+#define PPU_NAMETABLES_SIZE 0x1000
+#define PPU_PALETTE_START 0x3f00
+#define PPU_PALETTE_SIZE 0x20
+
+/*
+Every write into either address space also marks the 256 byte page it went
+to in a dirty bitmap (bit n of word n / 64 for page n), so snapshots can copy
+and compare only what changed since they last looked. The bitmap belongs to a
+single consumer, the one that clears it: currently rewind. Wholesale changes
+(a ROM or state load, clones) mark every page they replaced.
+*/
+#define MEMORY_PAGE_SHIFT 8
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define CPU_PAGES (ADDRESS_SPACE_SIZE_6502 / MEMORY_PAGE_SIZE)
+#define PPU_PAGES (ADDRESS_SPACE_SIZE_2C02 / MEMORY_PAGE_SIZE)
+#define DIRTY_WORDS(pages) (((pages) + 63) / 64)
+
 typedef struct __nes_cpu nes_cpu_t;
 
+/*
+Instructions in PRG ROM are decoded once into this cache (indexed by PC -
+DECODE_CACHE_START) instead of being fetched through mem_read_8 each time
+they run. An entry is only valid while its generation matches the cache's;
+the generation moves on whenever shared_writes does, which covers ROM and
+state loads and every write that could land in ROM. Code running from RAM
+isn't cached.
+*/
+#define DECODE_CACHE_START 0x8000
+#define DECODE_CACHE_SIZE (ADDRESS_SPACE_SIZE_6502 - DECODE_CACHE_START)
+
+typedef struct {
+    void (*handler)(nes_cpu_t *, uint32_t);
+    // Opcode << 16 | operand, as cpu_fetch_instruction packs it
+    uint32_t instr;
+    uint8_t size;
+    uint8_t cycles;
+    uint16_t generation;
+} decoded_instr_t;
+
 typedef struct __nes_memory {
     uint8_t *data;
+    uint32_t shared_writes;
+    uint64_t dirty[DIRTY_WORDS(CPU_PAGES)];
+
+    decoded_instr_t *decoded;
+    uint16_t decode_generation;
+    // shared_writes as of the current generation
+    uint32_t decode_writes;
 } nes_memory_t;
 
 typedef struct __nes_vmemory {
     uint8_t *data;
+    uint32_t shared_writes;
+    uint64_t dirty[DIRTY_WORDS(PPU_PAGES)];
 } nes_vmemory_t;
 
 bool memory_init(nes_memory_t *);
@@ -28,6 +84,10 @@ void memory_cleanup(nes_memory_t *);
 bool vmemory_init(nes_vmemory_t *);
 void vmemory_cleanup(nes_vmemory_t *);
 
+void memory_mark_dirty(uint64_t *, uint32_t, uint32_t);
+bool memory_page_dirty(const uint64_t *, uint32_t);
+void memory_take_dirty(uint64_t *, uint64_t *, uint32_t);
+
 
 uint8_t mem_read_8(nes_cpu_t *, uint16_t);
 uint16_t mem_read_16(nes_cpu_t *, uint16_t);
@@ -0,0 +1,453 @@
+#if defined NESEMU_LINUX || defined NESEMU_MACOS
+// mmap is POSIX, which a strict -std=c23 build hides
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "movie.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined NESEMU_LINUX || defined NESEMU_MACOS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+Everything a freshly loaded ROM starts from: all of memory and the CPU
+registers. A change to power-on behaviour (or a different ROM) changes it
+*/
+uint64_t movie_power_on_hash(const nes_t *nes)
+{
+	uint8_t registers[] = {
+		nes->cpu.pc & 0xff,
+		nes->cpu.pc >> 8,
+		nes->cpu.a,
+		nes->cpu.x,
+		nes->cpu.y,
+		nes->cpu.sp,
+		cpu_get_sr((nes_cpu_t *)&nes->cpu)
+	};
+
+	return hash_bytes(nes->memory.data, ADDRESS_SPACE_SIZE_6502) ^
+		hash_bytes(nes->vmemory.data, ADDRESS_SPACE_SIZE_2C02) * 3 ^
+		hash_bytes(registers, sizeof(registers)) * 5;
+}
+
+// Has to be called right after the ROM is loaded, before the first frame
+bool movie_record_start(movie_recorder_t *rec, const char *path, const nes_t *nes)
+{
+	rec->num_frames = 0;
+	rec->file = fopen(path, "wb");
+	if (!rec->file) {
+		log_event("Could not open movie file %s", path);
+		return false;
+	}
+
+	// num_frames is filled in by movie_record_finish
+	movie_header_t header = {
+		MOVIE_MAGIC,
+		MOVIE_VERSION,
+		nes->rom_hash,
+		movie_power_on_hash(nes),
+		0
+	};
+
+	if (fwrite(&header, sizeof(header), 1, rec->file) != 1) {
+		log_event("Could not write movie file %s", path);
+		fclose(rec->file);
+		rec->file = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+// Call once per frame with the input it was run with
+bool movie_record_frame(movie_recorder_t *rec, uint8_t key_state)
+{
+	if (fputc(key_state, rec->file) == EOF) {
+		return false;
+	}
+
+	rec->num_frames++;
+	return true;
+}
+
+bool movie_record_finish(movie_recorder_t *rec)
+{
+	bool code = fseek(rec->file, offsetof(movie_header_t, num_frames), SEEK_SET) == 0 &&
+		fwrite(&rec->num_frames, sizeof(rec->num_frames), 1, rec->file) == 1;
+
+	if (fclose(rec->file) != 0) {
+		code = false;
+	}
+	rec->file = NULL;
+
+	if (!code) {
+		log_event("Could not finish writing movie file!");
+	}
+
+	return code;
+}
+
+static bool movie_map(movie_t *movie, const char *path)
+{
+#if defined NESEMU_LINUX || defined NESEMU_MACOS
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	// replay reads it front to back exactly once
+	posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	movie->data = data;
+	movie->size = st.st_size;
+	movie->mapped = true;
+	return true;
+#else
+	movie->data = read_file(path, &movie->size);
+	movie->mapped = false;
+	return movie->data != NULL;
+#endif
+}
+
+bool movie_open(movie_t *movie, const char *path)
+{
+	memset(movie, 0, sizeof(movie_t));
+
+	if (!movie_map(movie, path)) {
+		log_event("Could not read movie file %s", path);
+		return false;
+	}
+
+	if (movie->size < sizeof(movie_header_t)) {
+		log_event("Movie file is truncated!");
+		movie_close(movie);
+		return false;
+	}
+	memcpy(&movie->header, movie->data, sizeof(movie_header_t));
+
+	if (memcmp(movie->header.magic, MOVIE_MAGIC, sizeof(movie->header.magic)) != 0) {
+		log_event("Not a movie file!");
+		movie_close(movie);
+		return false;
+	}
+
+	if (movie->header.version != MOVIE_VERSION) {
+		log_event("Movie version %u isn't supported (expected %u)", movie->header.version, MOVIE_VERSION);
+		movie_close(movie);
+		return false;
+	}
+
+	movie->inputs = (const uint8_t *)movie->data + sizeof(movie_header_t);
+	movie->num_frames = movie->size - sizeof(movie_header_t);
+
+	// a recording that never got finished still has every frame written
+	if (movie->header.num_frames != 0 && movie->header.num_frames < movie->num_frames) {
+		movie->num_frames = movie->header.num_frames;
+	}
+
+	movie->hash = hash_bytes(&movie->header, sizeof(movie_header_t)) ^
+		hash_bytes(movie->inputs, movie->num_frames) * 3;
+
+	return true;
+}
+
+// nes has to have the ROM freshly loaded
+bool movie_matches(const movie_t *movie, const nes_t *nes)
+{
+	if (movie->header.rom_hash != nes->rom_hash) {
+		log_event("Movie was recorded with a different ROM!");
+		return false;
+	}
+
+	if (movie->header.power_on_hash != movie_power_on_hash(nes)) {
+		log_event("Movie was recorded from a different power-on state!");
+		return false;
+	}
+
+	return true;
+}
+
+void movie_close(movie_t *movie)
+{
+	if (!movie->data) {
+		return;
+	}
+
+#if defined NESEMU_LINUX || defined NESEMU_MACOS
+	if (movie->mapped) {
+		munmap(movie->data, movie->size);
+	} else {
+		free(movie->data);
+	}
+#else
+	free(movie->data);
+#endif
+
+	movie->data = NULL;
+	movie->inputs = NULL;
+}
+
+bool movie_index_init(movie_index_t *index, const movie_t *movie, uint32_t interval, bool compress)
+{
+	memset(index, 0, sizeof(movie_index_t));
+	index->movie_hash = movie->hash;
+	index->interval = interval;
+	index->compress = compress;
+
+	index->state = malloc(sizeof(nes_state_t));
+	index->serialized = malloc(state_serialized_size());
+	index->compressed = malloc(state_compressed_bound());
+	if (!index->state || !index->serialized || !index->compressed) {
+		log_event("Could not allocate movie index!");
+		movie_index_cleanup(index);
+		return false;
+	}
+
+	return true;
+}
+
+static void movie_index_free_keyframes(movie_index_t *index)
+{
+	for (uint64_t i = 0; i < index->num_keyframes; i++) {
+		free(index->keyframes[i].data);
+	}
+	free(index->keyframes);
+
+	index->keyframes = NULL;
+	index->num_keyframes = 0;
+	index->capacity = 0;
+	index->keyframe_bytes = 0;
+}
+
+void movie_index_cleanup(movie_index_t *index)
+{
+	movie_index_free_keyframes(index);
+
+	free(index->state);
+	free(index->serialized);
+	free(index->compressed);
+	index->state = NULL;
+	index->serialized = NULL;
+	index->compressed = NULL;
+}
+
+// Appends a copy of data as the next keyframe
+static bool movie_index_append(movie_index_t *index, const uint8_t *data, uint32_t size)
+{
+	if (index->num_keyframes == index->capacity) {
+		uint64_t capacity = index->capacity ? index->capacity * 2 : 64;
+		movie_keyframe_t *keyframes = realloc(index->keyframes, capacity * sizeof(movie_keyframe_t));
+		if (!keyframes) {
+			log_event("Could not allocate movie keyframes!");
+			return false;
+		}
+
+		index->keyframes = keyframes;
+		index->capacity = capacity;
+	}
+
+	uint8_t *copy = malloc(size);
+	if (!copy) {
+		log_event("Could not allocate movie keyframes!");
+		return false;
+	}
+	memcpy(copy, data, size);
+
+	index->keyframes[index->num_keyframes++] = (movie_keyframe_t){copy, size};
+	index->keyframe_bytes += size;
+	return true;
+}
+
+/*
+Call with the number of movie frames nes has run so far, every frame. Takes
+a keyframe when position is the next one missing from the index
+*/
+bool movie_index_record(movie_index_t *index, const nes_t *nes, uint64_t position)
+{
+	if (position % index->interval != 0 || position / index->interval != index->num_keyframes) {
+		return true;
+	}
+
+	state_save(index->state, nes);
+	state_serialize(index->state, index->serialized);
+
+	if (index->compress) {
+		size_t size = state_compress(index->serialized, index->compressed);
+		return movie_index_append(index, index->compressed, size);
+	}
+
+	return movie_index_append(index, index->serialized, state_serialized_size());
+}
+
+bool movie_index_save(const movie_index_t *index, const char *path)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		log_event("Could not open movie index file %s", path);
+		return false;
+	}
+
+	movie_index_header_t header = {
+		MOVIE_INDEX_MAGIC,
+		MOVIE_INDEX_VERSION,
+		index->interval,
+		0,
+		index->movie_hash,
+		index->num_keyframes
+	};
+
+	bool code = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (uint64_t i = 0; code && i < index->num_keyframes; i++) {
+		const movie_keyframe_t *keyframe = &index->keyframes[i];
+		code = fwrite(&keyframe->size, sizeof(keyframe->size), 1, file) == 1 &&
+			fwrite(keyframe->data, keyframe->size, 1, file) == 1;
+	}
+
+	if (fclose(file) != 0) {
+		code = false;
+	}
+
+	if (!code) {
+		log_event("Could not write movie index file %s", path);
+	}
+
+	return code;
+}
+
+/*
+Replaces the keyframes (and interval) of index with the ones in the file,
+which has to belong to the same movie. Keyframes are only checked when a seek
+loads them. Leaves index untouched on failure
+*/
+bool movie_index_load(movie_index_t *index, const char *path)
+{
+	size_t size;
+	uint8_t *data = read_file(path, &size);
+	if (!data) {
+		log_event("Could not read movie index file %s", path);
+		return false;
+	}
+
+	movie_index_header_t header;
+	bool code = false;
+
+	if (size < sizeof(header)) {
+		log_event("Movie index file is truncated!");
+		goto done;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, MOVIE_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != MOVIE_INDEX_VERSION || header.interval == 0) {
+		log_event("Not a movie index file (or an unsupported version)!");
+		goto done;
+	}
+
+	if (header.movie_hash != index->movie_hash) {
+		log_event("Movie index belongs to a different movie!");
+		goto done;
+	}
+
+	// keyframes go into a copy of index, so it stays as it was on failure
+	movie_index_t loaded = *index;
+	loaded.interval = header.interval;
+	loaded.keyframes = NULL;
+	loaded.num_keyframes = 0;
+	loaded.capacity = 0;
+	loaded.keyframe_bytes = 0;
+
+	size_t pos = sizeof(header);
+	for (uint64_t i = 0; i < header.num_keyframes; i++) {
+		uint32_t keyframe_size;
+		if (size - pos < sizeof(keyframe_size)) {
+			break;
+		}
+		memcpy(&keyframe_size, data + pos, sizeof(keyframe_size));
+		pos += sizeof(keyframe_size);
+
+		if (size - pos < keyframe_size || !movie_index_append(&loaded, data + pos, keyframe_size)) {
+			break;
+		}
+		pos += keyframe_size;
+	}
+
+	if (loaded.num_keyframes != header.num_keyframes) {
+		log_event("Movie index file is truncated!");
+		movie_index_free_keyframes(&loaded);
+		goto done;
+	}
+
+	movie_index_free_keyframes(index);
+	*index = loaded;
+	code = true;
+
+done:
+	free(data);
+	return code;
+}
+
+/*
+Puts nes where it is after the first frame frames of the movie, showing the
+last of them. Needs at least the first keyframe in the index
+*/
+bool movie_seek(nes_t *nes, const movie_t *movie, movie_index_t *index, uint64_t frame)
+{
+	if (frame > movie->num_frames) {
+		log_event("Can't seek past the end of the movie!");
+		return false;
+	}
+
+	if (index->num_keyframes == 0) {
+		log_event("The movie index has no keyframes to seek from!");
+		return false;
+	}
+
+	// at least one frame is run (from the keyframe before) so it can be shown
+	uint64_t keyframe = frame > 0 ? (frame - 1) / index->interval : 0;
+	if (keyframe >= index->num_keyframes) {
+		keyframe = index->num_keyframes - 1;
+	}
+
+	const movie_keyframe_t *from = &index->keyframes[keyframe];
+	if (!state_deserialize(index->state, from->data, from->size)) {
+		log_event("Keyframe %llu of the movie index is corrupt!", (unsigned long long)keyframe);
+		return false;
+	}
+
+	state_load(index->state, nes);
+	// what's left in the frame buffer isn't from this state
+	nes->ppu.skip_render = true;
+
+	nes_audio_callback_t audio = nes->callbacks.audio;
+	nes->callbacks.audio = NULL;
+
+	bool code = true;
+	for (uint64_t position = keyframe * index->interval; position < frame && code; position++) {
+		nes->key_state = movie->inputs[position];
+		nes->skip_render = position + 1 < frame;
+		nes_do_frame_cycle(nes);
+		code = movie_index_record(index, nes, position + 1);
+	}
+
+	nes_flush_frame(nes);
+	nes->callbacks.audio = audio;
+
+	return code;
+}
@@ -0,0 +1,105 @@
+#ifndef MOVIE_INCLUDE
+#define MOVIE_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "nes.h"
+#include "state.h"
+
+/*
+Input movies: a header followed by one byte per frame, the 8 buttons of
+nes->key_state packed as is. A movie always starts from power-on and is tied
+to the ROM image and to the power-on state it was recorded from, so a replay
+either starts out exactly as the recording did or is refused.
+*/
+#define MOVIE_MAGIC "NESM"
+#define MOVIE_VERSION 1
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t rom_hash;
+	uint64_t power_on_hash;
+	uint64_t num_frames;
+} movie_header_t;
+
+typedef struct {
+	FILE *file;
+	uint64_t num_frames;
+} movie_recorder_t;
+
+// A movie opened for replay, inputs points straight into the mapped file
+typedef struct {
+	movie_header_t header;
+	const uint8_t *inputs;
+	uint64_t num_frames;
+
+	// Of the header and the inputs, what a movie index belongs to
+	uint64_t hash;
+
+	void *data;
+	size_t size;
+	bool mapped;
+} movie_t;
+
+/*
+Keyframes taken every interval frames while a movie is replayed, keyframe k
+being the state after k * interval frames. Seeking loads the closest one at
+or before the target and replays only the rest, taking any keyframes it
+passes on the way. Keyframes are kept serialized, LZ compressed when the
+index is set to compress (see state.h), so big indexes fit in memory. An
+index can be kept next to the movie as a sidecar file: a header followed by
+every keyframe as a u32 size and the keyframe.
+*/
+#define MOVIE_KEYFRAME_INTERVAL 600
+#define MOVIE_INDEX_MAGIC "NESI"
+#define MOVIE_INDEX_VERSION 2
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t interval;
+	uint32_t reserved;
+	uint64_t movie_hash;
+	uint64_t num_keyframes;
+} movie_index_header_t;
+
+typedef struct {
+	uint8_t *data;
+	uint32_t size;
+} movie_keyframe_t;
+
+typedef struct {
+	uint64_t movie_hash;
+	uint32_t interval;
+	bool compress;
+
+	movie_keyframe_t *keyframes;
+	uint64_t num_keyframes;
+	uint64_t capacity;
+	uint64_t keyframe_bytes;
+
+	// Scratch for taking and loading keyframes
+	nes_state_t *state;
+	uint8_t *serialized;
+	uint8_t *compressed;
+} movie_index_t;
+
+uint64_t movie_power_on_hash(const nes_t *);
+
+bool movie_record_start(movie_recorder_t *, const char *, const nes_t *);
+bool movie_record_frame(movie_recorder_t *, uint8_t);
+bool movie_record_finish(movie_recorder_t *);
+
+bool movie_open(movie_t *, const char *);
+bool movie_matches(const movie_t *, const nes_t *);
+void movie_close(movie_t *);
+
+bool movie_index_init(movie_index_t *, const movie_t *, uint32_t, bool);
+void movie_index_cleanup(movie_index_t *);
+bool movie_index_record(movie_index_t *, const nes_t *, uint64_t);
+bool movie_index_save(const movie_index_t *, const char *);
+bool movie_index_load(movie_index_t *, const char *);
+bool movie_seek(nes_t *, const movie_t *, movie_index_t *, uint64_t);
+#endif // MOVIE_INCLUDE
@@ -1,12 +1,30 @@
-#include <SDL3/SDL.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "nes.h"
+#include "state.h"
 #include "utils.h"
 
 #define INES_HEADER_SIZE 0x10
 
-bool nes_init(nes_t *nes, nes_render_context_t *render_ctx)
+// 0 is never handed out, so a zeroed nes_clone_info_t matches no instance
+static atomic_uint_fast64_t nes_next_instance_id = 1;
+
+static uint64_t nes_new_instance_id(void)
+{
+	return atomic_fetch_add(&nes_next_instance_id, 1);
+}
+
+static void nes_schedule_ppu_events(nes_t *nes)
+{
+	scheduler_add(&nes->scheduler, EVENT_VBLANK_START,
+		scheduler_ppu_clock(&nes->scheduler, nes->ppu.vblank_start_dot));
+	scheduler_add(&nes->scheduler, EVENT_VBLANK_END,
+		scheduler_ppu_clock(&nes->scheduler, nes->ppu.vblank_end_dot));
+}
+
+bool nes_init(nes_t *nes, const nes_callbacks_t *callbacks)
 {
 	if (!memory_init(&nes->memory)) {
 		log_event("Could not allocate memory!");
@@ -18,139 +36,214 @@ bool nes_init(nes_t *nes, nes_render_context_t *render_ctx)
 		return false;
 	}
 
+	if (!cpu_block_cache_init(&nes->cpu_blocks)) {
+		log_event("Could not allocate the CPU block cache!");
+		return false;
+	}
+
+	scheduler_init(&nes->scheduler);
 	apu_init(&nes->apu);
 	ppu_init(&nes->ppu, &nes->vmemory);
-	cpu_init(&nes->cpu, &nes->memory, &nes->ppu, &nes->apu);
+	cpu_init(&nes->cpu, &nes->memory, &nes->ppu, &nes->apu, &nes->scheduler);
 
+	nes_schedule_ppu_events(nes);
+
+	// the frame counter powers on in 4-step mode with the IRQ enabled
+	scheduler_add(&nes->scheduler, EVENT_APU_FRAME_IRQ,
+		scheduler_cpu_clock(&nes->scheduler, APU_FRAME_IRQ_CYCLES));
 
 	nes->rom_data = NULL;
-	nes->video_data = NULL;
+	nes->rom_hash = 0;
 
-	nes->render_ctx.renderer = render_ctx->renderer;
-	nes->render_ctx.video_texture = render_ctx->video_texture;
+	static const size_t frame_size = INTERNAL_VIDEO_WIDTH * INTERNAL_VIDEO_HEIGHT;
+
+	nes->ppu.video_data = calloc(frame_size, sizeof(uint32_t));
+	nes->frame_data = calloc(frame_size, sizeof(uint32_t));
+	if (!nes->ppu.video_data || !nes->frame_data) {
+		log_event("Could not allocate frame buffers!");
+		return false;
+	}
+
+	if (callbacks) {
+		nes->callbacks = *callbacks;
+	} else {
+		nes->callbacks = (nes_callbacks_t){0};
+	}
 
 	nes->key_state = 0;
+	nes->skip_render = false;
+	nes->cpu_core = NES_CPU_INTERPRETER;
+	nes->cpu_jit = (cpu_jit_t){0};
+	nes->cpu_aot = (cpu_aot_t){0};
+	nes->idle = (nes_idle_t){0};
+	nes->idle.cycle = NES_IDLE_NO_CYCLE;
 
-	nes->frame_start = 0;
 	nes->frames = 0;
-
-	nes->master_clock_cycles = 0;
+	nes->instance_id = nes_new_instance_id();
+	nes->clone_info = (nes_clone_info_t){0};
 	
 	return true;
 }
 
-bool nes_load_rom(nes_t *nes, const char *path) 
+nes_t *nes_create(const nes_callbacks_t *callbacks)
 {
-	bool code = true;
+	nes_t *nes = calloc(1, sizeof(nes_t));
+	if (!nes) {
+		return NULL;
+	}
 
-	FILE *rom_handle = fopen(path, "rb");
-	if (!rom_handle) {
-		code = false;
-		return code;
+	if (!nes_init(nes, callbacks)) {
+		nes_cleanup(nes);
+		free(nes);
+		return NULL;
 	}
 
-	if (!get_rom_info(rom_handle, &nes->rom_header, &nes->rom_info)) {
-		code = false;
-		goto done;
+	return nes;
+}
+
+void nes_destroy(nes_t *nes)
+{
+	if (!nes) {
+		return;
+	}
+
+	nes_cleanup(nes);
+	free(nes);
+}
+
+/*
+Loads an iNES image. The data is copied, so the caller can free it straight
+after
+*/
+bool nes_load_rom_from_memory(nes_t *nes, const uint8_t *data, size_t size)
+{
+	if (!get_rom_info(data, size, &nes->rom_header, &nes->rom_info)) {
+		return false;
 	}
 	uint32_t prg_rom_size = nes->rom_info.prg_size;
+	uint32_t chr_rom_size = nes->rom_info.chr_size;
 
-	bool copy_prg_rom_result;
+	if (size < INES_HEADER_SIZE + prg_rom_size + chr_rom_size) {
+		log_event("ROM image is truncated!");
+		return false;
+	}
+	const uint8_t *prg_rom = data + INES_HEADER_SIZE;
+	const uint8_t *chr_rom = prg_rom + prg_rom_size;
+
+	uint8_t *prg_dest;
 	if (nes->rom_info.mapper_id == 0) {
-		copy_prg_rom_result = read_bytes(nes->memory.data + 0x10000 - prg_rom_size, prg_rom_size, INES_HEADER_SIZE, rom_handle);
+		prg_dest = nes->memory.data + 0x10000 - prg_rom_size;
 	} else if (nes->rom_info.mapper_id == 1) {
-		copy_prg_rom_result = read_bytes(nes->memory.data + 0x8000, prg_rom_size, INES_HEADER_SIZE, rom_handle);
+		prg_dest = nes->memory.data + 0x8000;
 	} else {
-		copy_prg_rom_result = false;
+		prg_dest = NULL;
 	}
 
 	nes->cpu.mmc_type = nes->rom_info.mapper_id;
-		
-	if (!copy_prg_rom_result) {
-		log_event("couldn't copy PRG ROM!\n");
-		code = false;
-		goto done;
-	}
 
-	bool copy_chr_rom_result = read_bytes(
-		nes->vmemory.data, 
-		nes->rom_info.chr_size, 
-		INES_HEADER_SIZE + prg_rom_size, 
-		rom_handle
-	);
+	// without bank switching the PRG ROM has to fit in 0x8000-0xffff
+	if (!prg_dest || prg_rom_size > 0x8000) {
+		log_event("couldn't copy PRG ROM!");
+		return false;
+	}
+	memcpy(prg_dest, prg_rom, prg_rom_size);
 
-	if (!copy_chr_rom_result) {
+	if (chr_rom_size > ADDRESS_SPACE_SIZE_2C02) {
 		log_event("couldn't copy CHR ROM!");
-		code = false;
-		goto done;
+		return false;
 	}
+	memcpy(nes->vmemory.data, chr_rom, chr_rom_size);
+
+	nes->memory.shared_writes++;
+	nes->vmemory.shared_writes++;
+	nes->instance_id = nes_new_instance_id();
+	memory_mark_dirty(nes->memory.dirty, prg_dest - nes->memory.data, prg_rom_size);
+	memory_mark_dirty(nes->vmemory.dirty, 0, chr_rom_size);
 
+	free(nes->rom_data);
 	nes->rom_data = malloc(prg_rom_size);
 	if (!nes->rom_data) {
 		log_event("couldn't allocate rom data");
-		code = false;
-		goto done;
+		return false;
 	}
-	
-	read_bytes(nes->rom_data, prg_rom_size, INES_HEADER_SIZE, rom_handle);	
+	memcpy(nes->rom_data, prg_rom, prg_rom_size);
+	nes->rom_hash = hash_bytes(data, size);
 
 	printf("ROM loaded successfully!\n");
 	printf("PRG ROM size: %i bytes (%i KiB)\n", prg_rom_size, prg_rom_size / 1024);
-	printf("CHR ROM size: %i bytes (%i KiB)\n", nes->rom_info.chr_size, nes->rom_info.chr_size / 1024);
+	printf("CHR ROM size: %i bytes (%i KiB)\n", chr_rom_size, chr_rom_size / 1024);
 	printf("MMC mapper in use: %i\n", nes->rom_info.mapper_id);
 	cpu_reset(&nes->cpu);
 
-done:
-	fclose(rom_handle);
+	return true;
+}
+
+bool nes_load_rom(nes_t *nes, const char *path) 
+{
+	size_t size;
+	uint8_t *data = read_file(path, &size);
+	if (!data) {
+		return false;
+	}
+
+	bool code = nes_load_rom_from_memory(nes, data, size);
+	free(data);
 	return code;
 }
 
 void nes_clear_screen(nes_t *nes)
 {
-	memset(nes->video_data, 0, INTERNAL_VIDEO_WIDTH * INTERNAL_VIDEO_HEIGHT * sizeof(uint32_t));
+	memset(nes->ppu.video_data, 0, INTERNAL_VIDEO_WIDTH * INTERNAL_VIDEO_HEIGHT * sizeof(uint32_t));
 }
 
 
-static void render_frame(nes_render_context_t *render_ctx, uint32_t **video_data) 
+/*
+Hands a finished frame to the frontend. The buffers are swapped rather than
+copied, so the PPU carries on drawing into the one the frontend had before
+*/
+static void nes_present_frame(nes_t *nes)
 {
-	static const SDL_FRect video_display_rect = {
-		0,
-		0, 
-		INTERNAL_VIDEO_WIDTH * VIDEO_SCALE, 
-		INTERNAL_VIDEO_HEIGHT * VIDEO_SCALE
-	};
+	uint32_t *finished = nes->ppu.video_data;
+	nes->ppu.video_data = nes->frame_data;
+	nes->frame_data = finished;
 
-	SDL_UnlockTexture(render_ctx->video_texture);
-
-	SDL_RenderTexture(render_ctx->renderer, render_ctx->video_texture, NULL, &video_display_rect);
-	SDL_RenderPresent(render_ctx->renderer);
-
-	int texture_pitch;
-	SDL_LockTexture(render_ctx->video_texture, NULL, (void **)video_data, &texture_pitch);
+	if (nes->callbacks.frame) {
+		nes->callbacks.frame(nes->callbacks.userdata, nes->frame_data);
+	}
 }
 
-static void nes_do_ppu_cycle(nes_t *nes, nes_render_context_t *render_ctx)
+/*
+Presents the frame drawn during the last nes_do_frame_cycle right away rather
+than when the next one starts, for callers that jump around in time (run-ahead,
+rewind). Does nothing if that frame was skipped.
+*/
+void nes_flush_frame(nes_t *nes)
 {
-	bool should_update_frame = false;
-	ppu_update_registers(&nes->ppu, &should_update_frame, nes->video_data);
-
-	if (should_update_frame) {
-		render_frame(render_ctx, &nes->video_data);
-		nes_clear_screen(nes);
+	if (nes->ppu.skip_render) {
+		return;
 	}
 
-	nes->ppu.dot_clock_scanline++;
+	nes_present_frame(nes);
+	nes_clear_screen(nes);
+
+	// so it isn't presented a second time
+	nes->ppu.skip_render = true;
 }
 
-static void nes_do_cpu_cycle(nes_t *nes)
+/*
+Catches the PPU up to target_dot of the current frame, presenting every frame
+it completes on the way. A frame finishes early in the next call, so the
+skip_render request for that call is latched as the next one starts
+*/
+static void nes_do_ppu_cycles(nes_t *nes, uint32_t target_dot)
 {
-	cpu_update_registers(&nes->cpu, nes->key_state);
-
-	if (nes->cpu.wait_cycles == 0) {
-		cpu_run_cycle(&nes->cpu);
+	while (ppu_run(&nes->ppu, target_dot)) {
+		if (!nes->ppu.skip_render) {
+			nes_present_frame(nes);
+			nes_clear_screen(nes);
+		}
+		nes->ppu.skip_render = nes->skip_render;
 	}
-
-	nes->cpu.wait_cycles--;
 }
 
 static void nes_do_apu_cycle(nes_t *nes)
@@ -164,68 +257,313 @@ static void nes_do_apu_cycle(nes_t *nes)
 	if (nes->apu.status & 2) {
 		apu_pulse_play(&nes->apu, &nes->apu.pulse2);
 	}
+
+	apu_output_sample(&nes->apu);
 }
 
-void nes_do_master_cycle(nes_t *nes, uint32_t master_clock_frame)
+static void nes_do_apu_cycles(nes_t *nes, uint32_t *apu_cycle, uint32_t target_cycle)
 {
-	if ((master_clock_frame % MASTER_CLOCKS_PER_PPU_CLOCK) == 0) {
-		nes_do_ppu_cycle(nes, &nes->render_ctx);
+	while (*apu_cycle < target_cycle) {
+		nes_do_apu_cycle(nes);
+		(*apu_cycle)++;
 	}
+}
 
-	if ((master_clock_frame % MASTER_CLOCKS_PER_CPU_CLOCK) == 0) {
-		nes_do_cpu_cycle(nes);
+static void nes_handle_event(nes_t *nes, nes_event_t *event, uint32_t cpu_cycle)
+{
+	switch (event->type) {
+		case EVENT_VBLANK_START:
+		case EVENT_VBLANK_END: {
+			nes_do_ppu_cycles(nes, cpu_cycle * PPU_DOTS_PER_CPU_CYCLE + 1);
+			nes_schedule_ppu_events(nes);
+			nes->cpu.nmi_input = ppu_nmi_asserted(&nes->ppu);
+			break;
+		}
+		case EVENT_OAM_DMA_END: {
+			nes->cpu.halted = false;
+			break;
+		}
+		case EVENT_APU_FRAME_IRQ: {
+			nes->apu.frame_irq = true;
+			nes->cpu.irq_input = true;
+			scheduler_add(&nes->scheduler, EVENT_APU_FRAME_IRQ,
+				scheduler_add_cpu_cycles(event->clock, APU_FRAME_SEQUENCE_CYCLES));
+			break;
+		}
+		default:
+			break;
 	}
+}
 
-	if ((master_clock_frame % MASTER_CLOCKS_PER_APU_CLOCK) == 0) {
-		nes_do_apu_cycle(nes);
+/*
+Skips the CPU straight to its next instruction, or the end of the frame. A
+halted CPU keeps its wait cycles until it is resumed by an event.
+*/
+static uint32_t nes_skip_cpu_wait(nes_t *nes, uint32_t cpu_cycle)
+{
+	if (nes->cpu.halted) {
+		return cpu_cycle;
 	}
+
+	uint32_t elapsed = nes->cpu.wait_cycles;
+	if (elapsed > CPU_CYCLES_PER_FRAME - cpu_cycle) {
+		elapsed = CPU_CYCLES_PER_FRAME - cpu_cycle;
+	}
+
+	nes->cpu.wait_cycles -= elapsed;
+	return cpu_cycle + elapsed;
 }
 
+/*
+Runs the threaded CPU core (or the JIT / AOT blocks) up to the next scheduled event. Nothing it runs
+touches the APU, so the APU is only caught up afterwards. Cycles past the
+end of the frame carry over like nes_skip_cpu_wait leaves them.
+*/
+static uint32_t nes_run_cpu_threaded(nes_t *nes, uint32_t cpu_cycle)
+{
+	nes_scheduler_t *sched = &nes->scheduler;
+	uint32_t end_cycle = scheduler_cpu_cycle_at(sched, sched->next_clock);
+	if (end_cycle > CPU_CYCLES_PER_FRAME) {
+		end_cycle = CPU_CYCLES_PER_FRAME;
+	}
+
+	if (nes->cpu_core == NES_CPU_JIT) {
+		cpu_cycle = cpu_run_jit(&nes->cpu, &nes->cpu_jit, &nes->cpu_blocks, cpu_cycle, end_cycle);
+	} else if (nes->cpu_core == NES_CPU_AOT) {
+		cpu_cycle = cpu_run_aot(&nes->cpu, &nes->cpu_aot, &nes->cpu_blocks, cpu_cycle, end_cycle);
+	} else {
+		cpu_cycle = cpu_run_threaded(&nes->cpu, &nes->cpu_blocks, cpu_cycle, end_cycle);
+	}
+	if (cpu_cycle > CPU_CYCLES_PER_FRAME) {
+		nes->cpu.wait_cycles = cpu_cycle - CPU_CYCLES_PER_FRAME;
+		cpu_cycle = CPU_CYCLES_PER_FRAME;
+	}
+
+	return cpu_cycle;
+}
+
+/*
+Skips an idle loop the CPU is at the start of (see cpu.h) ahead to the last
+time round that starts before the next scheduled event, or the end of the
+frame. The loop has to have come round once already, in the cycles it takes
+going straight through and with the registers the same, with nothing due
+in between. Returns the cycle the CPU got to, cpu_cycle if nothing was skipped.
+*/
+static uint32_t nes_skip_idle_loop(nes_t *nes, uint32_t cpu_cycle)
+{
+	nes_idle_t *idle = &nes->idle;
+	nes_cpu_t *cpu = &nes->cpu;
+	uint16_t pc = cpu->pc;
+
+	// the interpreter only comes round with a jump back, the other cores
+	// stop at the start of the loop
+	bool jumped_back = pc <= idle->last_pc || nes->cpu_core != NES_CPU_INTERPRETER;
+	idle->last_pc = pc;
+	if (!jumped_back || cpu->wait_cycles) {
+		return cpu_cycle;
+	}
+
+	if (idle->loop.pc != pc || idle->memory_writes != cpu->mem->shared_writes) {
+		idle->found = cpu_find_idle_loop(cpu->mem->data, pc, &idle->loop);
+		idle->memory_writes = cpu->mem->shared_writes;
+		idle->cycle = NES_IDLE_NO_CYCLE;
+	}
+
+	if (!idle->found) {
+		return cpu_cycle;
+	}
+
+	uint8_t sr = cpu_get_sr(cpu);
+	bool same = idle->cycle != NES_IDLE_NO_CYCLE && cpu_cycle - idle->cycle == idle->loop.cycles &&
+		cpu->a == idle->a && cpu->x == idle->x && cpu->y == idle->y && cpu->sp == idle->sp && sr == idle->sr;
+
+	// an interrupt would have been taken on the way round
+	if (cpu->nmi_input || (cpu->irq_input && !cpu_get_flag(cpu, FLAG_I))) {
+		idle->cycle = NES_IDLE_NO_CYCLE;
+		return cpu_cycle;
+	}
+
+	idle->cycle = cpu_cycle;
+	idle->a = cpu->a;
+	idle->x = cpu->x;
+	idle->y = cpu->y;
+	idle->sp = cpu->sp;
+	idle->sr = sr;
+
+	if (!same || (idle->loop.reads_ppustatus && !ppu_status_is_steady(&nes->ppu))) {
+		return cpu_cycle;
+	}
+
+	nes_scheduler_t *sched = &nes->scheduler;
+	uint32_t end_cycle = scheduler_cpu_cycle_at(sched, sched->next_clock);
+	if (end_cycle > CPU_CYCLES_PER_FRAME) {
+		end_cycle = CPU_CYCLES_PER_FRAME;
+	}
+	if (end_cycle <= cpu_cycle) {
+		return cpu_cycle;
+	}
+
+	uint32_t skipped = (end_cycle - cpu_cycle) / idle->loop.cycles * idle->loop.cycles;
+	cpu->total_cycles += skipped;
+	idle->cycle += skipped;
+
+	return cpu_cycle + skipped;
+}
+
+/*
+Runs one frame worth of master clocks. Instead of ticking every master clock,
+the CPU is stepped a whole instruction at a time and the APU is then brought up
+to the same point in batches. Within a master clock tick the PPU runs before
+the CPU, so an instruction sees the PPU as of the dot that shares the CPU cycle
+it starts on. The PPU itself is caught up lazily: by mem_read_8 / mem_write_8
+when PPU registers are touched, and otherwise only when a scheduled event (a
+vblank edge) needs it.
+
+Anything that has to happen at a fixed time (vblank start / end, the end of an
+OAM DMA, the APU frame IRQ) sits in the scheduler. Events due on or before the
+cycle an instruction starts on are handled before it runs, so instructions and
+waits never need to check the clock themselves.
+*/
 void nes_do_frame_cycle(nes_t *nes)
 {
-	nes->frame_start = SDL_GetTicks();
+	nes_scheduler_t *sched = &nes->scheduler;
+	uint32_t cpu_cycle = nes_skip_cpu_wait(nes, 0);
+	uint32_t apu_cycle = 0;
+	nes->idle.cycle = NES_IDLE_NO_CYCLE;
+
+	while (cpu_cycle < CPU_CYCLES_PER_FRAME) {
+		uint64_t clock = sched->frame_clock + (uint64_t)cpu_cycle * MASTER_CLOCKS_PER_CPU_CLOCK;
+
+		nes_event_t event;
+		if (scheduler_pop_due(sched, clock, &event)) {
+			nes_handle_event(nes, &event, cpu_cycle);
+			cpu_cycle = nes_skip_cpu_wait(nes, cpu_cycle);
+			nes->idle.cycle = NES_IDLE_NO_CYCLE;
+		} else if (nes->cpu.halted) {
+			cpu_cycle = scheduler_cpu_cycle_at(sched, sched->next_clock);
+		} else {
+			nes->cpu.frame_cycle = cpu_cycle;
+			cpu_update_registers(&nes->cpu, nes->key_state);
+
+			uint32_t start_cycle = cpu_cycle;
+			if (nes->cpu_core != NES_CPU_INTERPRETER) {
+				cpu_cycle = nes_run_cpu_threaded(nes, cpu_cycle);
+			}
+
+			// the threaded core and the JIT stop short of anything they can't run,
+			// idle loops included. Whatever is due after a skip goes first
+			if (cpu_cycle == start_cycle) {
+				cpu_cycle = nes_skip_idle_loop(nes, cpu_cycle);
+			}
+			if (cpu_cycle == start_cycle) {
+				cpu_run_cycle(&nes->cpu);
+				cpu_cycle = nes_skip_cpu_wait(nes, cpu_cycle);
+			}
+		}
+
+		nes_do_apu_cycles(nes, &apu_cycle,
+			(cpu_cycle + CPU_CYCLES_PER_APU_CYCLE - 1) / CPU_CYCLES_PER_APU_CYCLE);
+	}
 
-	for (uint32_t master_clock_frame = 0; 
-		master_clock_frame < MASTER_CLOCK_CYCLES_PER_FRAME; 
-		master_clock_frame++) {
-		nes_do_master_cycle(nes, master_clock_frame);
-		nes->master_clock_cycles++;
+	nes_do_ppu_cycles(nes, PPU_DOTS_PER_FRAME);
+	ppu_start_frame(&nes->ppu);
+	nes_do_apu_cycles(nes, &apu_cycle, APU_CYCLES_PER_FRAME);
+
+	if (nes->callbacks.audio) {
+		nes->callbacks.audio(nes->callbacks.userdata, nes->apu.samples, nes->apu.num_samples);
 	}
+	nes->apu.num_samples = 0;
 
+	scheduler_start_frame(sched);
 	nes->frames++;
 }
 
-void nes_cleanup(nes_t *nes)
+/*
+Run-ahead: after a real frame, emulates frames more with the current input,
+presents the last one and rewinds to the real frame again, which hides that
+many frames of the game's own input lag. state is the scratch buffer the real
+frame is kept in. The real frames are never shown, so skip_render is left
+set for the next one; the ahead frames don't produce audio.
+*/
+void nes_run_ahead(nes_t *nes, nes_state_t *state, uint32_t frames)
 {
-	free(nes->rom_data);
+	if (frames == 0) {
+		return;
+	}
 
-	cpu_cleanup(&nes->cpu);
-	ppu_cleanup(&nes->ppu);
-	vmemory_cleanup(&nes->vmemory);
-	memory_cleanup(&nes->memory);
+	state_save(state, nes);
+
+	nes_audio_callback_t audio = nes->callbacks.audio;
+	nes->callbacks.audio = NULL;
+
+	for (uint32_t i = 0; i < frames; i++) {
+		nes->skip_render = i + 1 < frames;
+		nes_do_frame_cycle(nes);
+	}
+
+	nes_flush_frame(nes);
+
+	nes->callbacks.audio = audio;
+
+	state_load(state, nes);
+	nes->skip_render = true;
 }
 
-static void nes_delay(nes_t *nes, uint32_t time)
+// Looks up a CPU core by the name frontends take on the command line
+bool nes_cpu_core_from_name(const char *name, nes_cpu_core_t *core)
 {
-	#ifndef UNLIMITED_SPEED
-	SDL_Delay(time);
-	#endif
+	if (strcmp(name, "interpreter") == 0) {
+		*core = NES_CPU_INTERPRETER;
+	} else if (strcmp(name, "threaded") == 0) {
+		*core = NES_CPU_THREADED;
+	} else if (strcmp(name, "jit") == 0) {
+		*core = NES_CPU_JIT;
+	} else if (strcmp(name, "aot") == 0) {
+		*core = NES_CPU_AOT;
+	} else {
+		return false;
+	}
+
+	return true;
 }
 
 /*
-TODO: Might want to improve delay logic
+Switches CPU cores, which fails if the JIT can't be set up on this host or
+there is no recompiled ROM built in
 */
-void nes_delay_if_necessary(nes_t *nes)
+bool nes_set_cpu_core(nes_t *nes, nes_cpu_core_t core)
 {
-	static const double TARGET_DELAY_TIME_MS = 
-		MILLISECONDS_PER_SECOND / (NES_FRAMES_PER_SECOND * SPEED_MODIFIER);
-	
-	double frametime = (double)(SDL_GetTicks() - nes->frame_start);
+	if (core == NES_CPU_JIT && !nes->cpu_jit.code) {
+		if (!cpu_jit_init(&nes->cpu_jit)) {
+			log_event("Could not set up the JIT, it needs an x86-64 Linux or macOS host!");
+			return false;
+		}
+	}
 
-	if (TARGET_DELAY_TIME_MS > frametime) {
-		uint32_t time_delta = TARGET_DELAY_TIME_MS - frametime;
-		nes_delay(nes, time_delta);
+	if (core == NES_CPU_AOT && !nes->cpu_aot.program) {
+		if (!cpu_aot_init(&nes->cpu_aot)) {
+			log_event("No recompiled ROM is built in, see AOT_SRC in the Makefile!");
+			return false;
+		}
 	}
+
+	nes->cpu_core = core;
+	return true;
+}
+
+void nes_cleanup(nes_t *nes)
+{
+	free(nes->rom_data);
+
+	free(nes->ppu.video_data);
+	free(nes->frame_data);
+
+	cpu_cleanup(&nes->cpu);
+	cpu_block_cache_cleanup(&nes->cpu_blocks);
+	cpu_jit_cleanup(&nes->cpu_jit);
+	ppu_cleanup(&nes->ppu);
+	vmemory_cleanup(&nes->vmemory);
+	memory_cleanup(&nes->memory);
 }
 
 void nes_dump_memory(nes_t *nes, const char *fname)
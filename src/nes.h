@@ -2,15 +2,12 @@
 #define NES_INCLUDE
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "cpu.h"
 #include "memory.h"
 #include "ppu.h"
 #include "apu.h"
-
-struct SDL_Renderer;
-struct SDL_Texture;
-
-#define SPEED_MODIFIER 1.0
+#include "scheduler.h"
 
 #define MILLISECONDS_PER_SECOND 1000.0
 #define NES_FRAMES_PER_SECOND 60.0988138974
@@ -18,13 +15,83 @@ struct SDL_Texture;
 #define MASTER_CLOCK_PER_SEC 21477272
 #define MASTER_CLOCK_CYCLES_PER_FRAME 357366
 
-struct nes_render_context {
-	struct SDL_Renderer *renderer;
-	struct SDL_Texture *video_texture;
-};
-
-typedef struct nes_render_context nes_render_context_t;
-
+// Every component restarts its phase at the start of a frame, so a frame has
+// a partial last CPU / APU cycle and is rounded up here
+#define CPU_CYCLES_PER_FRAME \
+	((MASTER_CLOCK_CYCLES_PER_FRAME + MASTER_CLOCKS_PER_CPU_CLOCK - 1) / MASTER_CLOCKS_PER_CPU_CLOCK)
+#define PPU_DOTS_PER_FRAME \
+	((MASTER_CLOCK_CYCLES_PER_FRAME + MASTER_CLOCKS_PER_PPU_CLOCK - 1) / MASTER_CLOCKS_PER_PPU_CLOCK)
+
+#define APU_CYCLES_PER_FRAME \
+	((MASTER_CLOCK_CYCLES_PER_FRAME + MASTER_CLOCKS_PER_APU_CLOCK - 1) / MASTER_CLOCKS_PER_APU_CLOCK)
+
+#define CPU_CYCLES_PER_APU_CYCLE (MASTER_CLOCKS_PER_APU_CLOCK / MASTER_CLOCKS_PER_CPU_CLOCK)
+
+/*
+The core doesn't know about any frontend. Finished frames (XRGB8888,
+INTERNAL_VIDEO_WIDTH * INTERNAL_VIDEO_HEIGHT) and audio samples (mono float at
+APU_SAMPLE_RATE, delivered once per frame) are handed out through these
+callbacks, either of which may be NULL. The data is only valid for the
+duration of the call.
+*/
+typedef void (*nes_frame_callback_t)(void *userdata, const uint32_t *frame_data);
+typedef void (*nes_audio_callback_t)(void *userdata, const float *samples, size_t num_samples);
+
+typedef struct {
+	nes_frame_callback_t frame;
+	nes_audio_callback_t audio;
+	void *userdata;
+} nes_callbacks_t;
+
+
+/*
+The instance_id of what a nes_t last got all of its memory from through
+nes_clone, and the shared_writes counts of both sides at that point. While
+none of them move, everything outside the ranges nes_clone always copies is
+still identical.
+*/
+typedef struct {
+	uint64_t source_id;
+	uint32_t source_memory_writes;
+	uint32_t source_vmemory_writes;
+	uint32_t memory_writes;
+	uint32_t vmemory_writes;
+} nes_clone_info_t;
+
+/*
+The idle loop the frame loop last looked for (see cpu.h), and the CPU as it
+was the last time round. cycle is NES_IDLE_NO_CYCLE while there's no last
+time round to go by, after an event or at the start of a frame.
+*/
+#define NES_IDLE_NO_CYCLE UINT32_MAX
+
+typedef struct {
+	cpu_idle_loop_t loop;
+	bool found;
+	// memory.shared_writes the loop was looked for with
+	uint32_t memory_writes;
+
+	uint32_t cycle;
+	uint8_t a, x, y, sp, sr;
+
+	// PC of the last instruction the reference handlers ran
+	uint16_t last_pc;
+} nes_idle_t;
+
+/*
+Which CPU core runs instructions: the reference interpreter (one handler from
+instructions.c per instruction), the threaded core in cpu_threaded.c, which
+runs plain code between I/O accesses and events in one go and hands
+everything else to the interpreter, the threaded core with PRG ROM code
+compiled to native code by cpu_jit.c, or with the blocks the recompiler wrote
+for the ROM built in (cpu_aot.c). All of them give the same results.
+*/
+typedef enum {
+	NES_CPU_INTERPRETER,
+	NES_CPU_THREADED,
+	NES_CPU_JIT,
+	NES_CPU_AOT
+} nes_cpu_core_t;
 
 struct nes {
 	nes_cpu_t cpu;
@@ -33,33 +100,67 @@ struct nes {
 	nes_vmemory_t vmemory;
 
 	nes_apu_t apu;
+
+	nes_scheduler_t scheduler;
 	
 	ines_rom_header_t rom_header;
 	nes_rom_info_t rom_info;
 
 	uint8_t *rom_data;
-	uint32_t *video_data;
 
-	nes_render_context_t render_ctx;
+	// Hash of the whole iNES image last loaded
+	uint64_t rom_hash;
+
+	nes_callbacks_t callbacks;
+
+	// The PPU draws into ppu.video_data, every finished frame is swapped
+	// into frame_data
+	uint32_t *frame_data;
 
 	uint8_t key_state;
 
-	uint32_t frame_start;
+	// Set before nes_do_frame_cycle to skip rendering the frame drawn during
+	// it. Games still see sprite 0 hit and the status bits as usual, the
+	// frame just isn't rasterized or handed to the frame callback
+	bool skip_render;
+
 	uint64_t frames;
 
-	uint64_t master_clock_cycles;
+	// Unique to this nes_t and the ROM loaded into it, a new one is handed
+	// out by nes_init and every ROM load
+	uint64_t instance_id;
+	nes_clone_info_t clone_info;
+
+	// Set with nes_set_cpu_core after nes_init, and not touched by state
+	// loads or clones
+	nes_cpu_core_t cpu_core;
+	cpu_block_cache_t cpu_blocks;
+	// Only set up once they're picked
+	cpu_jit_t cpu_jit;
+	cpu_aot_t cpu_aot;
+
+	nes_idle_t idle;
 };
 
 typedef struct nes nes_t;
 
-bool nes_init(nes_t *, nes_render_context_t *);
+// See state.h
+typedef struct nes_state nes_state_t;
+
+bool nes_init(nes_t *, const nes_callbacks_t *);
 void nes_cleanup(nes_t *);
 
-void nes_do_master_cycle(nes_t *, uint32_t);
+nes_t *nes_create(const nes_callbacks_t *);
+void nes_destroy(nes_t *);
+
 bool nes_load_rom(nes_t *, const char *);
-void nes_delay_if_necessary(nes_t *);
+bool nes_load_rom_from_memory(nes_t *, const uint8_t *, size_t);
 void nes_do_frame_cycle(nes_t *);
+void nes_flush_frame(nes_t *);
+void nes_run_ahead(nes_t *, nes_state_t *, uint32_t);
 void nes_clear_screen(nes_t *);
+bool nes_cpu_core_from_name(const char *, nes_cpu_core_t *);
+bool nes_set_cpu_core(nes_t *, nes_cpu_core_t);
 
 // utilities
 void nes_dump_memory(nes_t *, const char *);
@@ -0,0 +1,155 @@
+#include "pacer.h"
+#include "utils_platform.h"
+#include <math.h>
+#include <string.h>
+
+void pacer_init(frame_pacer_t *pacer, double frames_per_second)
+{
+	memset(pacer, 0, sizeof(frame_pacer_t));
+	pacer->base_frame_ns = 1e9 / frames_per_second;
+	pacer->frame_ns = pacer->base_frame_ns;
+
+	pacer_reset(pacer);
+}
+
+/*
+Restarts the schedule from now, for when frames stop being paced for a while
+(e.g. fast forward). Statistics are kept.
+*/
+void pacer_reset(frame_pacer_t *pacer)
+{
+	uint64_t now = get_monotonic_ns();
+
+	pacer->schedule_start = now;
+	pacer->scheduled_frames = 0;
+	pacer->last_wake = now;
+}
+
+// Runs frames speed times faster (or slower) than the rate given to pacer_init
+void pacer_set_speed(frame_pacer_t *pacer, double speed)
+{
+	pacer->frame_ns = pacer->base_frame_ns / speed;
+	pacer_reset(pacer);
+}
+
+static void pacer_record_frame(frame_pacer_t *pacer, uint64_t now)
+{
+	uint64_t frame_time = now - pacer->last_wake;
+	pacer->last_wake = now;
+
+	uint64_t bucket = frame_time / PACER_HISTOGRAM_BUCKET_NS;
+	if (bucket >= PACER_HISTOGRAM_BUCKETS) {
+		bucket = PACER_HISTOGRAM_BUCKETS - 1;
+	}
+	pacer->histogram[bucket]++;
+
+	pacer->num_frames++;
+	pacer->frame_time_sum += frame_time;
+	pacer->frame_time_sum_sq += (double)frame_time * frame_time;
+}
+
+/*
+Blocks until the next frame is due. Most of the wait is an OS sleep, only the
+last PACER_SPIN_NS are spun so the deadline is hit without burning a core.
+*/
+void pacer_wait(frame_pacer_t *pacer)
+{
+	pacer->scheduled_frames++;
+	uint64_t deadline = pacer->schedule_start + (uint64_t)(pacer->scheduled_frames * pacer->frame_ns);
+
+	uint64_t now = get_monotonic_ns();
+	if (now > deadline + (uint64_t)(PACER_MAX_LATE_FRAMES * pacer->frame_ns)) {
+		pacer->drift_ns += now - deadline;
+		pacer->resyncs++;
+
+		pacer->schedule_start = now;
+		pacer->scheduled_frames = 0;
+		deadline = now;
+	} else {
+		if (deadline > now + PACER_SPIN_NS) {
+			sleep_until_monotonic_ns(deadline - PACER_SPIN_NS);
+		}
+
+		do {
+			now = get_monotonic_ns();
+		} while (now < deadline);
+	}
+
+	pacer->lateness_ns = now - deadline;
+	if (pacer->lateness_ns > pacer->max_lateness_ns) {
+		pacer->max_lateness_ns = pacer->lateness_ns;
+	}
+
+	pacer_record_frame(pacer, now);
+}
+
+/*
+Decides whether the coming frame is worth rendering. It isn't when the last
+paced wake was already more than a quarter frame late (the host can't keep
+up), or when frames come faster than they can be shown (fast forward), going
+by the unscaled frame rate. paced says whether pacer_wait runs between frames.
+*/
+bool pacer_should_render(frame_pacer_t *pacer, bool paced)
+{
+	uint64_t now = get_monotonic_ns();
+	bool render;
+
+	if (pacer->skipped_in_row >= PACER_MAX_FRAMESKIP) {
+		render = true;
+	} else if (paced && pacer->lateness_ns > pacer->frame_ns / 4) {
+		render = false;
+	} else if (now - pacer->last_render < pacer->base_frame_ns * 3 / 4) {
+		render = false;
+	} else {
+		render = true;
+	}
+
+	if (render) {
+		pacer->last_render = now;
+		pacer->skipped_in_row = 0;
+		pacer->frames_rendered++;
+	} else {
+		pacer->skipped_in_row++;
+		pacer->frames_skipped++;
+	}
+
+	return render;
+}
+
+// Upper edge of the histogram bucket the given fraction of frames fall into
+static double pacer_percentile_ms(frame_pacer_t *pacer, double fraction)
+{
+	uint64_t target = (uint64_t)ceil(pacer->num_frames * fraction);
+	uint64_t count = 0;
+
+	for (int i = 0; i < PACER_HISTOGRAM_BUCKETS; i++) {
+		count += pacer->histogram[i];
+		if (count >= target) {
+			return (double)(i + 1) * PACER_HISTOGRAM_BUCKET_NS / 1e6;
+		}
+	}
+
+	return (double)PACER_HISTOGRAM_BUCKETS * PACER_HISTOGRAM_BUCKET_NS / 1e6;
+}
+
+void pacer_report(frame_pacer_t *pacer, FILE *out)
+{
+	if (pacer->num_frames == 0) {
+		return;
+	}
+
+	double mean = pacer->frame_time_sum / pacer->num_frames;
+	double variance = pacer->frame_time_sum_sq / pacer->num_frames - mean * mean;
+	double jitter = variance > 0 ? sqrt(variance) : 0;
+
+	fprintf(out, "Frame pacing: %llu frames, target %.3f ms, mean %.3f ms\n",
+		(unsigned long long)pacer->num_frames, pacer->frame_ns / 1e6, mean / 1e6);
+	fprintf(out, "  p50 %.2f ms, p99 %.2f ms, jitter (stddev) %.3f ms\n",
+		pacer_percentile_ms(pacer, 0.50), pacer_percentile_ms(pacer, 0.99), jitter / 1e6);
+	fprintf(out, "  worst lateness %.3f ms, drift %.3f ms over %u resyncs\n",
+		pacer->max_lateness_ns / 1e6, pacer->drift_ns / 1e6, pacer->resyncs);
+	if (pacer->frames_skipped > 0) {
+		fprintf(out, "  rendered %llu frames, skipped %llu\n",
+			(unsigned long long)pacer->frames_rendered, (unsigned long long)pacer->frames_skipped);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef PACER_INCLUDE
+#define PACER_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// The last stretch before a deadline is spun instead of slept, OS sleeps
+// routinely overshoot by tens of microseconds
+#define PACER_SPIN_NS 250000
+
+// Falling further behind than this (a debugger, a stalled frontend) restarts
+// the schedule instead of trying to run fast until it catches up
+#define PACER_MAX_LATE_FRAMES 4
+
+// Never skip rendering more than this many frames in a row, so the picture
+// keeps moving even on a host that can't keep up at all
+#define PACER_MAX_FRAMESKIP 4
+
+// Frame times are bucketed in 10us steps up to 50ms
+#define PACER_HISTOGRAM_BUCKET_NS 10000
+#define PACER_HISTOGRAM_BUCKETS 5000
+
+typedef struct {
+	// frame_ns is base_frame_ns divided by the speed multiplier
+	double base_frame_ns;
+	double frame_ns;
+
+	// Deadline n is schedule_start + n * frame_ns, so neither sleep error nor
+	// rounding of frame_ns ever accumulates into the schedule
+	uint64_t schedule_start;
+	uint64_t scheduled_frames;
+	uint64_t last_wake;
+
+	// Lateness of the most recent wake and the worst so far, in ns. drift_ns
+	// is how far the schedule itself has been pushed back by resyncs
+	int64_t lateness_ns;
+	int64_t max_lateness_ns;
+	int64_t drift_ns;
+	uint32_t resyncs;
+
+	// Frameskip, see pacer_should_render
+	uint64_t last_render;
+	uint32_t skipped_in_row;
+	uint64_t frames_rendered;
+	uint64_t frames_skipped;
+
+	// Time between consecutive wakes
+	uint32_t histogram[PACER_HISTOGRAM_BUCKETS];
+	uint64_t num_frames;
+	double frame_time_sum;
+	double frame_time_sum_sq;
+} frame_pacer_t;
+
+void pacer_init(frame_pacer_t *, double);
+void pacer_reset(frame_pacer_t *);
+void pacer_set_speed(frame_pacer_t *, double);
+void pacer_wait(frame_pacer_t *);
+bool pacer_should_render(frame_pacer_t *, bool);
+void pacer_report(frame_pacer_t *, FILE *);
+#endif // PACER_INCLUDE
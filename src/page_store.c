@@ -0,0 +1,271 @@
+#include "page_store.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_STORE_INITIAL_PAGES 1024
+
+// Rehashes once the table is more than 3/4 full (deleted slots included)
+#define PAGE_STORE_MAX_LOAD(size) ((size) / 4 * 3)
+
+/*
+A page hash that goes 8 bytes at a time, FNV-1a style byte hashing is too
+slow for hashing every page of every snapshot
+*/
+static uint64_t page_store_hash(const uint8_t *page)
+{
+	uint64_t hash = 0x9e3779b97f4a7c15ULL;
+	for (size_t i = 0; i < PAGE_STORE_PAGE_SIZE; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, page + i, sizeof(word));
+		hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 32;
+	}
+
+	return hash;
+}
+
+static bool page_store_resize_table(page_store_t *store, uint32_t size)
+{
+	uint32_t *table = malloc(size * sizeof(uint32_t));
+	if (!table) {
+		log_event("Could not allocate page store table!");
+		return false;
+	}
+	memset(table, 0xff, size * sizeof(uint32_t));
+
+	// only live pages are carried over, which drops the deleted slots
+	for (uint32_t i = 0; i < store->table_size; i++) {
+		uint32_t id = store->table[i];
+		if (id == PAGE_STORE_EMPTY || id == PAGE_STORE_DELETED) {
+			continue;
+		}
+
+		uint32_t slot = store->hashes[id] & (size - 1);
+		while (table[slot] != PAGE_STORE_EMPTY) {
+			slot = (slot + 1) & (size - 1);
+		}
+		table[slot] = id;
+	}
+
+	free(store->table);
+	store->table = table;
+	store->table_size = size;
+	store->table_used = store->num_pages - store->num_free;
+	return true;
+}
+
+bool page_store_init(page_store_t *store)
+{
+	memset(store, 0, sizeof(page_store_t));
+
+	store->state = malloc(sizeof(nes_state_t));
+	if (!store->state || !page_store_resize_table(store, PAGE_STORE_INITIAL_PAGES * 2)) {
+		log_event("Could not allocate page store!");
+		page_store_cleanup(store);
+		return false;
+	}
+
+	return true;
+}
+
+void page_store_cleanup(page_store_t *store)
+{
+	free(store->pages);
+	free(store->hashes);
+	free(store->refs);
+	free(store->free_ids);
+	free(store->table);
+	free(store->state);
+
+	memset(store, 0, sizeof(page_store_t));
+}
+
+static bool page_store_grow(page_store_t *store)
+{
+	uint32_t capacity = store->capacity ? store->capacity * 2 : PAGE_STORE_INITIAL_PAGES;
+
+	uint8_t *pages = realloc(store->pages, (size_t)capacity * PAGE_STORE_PAGE_SIZE);
+	if (pages) {
+		store->pages = pages;
+	}
+	uint64_t *hashes = realloc(store->hashes, capacity * sizeof(uint64_t));
+	if (hashes) {
+		store->hashes = hashes;
+	}
+	uint32_t *refs = realloc(store->refs, capacity * sizeof(uint32_t));
+	if (refs) {
+		store->refs = refs;
+	}
+	uint32_t *free_ids = realloc(store->free_ids, capacity * sizeof(uint32_t));
+	if (free_ids) {
+		store->free_ids = free_ids;
+	}
+
+	if (!pages || !hashes || !refs || !free_ids) {
+		log_event("Could not grow page store!");
+		return false;
+	}
+
+	store->capacity = capacity;
+	return true;
+}
+
+/*
+Adds a reference to the page with the given contents, storing it if it's
+new. Returns its id, or PAGE_STORE_EMPTY if there was no memory for it
+*/
+uint32_t page_store_put(page_store_t *store, const uint8_t *page)
+{
+	// sized so live pages fill at most half of the allowed load
+	if (store->table_used >= PAGE_STORE_MAX_LOAD(store->table_size)) {
+		uint32_t live = store->num_pages - store->num_free;
+		uint32_t size = store->table_size;
+		while (PAGE_STORE_MAX_LOAD(size) / 2 <= live) {
+			size *= 2;
+		}
+
+		if (!page_store_resize_table(store, size)) {
+			return PAGE_STORE_EMPTY;
+		}
+	}
+
+	uint64_t hash = page_store_hash(page);
+	uint32_t mask = store->table_size - 1;
+	uint32_t slot = hash & mask;
+	uint32_t free_slot = PAGE_STORE_EMPTY;
+
+	store->pages_put++;
+
+	for (; store->table[slot] != PAGE_STORE_EMPTY; slot = (slot + 1) & mask) {
+		uint32_t id = store->table[slot];
+		if (id == PAGE_STORE_DELETED) {
+			if (free_slot == PAGE_STORE_EMPTY) {
+				free_slot = slot;
+			}
+			continue;
+		}
+
+		if (store->hashes[id] == hash &&
+			memcmp(store->pages + (size_t)id * PAGE_STORE_PAGE_SIZE, page, PAGE_STORE_PAGE_SIZE) == 0) {
+			store->refs[id]++;
+			store->pages_shared++;
+			return id;
+		}
+	}
+
+	uint32_t id;
+	if (store->num_free > 0) {
+		id = store->free_ids[--store->num_free];
+	} else {
+		if (store->num_pages == store->capacity && !page_store_grow(store)) {
+			return PAGE_STORE_EMPTY;
+		}
+		id = store->num_pages++;
+	}
+
+	memcpy(store->pages + (size_t)id * PAGE_STORE_PAGE_SIZE, page, PAGE_STORE_PAGE_SIZE);
+	store->hashes[id] = hash;
+	store->refs[id] = 1;
+
+	if (free_slot != PAGE_STORE_EMPTY) {
+		store->table[free_slot] = id;
+	} else {
+		store->table[slot] = id;
+		store->table_used++;
+	}
+
+	return id;
+}
+
+// Drops a reference, freeing the page once nothing refers to it
+void page_store_release(page_store_t *store, uint32_t id)
+{
+	if (--store->refs[id] > 0) {
+		return;
+	}
+
+	uint32_t mask = store->table_size - 1;
+	uint32_t slot = store->hashes[id] & mask;
+	while (store->table[slot] != id) {
+		slot = (slot + 1) & mask;
+	}
+	store->table[slot] = PAGE_STORE_DELETED;
+
+	store->free_ids[store->num_free++] = id;
+}
+
+const uint8_t *page_store_get(const page_store_t *store, uint32_t id)
+{
+	return store->pages + (size_t)id * PAGE_STORE_PAGE_SIZE;
+}
+
+// Returns false, storing nothing, if the store ran out of memory
+bool page_store_save(page_store_t *store, page_store_state_t *snapshot, const nes_t *nes)
+{
+	state_save(store->state, nes);
+	state_clear_host_pointers(store->state);
+
+	const uint8_t *data = (const uint8_t *)store->state;
+	for (size_t i = 0; i < PAGE_STORE_STATE_PAGES; i++) {
+		size_t offset = i * PAGE_STORE_PAGE_SIZE;
+		size_t size = sizeof(nes_state_t) - offset;
+
+		uint32_t id;
+		if (size >= PAGE_STORE_PAGE_SIZE) {
+			id = page_store_put(store, data + offset);
+		} else {
+			// the last page is zero padded
+			uint8_t page[PAGE_STORE_PAGE_SIZE] = {0};
+			memcpy(page, data + offset, size);
+			id = page_store_put(store, page);
+		}
+
+		if (id == PAGE_STORE_EMPTY) {
+			for (size_t j = 0; j < i; j++) {
+				page_store_release(store, snapshot->pages[j]);
+			}
+			return false;
+		}
+		snapshot->pages[i] = id;
+	}
+
+	return true;
+}
+
+void page_store_load(page_store_t *store, const page_store_state_t *snapshot, nes_t *nes)
+{
+	uint8_t *data = (uint8_t *)store->state;
+	for (size_t i = 0; i < PAGE_STORE_STATE_PAGES; i++) {
+		size_t offset = i * PAGE_STORE_PAGE_SIZE;
+		size_t size = sizeof(nes_state_t) - offset;
+
+		memcpy(data + offset, page_store_get(store, snapshot->pages[i]),
+			size < PAGE_STORE_PAGE_SIZE ? size : PAGE_STORE_PAGE_SIZE);
+	}
+
+	state_load(store->state, nes);
+}
+
+void page_store_drop(page_store_t *store, page_store_state_t *snapshot)
+{
+	for (size_t i = 0; i < PAGE_STORE_STATE_PAGES; i++) {
+		page_store_release(store, snapshot->pages[i]);
+	}
+}
+
+void page_store_report(const page_store_t *store, FILE *out)
+{
+	uint32_t live = store->num_pages - store->num_free;
+	uint64_t refs = 0;
+	for (uint32_t id = 0; id < store->num_pages; id++) {
+		refs += store->refs[id];
+	}
+
+	fprintf(out, "Page store: %u pages (%.1f MiB) hold %llu page references (%.1f MiB), %.1fx dedup\n",
+		live, (double)live * PAGE_STORE_PAGE_SIZE / 1048576.0,
+		(unsigned long long)refs, (double)refs * PAGE_STORE_PAGE_SIZE / 1048576.0,
+		live ? (double)refs / live : 0.0);
+	fprintf(out, "  %llu of %llu pages put were already stored\n",
+		(unsigned long long)store->pages_shared, (unsigned long long)store->pages_put);
+}
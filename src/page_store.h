@@ -0,0 +1,69 @@
+#ifndef PAGE_STORE_INCLUDE
+#define PAGE_STORE_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "nes.h"
+#include "state.h"
+
+/*
+Content addressed store of fixed size pages, for keeping a great many
+snapshots of instances running the same ROM. A snapshot is cut into
+PAGE_STORE_PAGE_SIZE pages, each page is looked up by its hash and only
+stored if no identical page is there yet, so the PRG and CHR copies, and
+whatever RAM the states have in common, are held once however many snapshots
+refer to them. Pages are reference counted and freed (for reuse) once the
+last snapshot using them is dropped. The store isn't thread safe: it's meant
+to be shared by the nes_t instances of one thread.
+*/
+#define PAGE_STORE_PAGE_SIZE 1024
+#define PAGE_STORE_STATE_PAGES ((sizeof(nes_state_t) + PAGE_STORE_PAGE_SIZE - 1) / PAGE_STORE_PAGE_SIZE)
+
+// Marks an unused hash table slot / a slot whose page was freed
+#define PAGE_STORE_EMPTY UINT32_MAX
+#define PAGE_STORE_DELETED (UINT32_MAX - 1)
+
+typedef struct {
+	// Page data, hashes and reference counts, by page id
+	uint8_t *pages;
+	uint64_t *hashes;
+	uint32_t *refs;
+	uint32_t num_pages;
+	uint32_t capacity;
+
+	// Ids of freed pages, to be reused first
+	uint32_t *free_ids;
+	uint32_t num_free;
+
+	// Open addressing (linear probing) table of page ids, by hash
+	uint32_t *table;
+	uint32_t table_size;
+	uint32_t table_used;
+
+	// Scratch for cutting up and putting together snapshots
+	nes_state_t *state;
+
+	// Statistics
+	uint64_t pages_put;
+	uint64_t pages_shared;
+} page_store_t;
+
+// A snapshot in the store, its page ids in order
+typedef struct {
+	uint32_t pages[PAGE_STORE_STATE_PAGES];
+} page_store_state_t;
+
+bool page_store_init(page_store_t *);
+void page_store_cleanup(page_store_t *);
+
+uint32_t page_store_put(page_store_t *, const uint8_t *);
+void page_store_release(page_store_t *, uint32_t);
+const uint8_t *page_store_get(const page_store_t *, uint32_t);
+
+bool page_store_save(page_store_t *, page_store_state_t *, const nes_t *);
+void page_store_load(page_store_t *, const page_store_state_t *, nes_t *);
+void page_store_drop(page_store_t *, page_store_state_t *);
+
+void page_store_report(const page_store_t *, FILE *);
+#endif // PAGE_STORE_INCLUDE
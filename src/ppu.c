@@ -1,6 +1,47 @@
 #include "ppu.h"
 #include <string.h>
 
+/*
+Number of upcoming dots in which ppu_update_registers would do nothing but
+advance the dot counter
+*/
+static int ppu_idle_dots(nes_ppu_t *ppu)
+{
+	int dot = ppu->dot_clock_scanline;
+	int next_dot = DOTS_PER_SCANLINE;
+
+	if (ppu->scanline < 240 && dot <= 340) {
+		next_dot = 340;
+	} else if (ppu->scanline == VBLANK_START_SCANLINE && dot <= 1) {
+		next_dot = 1;
+	} else if (ppu->scanline == SCANLINES_PER_FRAME) {
+		next_dot = dot;
+	}
+
+	return next_dot - dot;
+}
+
+/*
+Works out the frame dots of the next vblank start and end. Scanline 0 starts
+on dot 1 (dot 0 only exists straight after power on), and the end of vblank is
+the first dot of scanline 262, which then becomes scanline 0.
+*/
+static void ppu_find_vblank_edges(nes_ppu_t *ppu)
+{
+	static const int vblank_start_pos = VBLANK_START_SCANLINE * DOTS_PER_SCANLINE;
+	static const int vblank_end_pos = SCANLINES_PER_FRAME * DOTS_PER_SCANLINE;
+
+	int pos = ppu->scanline * DOTS_PER_SCANLINE + ppu->dot_clock_scanline - 1;
+
+	int dots_until_start = vblank_start_pos - pos;
+	if (dots_until_start < 0) {
+		dots_until_start += vblank_end_pos;
+	}
+
+	ppu->vblank_start_dot = ppu->frame_dot + dots_until_start;
+	ppu->vblank_end_dot = ppu->frame_dot + (vblank_end_pos - pos);
+}
+
 void ppu_init(nes_ppu_t *ppu, nes_vmemory_t *vmem) 
 {
 	memset(ppu, 0, sizeof(*ppu));
@@ -15,26 +56,38 @@ void ppu_init(nes_ppu_t *ppu, nes_vmemory_t *vmem)
 	ppu->sprite_tiledata_base_offset = 0;
 	ppu->PPUADDR_increment_amount = 1;
     ppu->ppudata_buf = 0;
+
+	ppu->video_data = NULL;
+	ppu->skip_render = false;
+	memset(ppu->skipped_spill, 0, sizeof(ppu->skipped_spill));
+	ppu->frame_dot = 0;
+	ppu_find_vblank_edges(ppu);
 }
 
 void ppu_update_registers(nes_ppu_t *ppu, bool *should_update_frame, uint32_t *video_data)
 {
 	if (ppu->scanline < 240) {
 		// normal operation
-		if (ppu->dot_clock_scanline == 340)
-			ppu_draw_scanline(ppu, video_data);
-	} else if (ppu->scanline == 241) {
+		if (ppu->dot_clock_scanline == 340) {
+			if (ppu->skip_render) {
+				ppu_skip_scanline(ppu);
+			} else {
+				ppu_draw_scanline(ppu, video_data);
+			}
+		}
+	} else if (ppu->scanline == VBLANK_START_SCANLINE) {
 		// start of vblank
 		if (ppu->dot_clock_scanline == 1) {
 			ppu->in_vblank = true;
 			ppu->triggered_NMI = false;
 		}
-	} else if (ppu->scanline == 262) {
+	} else if (ppu->scanline == SCANLINES_PER_FRAME) {
 		// end of vblank
 		ppu->scanline = 0;
 		if (ppu->dot_clock_scanline == 1) {
 			ppu->sprite0hit = false;
 			ppu->in_vblank = false;
+			memset(ppu->skipped_spill, 0, sizeof(ppu->skipped_spill));
 			*should_update_frame = true;
 		}
 	}
@@ -45,6 +98,57 @@ void ppu_update_registers(nes_ppu_t *ppu, bool *should_update_frame, uint32_t *v
 
 }
 
+/*
+Runs the PPU until target_dot of the current frame. Returns early (with true)
+right after a frame has been completed, so the caller can present it.
+*/
+bool ppu_run(nes_ppu_t *ppu, uint32_t target_dot)
+{
+	bool frame_done = false;
+
+	while (ppu->frame_dot < target_dot && !frame_done) {
+		uint32_t idle_dots = ppu_idle_dots(ppu);
+		if (idle_dots > target_dot - ppu->frame_dot) {
+			idle_dots = target_dot - ppu->frame_dot;
+		}
+
+		if (idle_dots) {
+			ppu->dot_clock_scanline += idle_dots;
+			ppu->frame_dot += idle_dots;
+			continue;
+		}
+
+		ppu_update_registers(ppu, &frame_done, ppu->video_data);
+		ppu->dot_clock_scanline++;
+		ppu->frame_dot++;
+	}
+
+	ppu_find_vblank_edges(ppu);
+	return frame_done;
+}
+
+void ppu_start_frame(nes_ppu_t *ppu)
+{
+	ppu->vblank_start_dot -= ppu->frame_dot;
+	ppu->vblank_end_dot -= ppu->frame_dot;
+	ppu->frame_dot = 0;
+}
+
+bool ppu_nmi_asserted(nes_ppu_t *ppu)
+{
+	return ppu->in_vblank && ppu->NMI_output && !ppu->triggered_NMI;
+}
+
+/*
+Whether PPUSTATUS reads keep returning the same (once vblank has been read
+off) until the next vblank edge. Sprite 0 hit is the only part that changes
+in between, and only while visible scanlines with sprites are left to draw.
+*/
+bool ppu_status_is_steady(nes_ppu_t *ppu)
+{
+	return ppu->sprite0hit || !ppu->should_render_sprites || ppu->scanline >= 240;
+}
+
 // Stored in RGB 8-bit format (0xRRGGBB)
 static const uint32_t ntsc_rgb_table[64] = {
 	0x464646, 0x00065a, 0x000678, 0x020673, 0x35034c, 0x57000e, 0x5a0000, 0x410000, 0x120200, 0x001400, 0x001e00, 0x001e00, 0x001521, 0x000000, 0x000000, 0x000000, 
@@ -180,6 +284,123 @@ void ppu_draw_scanline(nes_ppu_t *ppu, uint32_t *video_data)
 	}
 }
 
+// Colour ppu_draw_background_scanline would draw at x on the current scanline
+static uint32_t ppu_background_color_at(nes_ppu_t *ppu, int x)
+{
+	uint8_t *bg_tiledata_ptr = &ppu->vmem->data[ppu->background_tiledata_base_offset];
+	uint8_t *attributedata_ptr = &ppu->vmem->data[ppu->nametable_base_offset + 0x3c0];
+	uint8_t *nametable_ptr = &ppu->vmem->data[ppu->nametable_base_offset];
+
+	int cur_tile_idx = x / 8;
+	int pixel_x = x % 8;
+
+	int palette_offset = (ppu->scanline / 32) * 8 + cur_tile_idx / 4;
+	uint8_t palette_data = attributedata_ptr[palette_offset];
+
+	bool horizontal_odd = (cur_tile_idx / 2) & 1;
+	bool vertical_odd = (ppu->scanline / 16) & 1;
+
+	uint8_t specific_palette_data = palette_data >> (((vertical_odd << 1) | horizontal_odd) << 1) & 0b11;
+	int nametable_offset = (ppu->scanline / 8) * 32 + cur_tile_idx;
+
+	uint8_t tile_data_offset = nametable_ptr[nametable_offset];
+	int offset = (tile_data_offset * 16) + (ppu->scanline % 8);
+
+	uint8_t lo_bits = bg_tiledata_ptr[offset];
+	uint8_t hi_bits = bg_tiledata_ptr[offset + 8];
+
+	uint8_t pixel_data = (((hi_bits >> (7 - pixel_x)) & 1) << 1) | 
+						  ((lo_bits >> (7 - pixel_x)) & 1);
+
+	uint16_t bg_palette_offset = pixel_data == 0 ? 0x3f00 :
+		0x3f00 + specific_palette_data * 4;
+
+	return ntsc_rgb_table[ppu->vmem->data[bg_palette_offset + pixel_data]];
+}
+
+/*
+Stand-in for ppu_draw_scanline on skipped frames. Nothing is written to the
+frame buffer; sprite 0 hit comes out exactly as if it had been drawn. A hit
+happens where a sprite pixel lands on a non-zero pixel, so the background is
+only looked up under opaque sprite pixels.
+*/
+void ppu_skip_scanline(nes_ppu_t *ppu)
+{
+	// Whether each pixel has been worked out yet, and if it is non-zero
+	bool known[INTERNAL_VIDEO_WIDTH + SPRITE_SPILL_PIXELS];
+	bool nonzero[INTERNAL_VIDEO_WIDTH + SPRITE_SPILL_PIXELS];
+
+	bool spill[SPRITE_SPILL_PIXELS];
+	memcpy(spill, ppu->skipped_spill, sizeof(spill));
+	memset(ppu->skipped_spill, 0, sizeof(ppu->skipped_spill));
+
+	if (!ppu->should_render_sprites) {
+		return;
+	}
+
+	memset(known, 0, sizeof(known));
+
+	uint8_t *sprite_tiledata = ppu->vmem->data + ppu->sprite_tiledata_base_offset;
+
+	for (int oam_idx = 0; oam_idx < 0x40; oam_idx += 4) {
+		uint8_t sprite_y = ppu->oam[oam_idx];
+		if (sprite_y >= 0xef) {
+			continue;
+		}
+
+		if (ppu->scanline < sprite_y + 1 || ppu->scanline >= sprite_y + 9) {
+			continue;
+		}
+
+		uint8_t sprite_tile_idx = ppu->oam[oam_idx + 1];
+		uint8_t sprite_attributes = ppu->oam[oam_idx + 2];
+		uint8_t sprite_x = ppu->oam[oam_idx + 3];
+
+		int sprite_palette = sprite_attributes & 0b11;
+		int slice_offset = (sprite_tile_idx * 16) + ((ppu->scanline - sprite_y - 1) % 8) % 8;
+
+		uint8_t lo_bits = sprite_tiledata[slice_offset];
+		uint8_t hi_bits = sprite_tiledata[slice_offset + 8];
+
+		if (__get_bit_8(sprite_attributes, 6)) {
+			lo_bits = __mirror_bits(lo_bits);
+			hi_bits = __mirror_bits(hi_bits);
+		}
+
+		for (int pixel_x = 0; pixel_x < 8; pixel_x++) {
+			uint8_t pixel_data = (((hi_bits >> (7 - pixel_x)) & 1) << 1) | 
+								  ((lo_bits >> (7 - pixel_x)) & 1);
+
+			if (pixel_data == 0)
+				continue;
+
+			int x = sprite_x + pixel_x;
+			if (!known[x]) {
+				if (x < INTERNAL_VIDEO_WIDTH && ppu->should_render_background) {
+					nonzero[x] = ppu_background_color_at(ppu, x) != 0;
+				} else if (x < SPRITE_SPILL_PIXELS) {
+					nonzero[x] = spill[x];
+				} else {
+					nonzero[x] = false;
+				}
+				known[x] = true;
+			}
+
+			if (nonzero[x]) {
+				ppu->sprite0hit = true;
+			}
+
+			uint8_t *sprite_palette_addr = ppu->vmem->data + 0x3f10 + sprite_palette * 4;
+			nonzero[x] = ntsc_rgb_table[sprite_palette_addr[pixel_data]] != 0;
+		}
+	}
+
+	for (int i = 0; i < SPRITE_SPILL_PIXELS; i++) {
+		int x = INTERNAL_VIDEO_WIDTH + i;
+		ppu->skipped_spill[i] = known[x] && nonzero[x];
+	}
+}
+
 void ppu_cleanup(nes_ppu_t *ppu)
 {
 	// not needed (yet)	
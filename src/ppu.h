@@ -16,6 +16,7 @@
 
 #define DOTS_PER_SCANLINE 341
 #define SCANLINES_PER_FRAME 262
+#define VBLANK_START_SCANLINE 241
 
 #define HORIZONTAL_TILE_COUNT 32
 #define VERTICAL_TILE_COUNT 30
@@ -27,6 +28,10 @@
 
 #define VIDEO_SCALE 2
 
+// Sprites starting near the right edge write up to 7 pixels past the end of
+// their scanline, into the start of the next one
+#define SPRITE_SPILL_PIXELS 7
+
 
 typedef struct {
 	// Internal vram handle
@@ -67,10 +72,31 @@ typedef struct {
 	
 	int dot_clock_scanline;
 	int scanline;
+
+	// Frame being drawn into
+	uint32_t *video_data;
+
+	// A skipped frame isn't rasterized, only what the CPU can observe (sprite
+	// 0 hit, vblank, status) is computed. skipped_spill stands in for the
+	// sprite pixels that would have spilled into the next scanline
+	bool skip_render;
+	bool skipped_spill[SPRITE_SPILL_PIXELS];
+
+	// The PPU is only caught up lazily, when the CPU touches PPU state or at a
+	// vblank edge. frame_dot is how many dots have been run in the current
+	// frame, the vblank dots are the frame dots of the next vblank start / end
+	uint32_t frame_dot;
+	uint32_t vblank_start_dot;
+	uint32_t vblank_end_dot;
 } nes_ppu_t;
 
 void ppu_init(nes_ppu_t *, nes_vmemory_t *);
 void ppu_draw_scanline(nes_ppu_t *ppu, uint32_t *);
+void ppu_skip_scanline(nes_ppu_t *ppu);
 void ppu_update_registers(nes_ppu_t *, bool *, uint32_t *);
+bool ppu_run(nes_ppu_t *, uint32_t);
+void ppu_start_frame(nes_ppu_t *);
+bool ppu_nmi_asserted(nes_ppu_t *);
+bool ppu_status_is_steady(nes_ppu_t *);
 void ppu_cleanup(nes_ppu_t *);
 #endif
@@ -0,0 +1,447 @@
+#include "recompiler.h"
+#include "cpu.h"
+#include "disassembler.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+What each opcode does in the macros of cpu_ops.h, the same as in
+cpu_run_threaded. Only the official opcodes are compiled, blocks stop before
+anything else.
+*/
+static const char *const recompiler_ops[256] = {
+	[0x00] = "PUSH_16(pc); PUSH_8(GET_SR() | 0b00110000); fi = 1;",
+	[0x01] = "READ_X_IND(); a |= value; SET_NZ(a);",
+	[0x05] = "READ_ZPG(); a |= value; SET_NZ(a);",
+	[0x06] = "ADDR_ZPG(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE();",
+	[0x08] = "PUSH_8(GET_SR() | 0b00110000);",
+	[0x09] = "READ_IMM(); a |= value; SET_NZ(a);",
+	[0x0A] = "ASL(a); SET_NZ(a);",
+	[0x0D] = "READ_ABS(); a |= value; SET_NZ(a);",
+	[0x0E] = "ADDR_ABS(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE();",
+	[0x10] = "BRANCH(!fn);",
+	[0x11] = "READ_IND_Y(); a |= value; SET_NZ(a);",
+	[0x15] = "READ_ZPG_X(); a |= value; SET_NZ(a);",
+	[0x16] = "ADDR_ZPG_X(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE();",
+	[0x18] = "fc = 0;",
+	[0x19] = "READ_ABS_Y(); a |= value; SET_NZ(a);",
+	[0x1D] = "READ_ABS_X(); a |= value; SET_NZ(a);",
+	[0x1E] = "ADDR_ABS_X(); RMW_LOAD(); ASL(value); SET_NZ(value); RMW_STORE();",
+	[0x20] = "PUSH_16((uint16_t)(pc - 1)); pc = imm16;",
+	[0x21] = "READ_X_IND(); a &= value; SET_NZ(a);",
+	[0x24] = "READ_ZPG(); fz = (a & value) == 0; fn = value >> 7; fv = (value >> 6) & 1;",
+	[0x25] = "READ_ZPG(); a &= value; SET_NZ(a);",
+	[0x26] = "ADDR_ZPG(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE();",
+	[0x28] = "POP_8(value); SET_SR(value);",
+	[0x29] = "READ_IMM(); a &= value; SET_NZ(a);",
+	[0x2A] = "ROL(a); SET_NZ(a);",
+	[0x2C] = "READ_ABS(); fz = (a & value) == 0; fn = value >> 7; fv = (value >> 6) & 1;",
+	[0x2D] = "READ_ABS(); a &= value; SET_NZ(a);",
+	[0x2E] = "ADDR_ABS(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE();",
+	[0x30] = "BRANCH(fn);",
+	[0x31] = "READ_IND_Y(); a &= value; SET_NZ(a);",
+	[0x35] = "READ_ZPG_X(); a &= value; SET_NZ(a);",
+	[0x36] = "ADDR_ZPG_X(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE();",
+	[0x38] = "fc = 1;",
+	[0x39] = "READ_ABS_Y(); a &= value; SET_NZ(a);",
+	[0x3D] = "READ_ABS_X(); a &= value; SET_NZ(a);",
+	[0x3E] = "ADDR_ABS_X(); RMW_LOAD(); ROL(value); SET_NZ(value); RMW_STORE();",
+	[0x40] = "POP_8(value); SET_SR(value); POP_16(pc);",
+	[0x41] = "READ_X_IND(); a ^= value; SET_NZ(a);",
+	[0x45] = "READ_ZPG(); a ^= value; SET_NZ(a);",
+	[0x46] = "ADDR_ZPG(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE();",
+	[0x48] = "PUSH_8(a);",
+	[0x49] = "READ_IMM(); a ^= value; SET_NZ(a);",
+	[0x4A] = "LSR(a); SET_NZ(a);",
+	[0x4C] = "pc = imm16;",
+	[0x4D] = "READ_ABS(); a ^= value; SET_NZ(a);",
+	[0x4E] = "ADDR_ABS(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE();",
+	[0x50] = "BRANCH(!fv);",
+	[0x51] = "READ_IND_Y(); a ^= value; SET_NZ(a);",
+	[0x55] = "READ_ZPG_X(); a ^= value; SET_NZ(a);",
+	[0x56] = "ADDR_ZPG_X(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE();",
+	[0x58] = "fi = 0;",
+	[0x59] = "READ_ABS_Y(); a ^= value; SET_NZ(a);",
+	[0x5D] = "READ_ABS_X(); a ^= value; SET_NZ(a);",
+	[0x5E] = "ADDR_ABS_X(); RMW_LOAD(); LSR(value); SET_NZ(value); RMW_STORE();",
+	[0x60] = "POP_16(pc); pc++;",
+	[0x61] = "READ_X_IND(); ADC(value);",
+	[0x65] = "READ_ZPG(); ADC(value);",
+	[0x66] = "ADDR_ZPG(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE();",
+	[0x68] = "POP_8(a); SET_NZ(a);",
+	[0x69] = "READ_IMM(); ADC(value);",
+	[0x6A] = "ROR(a); SET_NZ(a);",
+	[0x6C] = "LOAD(imm16); carry = value; LOAD((imm16 & 0xff00) | (uint8_t)((imm16 & 0xff) + 1)); pc = (value << 8) | carry;",
+	[0x6D] = "READ_ABS(); ADC(value);",
+	[0x6E] = "ADDR_ABS(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE();",
+	[0x70] = "BRANCH(fv);",
+	[0x71] = "READ_IND_Y(); ADC(value);",
+	[0x75] = "READ_ZPG_X(); ADC(value);",
+	[0x76] = "ADDR_ZPG_X(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE();",
+	[0x78] = "fi = 1;",
+	[0x79] = "READ_ABS_Y(); ADC(value);",
+	[0x7D] = "READ_ABS_X(); ADC(value);",
+	[0x7E] = "ADDR_ABS_X(); RMW_LOAD(); ROR(value); SET_NZ(value); RMW_STORE();",
+	[0x81] = "ADDR_X_IND(); STORE(a);",
+	[0x84] = "ADDR_ZPG(); STORE(y);",
+	[0x85] = "ADDR_ZPG(); STORE(a);",
+	[0x86] = "ADDR_ZPG(); STORE(x);",
+	[0x88] = "y--; SET_NZ(y);",
+	[0x8A] = "a = x; SET_NZ(a);",
+	[0x8C] = "ADDR_ABS(); STORE(y);",
+	[0x8D] = "ADDR_ABS(); STORE(a);",
+	[0x8E] = "ADDR_ABS(); STORE(x);",
+	[0x90] = "BRANCH(!fc);",
+	[0x91] = "ADDR_IND_Y(); STORE(a);",
+	[0x94] = "ADDR_ZPG_X(); STORE(y);",
+	[0x95] = "ADDR_ZPG_X(); STORE(a);",
+	[0x96] = "ADDR_ZPG_Y(); STORE(x);",
+	[0x98] = "a = y; SET_NZ(a);",
+	[0x99] = "ADDR_ABS_Y(); STORE(a);",
+	[0x9A] = "sp = x;",
+	[0x9D] = "ADDR_ABS_X(); STORE(a);",
+	[0xA0] = "READ_IMM(); y = value; SET_NZ(y);",
+	[0xA1] = "READ_X_IND(); a = value; SET_NZ(a);",
+	[0xA2] = "READ_IMM(); x = value; SET_NZ(x);",
+	[0xA4] = "READ_ZPG(); y = value; SET_NZ(y);",
+	[0xA5] = "READ_ZPG(); a = value; SET_NZ(a);",
+	[0xA6] = "READ_ZPG(); x = value; SET_NZ(x);",
+	[0xA8] = "y = a; SET_NZ(y);",
+	[0xA9] = "READ_IMM(); a = value; SET_NZ(a);",
+	[0xAA] = "x = a; SET_NZ(x);",
+	[0xAC] = "READ_ABS(); y = value; SET_NZ(y);",
+	[0xAD] = "READ_ABS(); a = value; SET_NZ(a);",
+	[0xAE] = "READ_ABS(); x = value; SET_NZ(x);",
+	[0xB0] = "BRANCH(fc);",
+	[0xB1] = "READ_IND_Y(); a = value; SET_NZ(a);",
+	[0xB4] = "READ_ZPG_X(); y = value; SET_NZ(y);",
+	[0xB5] = "READ_ZPG_X(); a = value; SET_NZ(a);",
+	[0xB6] = "READ_ZPG_Y(); x = value; SET_NZ(x);",
+	[0xB8] = "fv = 0;",
+	[0xB9] = "READ_ABS_Y(); a = value; SET_NZ(a);",
+	[0xBA] = "x = sp; SET_NZ(x);",
+	[0xBC] = "READ_ABS_X(); y = value; SET_NZ(y);",
+	[0xBD] = "READ_ABS_X(); a = value; SET_NZ(a);",
+	[0xBE] = "READ_ABS_Y(); x = value; SET_NZ(x);",
+	[0xC0] = "READ_IMM(); COMPARE(y, value);",
+	[0xC1] = "READ_X_IND(); COMPARE(a, value);",
+	[0xC4] = "READ_ZPG(); COMPARE(y, value);",
+	[0xC5] = "READ_ZPG(); COMPARE(a, value);",
+	[0xC6] = "ADDR_ZPG(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE();",
+	[0xC8] = "y++; SET_NZ(y);",
+	[0xC9] = "READ_IMM(); COMPARE(a, value);",
+	[0xCA] = "x--; SET_NZ(x);",
+	[0xCC] = "READ_ABS(); COMPARE(y, value);",
+	[0xCD] = "READ_ABS(); COMPARE(a, value);",
+	[0xCE] = "ADDR_ABS(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE();",
+	[0xD0] = "BRANCH(!fz);",
+	[0xD1] = "READ_IND_Y(); COMPARE(a, value);",
+	[0xD5] = "READ_ZPG_X(); COMPARE(a, value);",
+	[0xD6] = "ADDR_ZPG_X(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE();",
+	[0xD8] = "fd = 0;",
+	[0xD9] = "READ_ABS_Y(); COMPARE(a, value);",
+	[0xDD] = "READ_ABS_X(); COMPARE(a, value);",
+	[0xDE] = "ADDR_ABS_X(); RMW_LOAD(); value--; SET_NZ(value); RMW_STORE();",
+	[0xE0] = "READ_IMM(); COMPARE(x, value);",
+	[0xE1] = "READ_X_IND(); ADC((uint8_t)~value);",
+	[0xE4] = "READ_ZPG(); COMPARE(x, value);",
+	[0xE5] = "READ_ZPG(); ADC((uint8_t)~value);",
+	[0xE6] = "ADDR_ZPG(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE();",
+	[0xE8] = "x++; SET_NZ(x);",
+	[0xE9] = "READ_IMM(); ADC((uint8_t)~value);",
+	[0xEA] = "",
+	[0xEC] = "READ_ABS(); COMPARE(x, value);",
+	[0xED] = "READ_ABS(); ADC((uint8_t)~value);",
+	[0xEE] = "ADDR_ABS(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE();",
+	[0xF0] = "BRANCH(fz);",
+	[0xF1] = "READ_IND_Y(); ADC((uint8_t)~value);",
+	[0xF5] = "READ_ZPG_X(); ADC((uint8_t)~value);",
+	[0xF6] = "ADDR_ZPG_X(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE();",
+	[0xF8] = "fd = 1;",
+	[0xF9] = "READ_ABS_Y(); ADC((uint8_t)~value);",
+	[0xFD] = "READ_ABS_X(); ADC((uint8_t)~value);",
+	[0xFE] = "ADDR_ABS_X(); RMW_LOAD(); value++; SET_NZ(value); RMW_STORE();",
+};
+
+typedef struct {
+	const uint8_t *mem;
+
+	// By PC - CPU_BLOCK_CACHE_START
+	bool leader[CPU_BLOCK_CACHE_SIZE];
+	bool walked[CPU_BLOCK_CACHE_SIZE];
+
+	uint16_t queue[CPU_BLOCK_CACHE_SIZE];
+	uint32_t queue_size;
+
+	// PCs of the instructions in the block being written, and whether
+	// something in the block jumps back to them
+	uint16_t block[CPU_BLOCK_CACHE_SIZE];
+	bool jumped_to[CPU_BLOCK_CACHE_SIZE];
+	uint32_t block_size;
+} recompiler_t;
+
+// Whether the instruction at pc is compiled, and lies in 0x8000-0xffff as a whole
+static bool recompiler_compiles(const recompiler_t *rc, uint32_t pc)
+{
+	if (pc < CPU_BLOCK_CACHE_START || pc >= ADDRESS_SPACE_SIZE_6502) {
+		return false;
+	}
+
+	uint8_t op = rc->mem[pc];
+	return recompiler_ops[op] && pc + cpu_size_table[op] <= ADDRESS_SPACE_SIZE_6502;
+}
+
+static uint16_t recompiler_operand(const recompiler_t *rc, uint32_t pc)
+{
+	switch (cpu_size_table[rc->mem[pc]]) {
+		case 2:
+			return rc->mem[pc + 1];
+		case 3:
+			return rc->mem[pc + 1] | (rc->mem[pc + 2] << 8);
+		default:
+			return 0;
+	}
+}
+
+/*
+Whether a block ends after op. Besides jumps, branches and returns that's
+PLP and CLI, which can make an interrupt due: blocks don't check for them,
+only cpu_run_aot does in between.
+*/
+static bool recompiler_ends_block(uint8_t op)
+{
+	switch (op) {
+		case 0x00: case 0x20: case 0x28: case 0x40:
+		case 0x4C: case 0x58: case 0x60: case 0x6C:
+			return true;
+		default:
+			return (op & 0x1F) == 0x10;
+	}
+}
+
+// Idle loops are left to the frame loop (see cpu.h), so they don't get a block
+static bool recompiler_is_idle_loop(const recompiler_t *rc, uint32_t pc)
+{
+	cpu_idle_loop_t loop;
+	return cpu_find_idle_loop(rc->mem, pc, &loop);
+}
+
+static void recompiler_add_leader(recompiler_t *rc, uint16_t pc)
+{
+	if (pc < CPU_BLOCK_CACHE_START || rc->leader[pc - CPU_BLOCK_CACHE_START]) {
+		return;
+	}
+
+	rc->leader[pc - CPU_BLOCK_CACHE_START] = true;
+	rc->queue[rc->queue_size++] = pc;
+}
+
+/*
+Follows the code from every leader queued up, queueing branch / jump targets
+and the code after JSRs as leaders in turn. Code already walked from somewhere
+else becomes a leader too, so blocks never overlap, and so do idle loops,
+so blocks stop short of them.
+*/
+static void recompiler_walk(recompiler_t *rc)
+{
+	while (rc->queue_size > 0) {
+		uint32_t start = rc->queue[--rc->queue_size];
+		uint32_t pc = start;
+
+		while (recompiler_compiles(rc, pc)) {
+			if (rc->walked[pc - CPU_BLOCK_CACHE_START] ||
+				(pc != start && recompiler_is_idle_loop(rc, pc))) {
+				recompiler_add_leader(rc, pc);
+				break;
+			}
+			rc->walked[pc - CPU_BLOCK_CACHE_START] = true;
+
+			uint8_t op = rc->mem[pc];
+			uint16_t imm16 = recompiler_operand(rc, pc);
+			uint16_t next_pc = pc + cpu_size_table[op];
+
+			if ((op & 0x1F) == 0x10) {
+				recompiler_add_leader(rc, next_pc + (int8_t)imm16);
+				recompiler_add_leader(rc, next_pc);
+			} else if (op == 0x4C) {
+				recompiler_add_leader(rc, imm16);
+			} else if (op == 0x20) {
+				recompiler_add_leader(rc, imm16);
+				recompiler_add_leader(rc, next_pc);
+			} else if (op == 0x28 || op == 0x58) {
+				recompiler_add_leader(rc, next_pc);
+			}
+
+			if (recompiler_ends_block(op)) {
+				break;
+			}
+			pc = next_pc;
+		}
+	}
+}
+
+// Where a JMP abs / branch at pc goes, or -1 for anything else
+static int32_t recompiler_jump_target(const recompiler_t *rc, uint32_t pc)
+{
+	uint8_t op = rc->mem[pc];
+	uint16_t operand = recompiler_operand(rc, pc);
+
+	if (op == 0x4C) {
+		return operand;
+	} else if ((op & 0x1F) == 0x10) {
+		return (uint16_t)(pc + 2 + (int8_t)operand);
+	}
+
+	return -1;
+}
+
+// Index of the instruction at pc in the current block, or -1
+static int32_t recompiler_find_instr(const recompiler_t *rc, int32_t pc)
+{
+	for (uint32_t i = 0; i < rc->block_size; i++) {
+		if (rc->block[i] == pc) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+Writes out the block starting at pc, returns how many instructions it has.
+Jumps and branches back into the block stay in the function, which keeps
+loops like the idle loop of most games (JMP to itself) from going through
+cpu_run_aot every time around.
+*/
+static uint32_t recompiler_write_block(recompiler_t *rc, FILE *file, uint32_t pc)
+{
+	rc->block_size = 0;
+	do {
+		uint8_t op = rc->mem[pc];
+		rc->block[rc->block_size++] = pc;
+		pc += cpu_size_table[op];
+		if (recompiler_ends_block(op)) {
+			break;
+		}
+	} while (recompiler_compiles(rc, pc) && !rc->leader[pc - CPU_BLOCK_CACHE_START]);
+
+	for (uint32_t i = 0; i < rc->block_size; i++) {
+		rc->jumped_to[i] = false;
+	}
+	for (uint32_t i = 0; i < rc->block_size; i++) {
+		int32_t target = recompiler_find_instr(rc, recompiler_jump_target(rc, rc->block[i]));
+		if (target >= 0) {
+			rc->jumped_to[target] = true;
+		}
+	}
+
+	fprintf(file, "static void aot_%04X(cpu_aot_regs_t *r)\n{\n\tAOT_BLOCK_BEGIN();\n", rc->block[0]);
+
+	for (uint32_t i = 0; i < rc->block_size; i++) {
+		pc = rc->block[i];
+		uint8_t op = rc->mem[pc];
+		uint8_t size = cpu_size_table[op];
+		uint16_t operand = recompiler_operand(rc, pc);
+
+		// packed like cpu_fetch_instruction does
+		uint32_t instr = op << 16 | (size == 2 ? operand << 8 : operand);
+
+		char disasm[32] = "";
+		disasm_instr(instr, disasm, sizeof(disasm), pc + size);
+
+		fprintf(file, "\n\t// $%04X: %s\n", pc, disasm);
+		if (rc->jumped_to[i]) {
+			fprintf(file, "instr_%04X:\n", pc);
+		}
+		fprintf(file, "\tAOT_INSTR(0x%04X, 0x%04X, %u, 0x%04X);\n",
+			pc, (pc + size) & 0xffff, cpu_cycle_count_table[op], operand);
+		if (recompiler_ops[op][0] != '\0') {
+			fprintf(file, "\t%s\n", recompiler_ops[op]);
+		}
+		fprintf(file, "\tcpu_cycle += cycles;\n");
+
+		int32_t target = recompiler_jump_target(rc, pc);
+		if (recompiler_find_instr(rc, target) >= 0) {
+			if (op == 0x4C) {
+				fprintf(file, "\tgoto instr_%04X;\n", target);
+			} else {
+				fprintf(file, "\tif (pc == 0x%04X) {\n\t\tgoto instr_%04X;\n\t}\n", target, target);
+			}
+		}
+	}
+
+	fprintf(file, "\n\tAOT_BLOCK_END();\n}\n\n");
+	return rc->block_size;
+}
+
+/*
+Writes the C for the ROM in nes to path, see recompiler.h. The ROM has to be
+loaded, and 0x8000-0xffff has to hold what the ROM had there when it was.
+*/
+bool recompiler_write(const nes_t *nes, const char *path, recompiler_stats_t *stats)
+{
+	recompiler_t *rc = calloc(1, sizeof(recompiler_t));
+	if (!rc) {
+		log_event("Could not allocate the recompiler!");
+		return false;
+	}
+	rc->mem = nes->memory.data;
+
+	static const uint16_t vectors[] = {
+		NMI_INTERRUPT_VECTOR_ADDR, RESET_VECTOR_ADDR, IRQ_INTERRUPT_VECTOR_ADDR
+	};
+	for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		recompiler_add_leader(rc, rc->mem[vectors[i]] | (rc->mem[vectors[i] + 1] << 8));
+	}
+
+	const cpu_block_cache_t *cache = &nes->cpu_blocks;
+	for (uint32_t i = 0; i < CPU_BLOCK_CACHE_SIZE; i++) {
+		if (cache->blocks[i].generation == cache->generation) {
+			recompiler_add_leader(rc, CPU_BLOCK_CACHE_START + i);
+		}
+	}
+
+	recompiler_walk(rc);
+
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		log_event("Could not open %s!", path);
+		free(rc);
+		return false;
+	}
+
+	fprintf(file, "// Written by nesemu-headless --recompile, see recompiler.h. Don't edit\n");
+	fprintf(file, "#include \"cpu_aot.h\"\n\n");
+
+	*stats = (recompiler_stats_t){0};
+	for (uint32_t pc = CPU_BLOCK_CACHE_START; pc < ADDRESS_SPACE_SIZE_6502; pc++) {
+		if (rc->leader[pc - CPU_BLOCK_CACHE_START] && recompiler_compiles(rc, pc) && !recompiler_is_idle_loop(rc, pc)) {
+			stats->instructions += recompiler_write_block(rc, file, pc);
+			stats->blocks++;
+		}
+	}
+
+	fprintf(file, "static const cpu_aot_block_t aot_blocks[CPU_BLOCK_CACHE_SIZE] = {\n");
+	for (uint32_t pc = CPU_BLOCK_CACHE_START; pc < ADDRESS_SPACE_SIZE_6502; pc++) {
+		if (rc->leader[pc - CPU_BLOCK_CACHE_START] && recompiler_compiles(rc, pc) && !recompiler_is_idle_loop(rc, pc)) {
+			fprintf(file, "\t[0x%04X - CPU_BLOCK_CACHE_START] = aot_%04X,\n", pc, pc);
+		}
+	}
+	fprintf(file, "};\n\n");
+
+	fprintf(file, "const cpu_aot_program_t cpu_aot_program = {\n");
+	fprintf(file, "\t0x%016llXULL,\n", (unsigned long long)hash_bytes(rc->mem + CPU_BLOCK_CACHE_START, CPU_BLOCK_CACHE_SIZE));
+	fprintf(file, "\taot_blocks,\n");
+	fprintf(file, "\t%u\n", stats->blocks);
+	fprintf(file, "};\n");
+
+	bool ok = !ferror(file);
+	ok &= fclose(file) == 0;
+	if (!ok) {
+		log_event("Could not write %s!", path);
+	}
+
+	free(rc);
+	return ok;
+}
@@ -0,0 +1,21 @@
+#ifndef RECOMPILER_INCLUDE
+#define RECOMPILER_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include "nes.h"
+
+/*
+Ahead-of-time recompiler. Walks the code reachable from the NMI / reset / IRQ
+vectors of the loaded ROM, plus every block the threaded core has cached so
+far (which finds what's only reached through jump tables), and writes it out
+as C with one function per basic block. Building that file into the core
+(AOT_SRC in the Makefile) gives a core for that ROM, --cpu aot, that runs
+the blocks wherever it can and the threaded core everywhere else.
+*/
+typedef struct {
+	uint32_t blocks;
+	uint32_t instructions;
+} recompiler_stats_t;
+
+bool recompiler_write(const nes_t *, const char *, recompiler_stats_t *);
+#endif // RECOMPILER_INCLUDE
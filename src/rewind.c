@@ -0,0 +1,385 @@
+#include "rewind.h"
+#include "utils.h"
+#include "utils_platform.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REWIND_WORDS (sizeof(nes_state_t) / sizeof(uint64_t))
+
+// Run lengths are stored as 16 bit word counts
+#define REWIND_MAX_RUN 0xffff
+
+static_assert(sizeof(nes_state_t) % sizeof(uint64_t) == 0, "nes_state_t isn't a whole number of words");
+static_assert(REWIND_WORDS <= REWIND_MAX_RUN, "nes_state_t is too big for 16 bit run lengths");
+
+// Memory is encoded page by page, skipping the ones that weren't written
+#define REWIND_MEMORY_WORD (offsetof(nes_state_t, memory) / sizeof(uint64_t))
+#define REWIND_VMEMORY_WORD (offsetof(nes_state_t, vmemory) / sizeof(uint64_t))
+#define REWIND_END_WORD (REWIND_VMEMORY_WORD + ADDRESS_SPACE_SIZE_2C02 / sizeof(uint64_t))
+#define REWIND_PAGE_WORDS (MEMORY_PAGE_SIZE / sizeof(uint64_t))
+
+static_assert(offsetof(nes_state_t, memory) % sizeof(uint64_t) == 0, "nes_state_t memory isn't word aligned");
+static_assert(offsetof(nes_state_t, vmemory) == offsetof(nes_state_t, memory) + ADDRESS_SPACE_SIZE_6502,
+	"nes_state_t vmemory doesn't follow memory");
+
+/*
+A delta is a series of [equal words][literal words] u16 pairs, each followed by
+that many XORed literal words. A literal run ends at the first equal word, so
+the encoding is never bigger than the state itself plus one pair.
+*/
+#define REWIND_MAX_DELTA_SIZE (sizeof(nes_state_t) + 2 * sizeof(uint16_t))
+
+bool rewind_init(rewind_t *rw, size_t budget, uint32_t interval)
+{
+	memset(rw, 0, sizeof(rewind_t));
+	rw->interval = interval;
+	rw->capacity = budget;
+
+	rw->newest = malloc(sizeof(nes_state_t));
+	rw->captured = malloc(sizeof(nes_state_t));
+	rw->inputs = malloc(interval);
+	rw->delta = malloc(interval + REWIND_MAX_DELTA_SIZE);
+	rw->ring = malloc(budget);
+
+	if (!rw->newest || !rw->captured || !rw->inputs || !rw->delta || !rw->ring) {
+		log_event("Could not allocate rewind buffer!");
+		rewind_cleanup(rw);
+		return false;
+	}
+
+	return true;
+}
+
+void rewind_cleanup(rewind_t *rw)
+{
+	free(rw->newest);
+	free(rw->captured);
+	free(rw->inputs);
+	free(rw->delta);
+	free(rw->ring);
+
+	rw->newest = NULL;
+	rw->captured = NULL;
+	rw->inputs = NULL;
+	rw->delta = NULL;
+	rw->ring = NULL;
+}
+
+// Forgets all history, e.g. after loading a different ROM
+void rewind_reset(rewind_t *rw)
+{
+	rw->has_newest = false;
+	rw->frames_since_newest = 0;
+
+	rw->head = 0;
+	rw->tail = 0;
+	rw->used = 0;
+	rw->num_deltas = 0;
+}
+
+static void rewind_ring_write(rewind_t *rw, size_t pos, const void *src, size_t size)
+{
+	size_t first = rw->capacity - pos < size ? rw->capacity - pos : size;
+	memcpy(rw->ring + pos, src, first);
+	memcpy(rw->ring, (const uint8_t *)src + first, size - first);
+}
+
+static void rewind_ring_read(rewind_t *rw, size_t pos, void *dest, size_t size)
+{
+	size_t first = rw->capacity - pos < size ? rw->capacity - pos : size;
+	memcpy(dest, rw->ring + pos, first);
+	memcpy((uint8_t *)dest + first, rw->ring, size - first);
+}
+
+static void rewind_drop_oldest(rewind_t *rw)
+{
+	uint32_t size;
+	rewind_ring_read(rw, rw->tail, &size, sizeof(size));
+
+	size_t entry_size = size + 2 * sizeof(uint32_t);
+	rw->tail = (rw->tail + entry_size) % rw->capacity;
+	rw->used -= entry_size;
+	rw->num_deltas--;
+}
+
+static void rewind_push(rewind_t *rw, const uint8_t *payload, uint32_t size)
+{
+	size_t entry_size = size + 2 * sizeof(uint32_t);
+
+	// every delta is needed to walk back past it, so one that can't be
+	// stored at all cuts the history off here
+	if (entry_size > rw->capacity) {
+		rewind_reset(rw);
+		return;
+	}
+
+	while (rw->capacity - rw->used < entry_size) {
+		rewind_drop_oldest(rw);
+	}
+
+	rewind_ring_write(rw, rw->head, &size, sizeof(size));
+	rewind_ring_write(rw, (rw->head + sizeof(size)) % rw->capacity, payload, size);
+	rewind_ring_write(rw, (rw->head + sizeof(size) + size) % rw->capacity, &size, sizeof(size));
+
+	rw->head = (rw->head + entry_size) % rw->capacity;
+	rw->used += entry_size;
+	rw->num_deltas++;
+}
+
+// Copies the newest entry's payload into rw->delta and removes it
+static uint32_t rewind_pop(rewind_t *rw)
+{
+	size_t end = (rw->head + rw->capacity - sizeof(uint32_t)) % rw->capacity;
+
+	uint32_t size;
+	rewind_ring_read(rw, end, &size, sizeof(size));
+
+	size_t entry_size = size + 2 * sizeof(uint32_t);
+	size_t start = (rw->head + rw->capacity - entry_size) % rw->capacity;
+	rewind_ring_read(rw, (start + sizeof(size)) % rw->capacity, rw->delta, size);
+
+	rw->head = start;
+	rw->used -= entry_size;
+	rw->num_deltas--;
+
+	return size;
+}
+
+/*
+Builds a delta word by word. The pair being built is written once it's
+complete, its literal words go right after the space left for it
+*/
+typedef struct {
+	uint8_t *out;
+	uint8_t *pair;
+	uint16_t equal;
+	uint16_t literal;
+} rewind_encoder_t;
+
+static inline void rewind_encode_pair(rewind_encoder_t *enc)
+{
+	uint16_t run[2] = {enc->equal, enc->literal};
+	memcpy(enc->pair, run, sizeof(run));
+}
+
+static inline void rewind_encode_start_pair(rewind_encoder_t *enc)
+{
+	enc->pair = enc->out;
+	enc->out += 2 * sizeof(uint16_t);
+	enc->equal = 0;
+	enc->literal = 0;
+}
+
+static inline void rewind_encode_equal(rewind_encoder_t *enc, size_t words)
+{
+	if (enc->literal > 0) {
+		rewind_encode_pair(enc);
+		rewind_encode_start_pair(enc);
+	}
+	enc->equal += words;
+}
+
+static inline void rewind_encode_words(rewind_encoder_t *enc, const uint64_t *a, const uint64_t *b,
+	size_t words)
+{
+	for (size_t i = 0; i < words; i++) {
+		if (a[i] == b[i]) {
+			rewind_encode_equal(enc, 1);
+		} else {
+			uint64_t x = a[i] ^ b[i];
+			memcpy(enc->out, &x, sizeof(x));
+			enc->out += sizeof(x);
+			enc->literal++;
+		}
+	}
+}
+
+// Pages not set in changed are known to be the same on both sides
+static void rewind_encode_pages(rewind_encoder_t *enc, const uint64_t *a, const uint64_t *b,
+	const uint64_t *changed, uint32_t num_pages)
+{
+	for (uint32_t page = 0; page < num_pages; page++) {
+		size_t offset = page * REWIND_PAGE_WORDS;
+		if (memory_page_dirty(changed, page)) {
+			rewind_encode_words(enc, a + offset, b + offset, REWIND_PAGE_WORDS);
+		} else {
+			rewind_encode_equal(enc, REWIND_PAGE_WORDS);
+		}
+	}
+}
+
+static size_t rewind_encode_delta(uint8_t *out, const nes_state_t *from, const nes_state_t *to,
+	const uint64_t *memory_changed, const uint64_t *vmemory_changed)
+{
+	const uint64_t *a = (const uint64_t *)from;
+	const uint64_t *b = (const uint64_t *)to;
+
+	rewind_encoder_t enc;
+	enc.out = out;
+	rewind_encode_start_pair(&enc);
+
+	rewind_encode_words(&enc, a, b, REWIND_MEMORY_WORD);
+	rewind_encode_pages(&enc, a + REWIND_MEMORY_WORD, b + REWIND_MEMORY_WORD, memory_changed, CPU_PAGES);
+	rewind_encode_pages(&enc, a + REWIND_VMEMORY_WORD, b + REWIND_VMEMORY_WORD, vmemory_changed, PPU_PAGES);
+	rewind_encode_words(&enc, a + REWIND_END_WORD, b + REWIND_END_WORD, REWIND_WORDS - REWIND_END_WORD);
+
+	rewind_encode_pair(&enc);
+	return enc.out - out;
+}
+
+static void rewind_apply_delta(nes_state_t *state, const uint8_t *in, size_t size)
+{
+	uint64_t *words = (uint64_t *)state;
+	const uint8_t *end = in + size;
+
+	size_t i = 0;
+	while (in < end) {
+		uint16_t run[2];
+		memcpy(run, in, sizeof(run));
+		in += sizeof(run);
+
+		i += run[0];
+		for (uint16_t w = 0; w < run[1]; w++, i++) {
+			uint64_t x;
+			memcpy(&x, in, sizeof(x));
+			in += sizeof(x);
+			words[i] ^= x;
+		}
+	}
+}
+
+/*
+Call after every frame, with key_state still holding the input it was run
+with. Takes (and clears) the memory dirty bitmaps of nes: a snapshot only
+copies the pages written since the last two, and only compares the pages
+written since the last one
+*/
+void rewind_record_frame(rewind_t *rw, nes_t *nes)
+{
+	if (!rw->has_newest) {
+		state_save(rw->newest, nes);
+		rw->has_newest = true;
+		rw->frames_since_newest = 0;
+
+		memset(nes->memory.dirty, 0, sizeof(nes->memory.dirty));
+		memset(nes->vmemory.dirty, 0, sizeof(nes->vmemory.dirty));
+
+		// rw->captured holds nothing yet
+		memset(rw->memory_dirty, 0xff, sizeof(rw->memory_dirty));
+		memset(rw->vmemory_dirty, 0xff, sizeof(rw->vmemory_dirty));
+		return;
+	}
+
+	rw->inputs[rw->frames_since_newest++] = nes->key_state;
+	if (rw->frames_since_newest < rw->interval) {
+		return;
+	}
+
+	uint64_t start = get_monotonic_ns();
+
+	// rw->captured is the snapshot before rw->newest, so it's missing the
+	// pages written since either
+	uint64_t memory_dirty[DIRTY_WORDS(CPU_PAGES)];
+	uint64_t vmemory_dirty[DIRTY_WORDS(PPU_PAGES)];
+	memory_take_dirty(nes->memory.dirty, memory_dirty, DIRTY_WORDS(CPU_PAGES));
+	memory_take_dirty(nes->vmemory.dirty, vmemory_dirty, DIRTY_WORDS(PPU_PAGES));
+
+	uint64_t memory_pages[DIRTY_WORDS(CPU_PAGES)];
+	uint64_t vmemory_pages[DIRTY_WORDS(PPU_PAGES)];
+	for (int i = 0; i < DIRTY_WORDS(CPU_PAGES); i++) {
+		memory_pages[i] = memory_dirty[i] | rw->memory_dirty[i];
+	}
+	for (int i = 0; i < DIRTY_WORDS(PPU_PAGES); i++) {
+		vmemory_pages[i] = vmemory_dirty[i] | rw->vmemory_dirty[i];
+	}
+	state_save_pages(rw->captured, nes, memory_pages, vmemory_pages);
+
+	// the payload is the inputs leading away from the older snapshot,
+	// followed by the delta back to it
+	memcpy(rw->delta, rw->inputs, rw->interval);
+	size_t size = rw->interval + rewind_encode_delta(rw->delta + rw->interval, rw->newest, rw->captured,
+		memory_dirty, vmemory_dirty);
+	rewind_push(rw, rw->delta, size);
+
+	memcpy(rw->memory_dirty, memory_dirty, sizeof(memory_dirty));
+	memcpy(rw->vmemory_dirty, vmemory_dirty, sizeof(vmemory_dirty));
+
+	nes_state_t *older = rw->newest;
+	rw->newest = rw->captured;
+	rw->captured = older;
+	rw->frames_since_newest = 0;
+
+	rw->snapshots_taken++;
+	rw->delta_bytes += size;
+	rw->capture_ns += get_monotonic_ns() - start;
+}
+
+/*
+Loads the newest snapshot and runs the given number of recorded frames on
+from it, showing only the last one
+*/
+static void rewind_replay(rewind_t *rw, nes_t *nes, uint32_t frames)
+{
+	state_load(rw->newest, nes);
+
+	// whatever was pending in the snapshot is long gone from the frame buffer
+	nes->ppu.skip_render = true;
+
+	nes_audio_callback_t audio = nes->callbacks.audio;
+	nes->callbacks.audio = NULL;
+
+	for (uint32_t i = 0; i < frames; i++) {
+		nes->key_state = rw->inputs[i];
+		nes->skip_render = i + 1 < frames;
+		nes_do_frame_cycle(nes);
+	}
+
+	nes->callbacks.audio = audio;
+	nes_flush_frame(nes);
+}
+
+/*
+Steps the emulation one frame back in time and presents that frame. Returns
+false, leaving nes untouched, once there's no more history to go back into.
+*/
+bool rewind_step_back(rewind_t *rw, nes_t *nes)
+{
+	if (!rw->has_newest) {
+		return false;
+	}
+
+	/*
+	Showing a frame means running the frame before it, so the snapshot used
+	has to be at least one frame older than the target
+	*/
+	if (rw->frames_since_newest < 2) {
+		if (rw->num_deltas == 0) {
+			return false;
+		}
+
+		uint32_t size = rewind_pop(rw);
+		rewind_apply_delta(rw->newest, rw->delta + rw->interval, size - rw->interval);
+		memcpy(rw->inputs, rw->delta, rw->interval);
+		rw->frames_since_newest += rw->interval;
+	}
+
+	rw->frames_since_newest--;
+	rewind_replay(rw, nes, rw->frames_since_newest);
+
+	return true;
+}
+
+void rewind_report(rewind_t *rw, FILE *out)
+{
+	if (rw->snapshots_taken == 0) {
+		return;
+	}
+
+	fprintf(out, "Rewind: %u deltas in %.1f / %.1f MiB, one every %u frames\n",
+		rw->num_deltas, rw->used / 1048576.0, rw->capacity / 1048576.0, rw->interval);
+	fprintf(out, "  mean delta %.1f KiB of %.1f KiB, capture %.1f us\n",
+		rw->delta_bytes / 1024.0 / rw->snapshots_taken, sizeof(nes_state_t) / 1024.0,
+		rw->capture_ns / 1e3 / rw->snapshots_taken);
+}
@@ -0,0 +1,64 @@
+#ifndef REWIND_INCLUDE
+#define REWIND_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "nes.h"
+#include "state.h"
+
+#define REWIND_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define REWIND_DEFAULT_INTERVAL 4
+
+/*
+Rewind history. Every interval frames a snapshot is taken; only the newest is
+kept whole, each older one is stored in a ring as the XOR of itself and the
+snapshot after it, run-length encoded over 8 byte words. Most of the state
+doesn't change between snapshots, so deltas are small, and walking backwards
+from the newest snapshot never needs anything older than the step being
+taken. When the ring is full the oldest deltas are dropped.
+
+The input of every frame is kept alongside, so stepping back a single frame
+restores the nearest snapshot before it and re-emulates forward from there.
+*/
+typedef struct {
+	uint32_t interval;
+
+	// Newest snapshot, the input of each frame run since, and how many
+	nes_state_t *newest;
+	uint8_t *inputs;
+	uint32_t frames_since_newest;
+	bool has_newest;
+
+	// Memory pages written between the newest snapshot and the one before
+	uint64_t memory_dirty[DIRTY_WORDS(CPU_PAGES)];
+	uint64_t vmemory_dirty[DIRTY_WORDS(PPU_PAGES)];
+
+	// Scratch: the state being captured and a delta being encoded / decoded
+	nes_state_t *captured;
+	uint8_t *delta;
+
+	// Ring of [size][inputs][delta][size] entries, oldest at tail. The size
+	// is repeated at the end so the newest entry can be found from head
+	uint8_t *ring;
+	size_t capacity;
+	size_t head;
+	size_t tail;
+	size_t used;
+	uint32_t num_deltas;
+
+	// Statistics
+	uint64_t snapshots_taken;
+	uint64_t delta_bytes;
+	uint64_t capture_ns;
+} rewind_t;
+
+bool rewind_init(rewind_t *, size_t, uint32_t);
+void rewind_cleanup(rewind_t *);
+void rewind_reset(rewind_t *);
+
+void rewind_record_frame(rewind_t *, nes_t *);
+bool rewind_step_back(rewind_t *, nes_t *);
+
+void rewind_report(rewind_t *, FILE *);
+#endif // REWIND_INCLUDE
@@ -0,0 +1,112 @@
+#include "scheduler.h"
+#include "nes.h"
+#include <string.h>
+
+void scheduler_init(nes_scheduler_t *sched)
+{
+	sched->num_events = 0;
+	sched->next_clock = UINT64_MAX;
+	sched->frame_clock = 0;
+}
+
+static void scheduler_update_next_clock(nes_scheduler_t *sched)
+{
+	if (sched->num_events == 0) {
+		sched->next_clock = UINT64_MAX;
+	} else {
+		sched->next_clock = sched->events[sched->num_events - 1].clock;
+	}
+}
+
+void scheduler_cancel(nes_scheduler_t *sched, nes_event_type_t type)
+{
+	for (int i = 0; i < sched->num_events; i++) {
+		if (sched->events[i].type == type) {
+			memmove(&sched->events[i], &sched->events[i + 1],
+				(sched->num_events - i - 1) * sizeof(nes_event_t));
+			sched->num_events--;
+			scheduler_update_next_clock(sched);
+			return;
+		}
+	}
+}
+
+/*
+Schedules an event, replacing any pending event of the same type. Events due
+on the same clock are popped in the order they were added.
+*/
+void scheduler_add(nes_scheduler_t *sched, nes_event_type_t type, uint64_t clock)
+{
+	scheduler_cancel(sched, type);
+
+	int idx = sched->num_events;
+	while (idx > 0 && sched->events[idx - 1].clock <= clock) {
+		sched->events[idx] = sched->events[idx - 1];
+		idx--;
+	}
+
+	sched->events[idx].type = type;
+	sched->events[idx].clock = clock;
+	sched->num_events++;
+	scheduler_update_next_clock(sched);
+}
+
+bool scheduler_pop_due(nes_scheduler_t *sched, uint64_t clock, nes_event_t *event)
+{
+	if (sched->next_clock > clock) {
+		return false;
+	}
+
+	sched->num_events--;
+	*event = sched->events[sched->num_events];
+	scheduler_update_next_clock(sched);
+	return true;
+}
+
+void scheduler_start_frame(nes_scheduler_t *sched)
+{
+	sched->frame_clock += MASTER_CLOCK_CYCLES_PER_FRAME;
+}
+
+// Master clock a number of CPU cycles after clock, which must be on a CPU cycle
+uint64_t scheduler_add_cpu_cycles(uint64_t clock, uint64_t cpu_cycles)
+{
+	uint64_t frame_clock = clock - clock % MASTER_CLOCK_CYCLES_PER_FRAME;
+	uint64_t cpu_cycle = (clock - frame_clock) / MASTER_CLOCKS_PER_CPU_CLOCK + cpu_cycles;
+
+	return frame_clock
+		+ (cpu_cycle / CPU_CYCLES_PER_FRAME) * MASTER_CLOCK_CYCLES_PER_FRAME
+		+ (cpu_cycle % CPU_CYCLES_PER_FRAME) * MASTER_CLOCKS_PER_CPU_CLOCK;
+}
+
+// Master clock of a CPU cycle counted from the start of the current frame
+uint64_t scheduler_cpu_clock(nes_scheduler_t *sched, uint64_t cpu_cycle)
+{
+	return scheduler_add_cpu_cycles(sched->frame_clock, cpu_cycle);
+}
+
+// Master clock of a PPU dot counted from the start of the current frame
+uint64_t scheduler_ppu_clock(nes_scheduler_t *sched, uint64_t ppu_dot)
+{
+	return sched->frame_clock
+		+ (ppu_dot / PPU_DOTS_PER_FRAME) * MASTER_CLOCK_CYCLES_PER_FRAME
+		+ (ppu_dot % PPU_DOTS_PER_FRAME) * MASTER_CLOCKS_PER_PPU_CLOCK;
+}
+
+/*
+First CPU cycle of the current frame that is on or after clock, or
+CPU_CYCLES_PER_FRAME if clock is past the end of the frame
+*/
+uint32_t scheduler_cpu_cycle_at(nes_scheduler_t *sched, uint64_t clock)
+{
+	if (clock <= sched->frame_clock) {
+		return 0;
+	}
+
+	uint64_t frame_offset = clock - sched->frame_clock;
+	if (frame_offset >= MASTER_CLOCK_CYCLES_PER_FRAME) {
+		return CPU_CYCLES_PER_FRAME;
+	}
+
+	return (frame_offset + MASTER_CLOCKS_PER_CPU_CLOCK - 1) / MASTER_CLOCKS_PER_CPU_CLOCK;
+}
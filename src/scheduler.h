@@ -0,0 +1,50 @@
+#ifndef SCHEDULER_INCLUDE
+#define SCHEDULER_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Everything is timed on a 64-bit master clock. Every frame starts on a
+multiple of MASTER_CLOCK_CYCLES_PER_FRAME and the CPU / PPU restart their
+phase at each frame start, so CPU cycle n of a frame is at
+frame_clock + n * MASTER_CLOCKS_PER_CPU_CLOCK (and likewise for PPU dots).
+*/
+
+typedef enum {
+	EVENT_VBLANK_START = 0,
+	EVENT_VBLANK_END,
+	EVENT_OAM_DMA_END,
+	EVENT_APU_FRAME_IRQ,
+
+	NUM_EVENT_TYPES
+} nes_event_type_t;
+
+typedef struct {
+	nes_event_type_t type;
+	uint64_t clock;
+} nes_event_t;
+
+typedef struct __nes_scheduler {
+	// Pending events (at most one per type), sorted so the next one due is last
+	nes_event_t events[NUM_EVENT_TYPES];
+	int num_events;
+
+	// Clock of the next event due (or UINT64_MAX), this is the horizon the CPU
+	// can run up to without anything else needing to happen
+	uint64_t next_clock;
+
+	// Master clock the current frame started on
+	uint64_t frame_clock;
+} nes_scheduler_t;
+
+void scheduler_init(nes_scheduler_t *);
+void scheduler_add(nes_scheduler_t *, nes_event_type_t, uint64_t);
+void scheduler_cancel(nes_scheduler_t *, nes_event_type_t);
+bool scheduler_pop_due(nes_scheduler_t *, uint64_t, nes_event_t *);
+void scheduler_start_frame(nes_scheduler_t *);
+
+uint64_t scheduler_cpu_clock(nes_scheduler_t *, uint64_t);
+uint64_t scheduler_ppu_clock(nes_scheduler_t *, uint64_t);
+uint32_t scheduler_cpu_cycle_at(nes_scheduler_t *, uint64_t);
+uint64_t scheduler_add_cpu_cycles(uint64_t, uint64_t);
+#endif // SCHEDULER_INCLUDE
@@ -0,0 +1,460 @@
+#include "state.h"
+#include "utils.h"
+#include "lz.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct {
+	char tag[4];
+	size_t offset;
+	size_t size;
+} state_chunk_t;
+
+// Everything in nes_state_t, one chunk per component
+static const state_chunk_t chunks[] = {
+	{"CPU ", offsetof(nes_state_t, cpu), sizeof(nes_cpu_t)},
+	{"PPU ", offsetof(nes_state_t, ppu), sizeof(nes_ppu_t)},
+	{"APU ", offsetof(nes_state_t, apu), sizeof(nes_apu_t)},
+	{"SCHD", offsetof(nes_state_t, scheduler), sizeof(nes_scheduler_t)},
+	{"KEYS", offsetof(nes_state_t, key_state), sizeof(uint8_t)},
+	{"SKIP", offsetof(nes_state_t, skip_render), sizeof(bool)},
+	{"FRMS", offsetof(nes_state_t, frames), sizeof(uint64_t)},
+	{"RAM ", offsetof(nes_state_t, memory), ADDRESS_SPACE_SIZE_6502},
+	{"VRAM", offsetof(nes_state_t, vmemory), ADDRESS_SPACE_SIZE_2C02},
+};
+
+#define NUM_CHUNKS (sizeof(chunks) / sizeof(chunks[0]))
+
+static void state_save_components(nes_state_t *state, const nes_t *nes)
+{
+	state->cpu = nes->cpu;
+	// the cores don't all leave the same bytes behind for the same N and Z
+	cpu_normalize_nz(&state->cpu);
+	state->ppu = nes->ppu;
+	state->apu = nes->apu;
+	state->scheduler = nes->scheduler;
+
+	state->key_state = nes->key_state;
+	state->skip_render = nes->skip_render;
+	state->frames = nes->frames;
+}
+
+void state_save(nes_state_t *state, const nes_t *nes)
+{
+	state_save_components(state, nes);
+
+	memcpy(state->memory, nes->memory.data, ADDRESS_SPACE_SIZE_6502);
+	memcpy(state->vmemory, nes->vmemory.data, ADDRESS_SPACE_SIZE_2C02);
+}
+
+static void state_copy_pages(uint8_t *dest, const uint8_t *src, const uint64_t *pages, uint32_t num_pages)
+{
+	for (uint32_t page = 0; page < num_pages; page++) {
+		if (memory_page_dirty(pages, page)) {
+			memcpy(dest + page * MEMORY_PAGE_SIZE, src + page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+		}
+	}
+}
+
+/*
+Like state_save, but only copies the memory pages set in the given bitmaps:
+state has to already hold the rest from an earlier save of the same nes_t
+*/
+void state_save_pages(nes_state_t *state, const nes_t *nes, const uint64_t *memory_pages,
+	const uint64_t *vmemory_pages)
+{
+	state_save_components(state, nes);
+
+	state_copy_pages(state->memory, nes->memory.data, memory_pages, CPU_PAGES);
+	state_copy_pages(state->vmemory, nes->vmemory.data, vmemory_pages, PPU_PAGES);
+}
+
+/*
+Copies the components into nes, keeping the host pointers nes already has,
+so this works between different nes_t as well
+*/
+static void state_load_components(nes_t *nes, const nes_cpu_t *src_cpu, const nes_ppu_t *src_ppu,
+	const nes_apu_t *apu, const nes_scheduler_t *scheduler)
+{
+	nes_cpu_t cpu = *src_cpu;
+	cpu.mem = nes->cpu.mem;
+	cpu.ppu = nes->cpu.ppu;
+	cpu.apu = nes->cpu.apu;
+	cpu.scheduler = nes->cpu.scheduler;
+	#ifdef DEBUG
+	cpu.debug_file = nes->cpu.debug_file;
+	#endif
+	nes->cpu = cpu;
+
+	nes_ppu_t ppu = *src_ppu;
+	ppu.vmem = nes->ppu.vmem;
+	ppu.video_data = nes->ppu.video_data;
+	nes->ppu = ppu;
+
+	nes->apu = *apu;
+	nes->scheduler = *scheduler;
+}
+
+/*
+Whether a and b differ outside the two ranges games keep changing (see
+memory.h), given in order. Only then does loading one over the other have
+to move shared_writes, and throw away what was decoded or compiled from it.
+*/
+static bool state_shared_differs(const uint8_t *a, const uint8_t *b, uint32_t size,
+	uint32_t first_start, uint32_t first_size, uint32_t second_start, uint32_t second_size)
+{
+	uint32_t first_end = first_start + first_size;
+	uint32_t second_end = second_start + second_size;
+
+	return memcmp(a, b, first_start) != 0 ||
+		memcmp(a + first_end, b + first_end, second_start - first_end) != 0 ||
+		memcmp(a + second_end, b + second_end, size - second_end) != 0;
+}
+
+void state_load(const nes_state_t *state, nes_t *nes)
+{
+	state_load_components(nes, &state->cpu, &state->ppu, &state->apu, &state->scheduler);
+
+	nes->key_state = state->key_state;
+	nes->skip_render = state->skip_render;
+	nes->frames = state->frames;
+
+	// run-ahead, rewind and seeks mostly load states of the same ROM
+	if (state_shared_differs(nes->memory.data, state->memory, ADDRESS_SPACE_SIZE_6502,
+		0, CPU_RAM_SIZE, CPU_IO_START, CPU_IO_SIZE)) {
+		nes->memory.shared_writes++;
+	}
+	if (state_shared_differs(nes->vmemory.data, state->vmemory, ADDRESS_SPACE_SIZE_2C02,
+		PPU_NAMETABLES_START, PPU_NAMETABLES_SIZE, PPU_PALETTE_START, PPU_PALETTE_SIZE)) {
+		nes->vmemory.shared_writes++;
+	}
+
+	memcpy(nes->memory.data, state->memory, ADDRESS_SPACE_SIZE_6502);
+	memcpy(nes->vmemory.data, state->vmemory, ADDRESS_SPACE_SIZE_2C02);
+
+	// all of memory was just replaced
+	memory_mark_dirty(nes->memory.dirty, 0, ADDRESS_SPACE_SIZE_6502);
+	memory_mark_dirty(nes->vmemory.dirty, 0, ADDRESS_SPACE_SIZE_2C02);
+}
+
+/*
+Makes dst a copy of src that can run on independently (dst has to be set up
+with nes_init, and keeps its own callbacks and frame buffers). Normally only
+the mutable parts of memory are copied, a few KiB, while ROM and the rest
+stay as they were: the full address spaces are only copied when dst wasn't
+last cloned from this src with this ROM, or either side has written outside
+those parts since, and then dst takes on src's ROM (rom_hash included).
+The frame src had waiting to be presented isn't carried over.
+*/
+void nes_clone(nes_t *dst, const nes_t *src)
+{
+	const nes_clone_info_t *info = &dst->clone_info;
+	bool full_copy = info->source_id != src->instance_id ||
+		info->source_memory_writes != src->memory.shared_writes ||
+		info->source_vmemory_writes != src->vmemory.shared_writes ||
+		info->memory_writes != dst->memory.shared_writes ||
+		info->vmemory_writes != dst->vmemory.shared_writes;
+
+	state_load_components(dst, &src->cpu, &src->ppu, &src->apu, &src->scheduler);
+	dst->ppu.skip_render = true;
+
+	dst->key_state = src->key_state;
+	dst->skip_render = src->skip_render;
+	dst->frames = src->frames;
+
+	if (full_copy) {
+		// dst now runs src's ROM, movies recorded from it have to say so
+		dst->rom_header = src->rom_header;
+		dst->rom_info = src->rom_info;
+		dst->rom_hash = src->rom_hash;
+
+		free(dst->rom_data);
+		dst->rom_data = src->rom_data ? malloc(src->rom_info.prg_size) : NULL;
+		if (dst->rom_data) {
+			memcpy(dst->rom_data, src->rom_data, src->rom_info.prg_size);
+		} else if (src->rom_data) {
+			log_event("couldn't allocate rom data");
+		}
+
+		memcpy(dst->memory.data, src->memory.data, ADDRESS_SPACE_SIZE_6502);
+		memcpy(dst->vmemory.data, src->vmemory.data, ADDRESS_SPACE_SIZE_2C02);
+		memory_mark_dirty(dst->memory.dirty, 0, ADDRESS_SPACE_SIZE_6502);
+		memory_mark_dirty(dst->vmemory.dirty, 0, ADDRESS_SPACE_SIZE_2C02);
+
+		// everything dst had decoded or compiled came from what was just replaced
+		dst->memory.shared_writes++;
+		dst->vmemory.shared_writes++;
+
+		dst->clone_info = (nes_clone_info_t){
+			src->instance_id,
+			src->memory.shared_writes,
+			src->vmemory.shared_writes,
+			dst->memory.shared_writes,
+			dst->vmemory.shared_writes
+		};
+	} else {
+		memcpy(dst->memory.data, src->memory.data, CPU_RAM_SIZE);
+		memcpy(dst->memory.data + CPU_IO_START, src->memory.data + CPU_IO_START, CPU_IO_SIZE);
+
+		memcpy(dst->vmemory.data + PPU_NAMETABLES_START, src->vmemory.data + PPU_NAMETABLES_START,
+			PPU_NAMETABLES_SIZE);
+		memcpy(dst->vmemory.data + PPU_PALETTE_START, src->vmemory.data + PPU_PALETTE_START,
+			PPU_PALETTE_SIZE);
+
+		memory_mark_dirty(dst->memory.dirty, 0, CPU_RAM_SIZE);
+		memory_mark_dirty(dst->memory.dirty, CPU_IO_START, CPU_IO_SIZE);
+		memory_mark_dirty(dst->vmemory.dirty, PPU_NAMETABLES_START, PPU_NAMETABLES_SIZE);
+		memory_mark_dirty(dst->vmemory.dirty, PPU_PALETTE_START, PPU_PALETTE_SIZE);
+	}
+}
+
+size_t state_serialized_size(void)
+{
+	size_t size = sizeof(state_file_header_t);
+	for (size_t i = 0; i < NUM_CHUNKS; i++) {
+		size += sizeof(state_chunk_header_t) + chunks[i].size;
+	}
+
+	return size;
+}
+
+static void state_clear_component_pointers(nes_cpu_t *cpu, nes_ppu_t *ppu)
+{
+	cpu->mem = NULL;
+	cpu->ppu = NULL;
+	cpu->apu = NULL;
+	cpu->scheduler = NULL;
+	#ifdef DEBUG
+	cpu->debug_file = NULL;
+	#endif
+
+	ppu->vmem = NULL;
+	ppu->video_data = NULL;
+}
+
+/*
+Zeroes the host pointers a saved state carries along (state_load ignores
+them anyway), so states that are the same are also byte for byte the same
+*/
+void state_clear_host_pointers(nes_state_t *state)
+{
+	state_clear_component_pointers(&state->cpu, &state->ppu);
+}
+
+// out has to hold state_serialized_size() bytes
+void state_serialize(const nes_state_t *state, uint8_t *out)
+{
+	state_file_header_t header = {
+		STATE_FILE_MAGIC,
+		STATE_FILE_VERSION,
+		NUM_CHUNKS,
+		0
+	};
+	memcpy(out, &header, sizeof(header));
+	out += sizeof(header);
+
+	// host pointers would only make files differ between runs
+	nes_cpu_t cpu = state->cpu;
+	nes_ppu_t ppu = state->ppu;
+	state_clear_component_pointers(&cpu, &ppu);
+
+	for (size_t i = 0; i < NUM_CHUNKS; i++) {
+		const void *data = (const uint8_t *)state + chunks[i].offset;
+		if (chunks[i].offset == offsetof(nes_state_t, cpu)) {
+			data = &cpu;
+		} else if (chunks[i].offset == offsetof(nes_state_t, ppu)) {
+			data = &ppu;
+		}
+
+		state_chunk_header_t chunk_header;
+		memcpy(chunk_header.tag, chunks[i].tag, sizeof(chunk_header.tag));
+		chunk_header.size = chunks[i].size;
+
+		memcpy(out, &chunk_header, sizeof(chunk_header));
+		out += sizeof(chunk_header);
+		memcpy(out, data, chunks[i].size);
+		out += chunks[i].size;
+	}
+}
+
+static bool state_deserialize_chunks(nes_state_t *state, const uint8_t *in, size_t size)
+{
+	state_file_header_t header;
+	if (size < sizeof(header)) {
+		log_event("Savestate is truncated!");
+		return false;
+	}
+	memcpy(&header, in, sizeof(header));
+
+	if (memcmp(header.magic, STATE_FILE_MAGIC, sizeof(header.magic)) != 0) {
+		log_event("Not a savestate!");
+		return false;
+	}
+
+	if (header.version != STATE_FILE_VERSION) {
+		log_event("Savestate version %u isn't supported (expected %u)", header.version, STATE_FILE_VERSION);
+		return false;
+	}
+
+	bool found[NUM_CHUNKS] = {0};
+	size_t pos = sizeof(header);
+
+	for (uint32_t n = 0; n < header.num_chunks; n++) {
+		state_chunk_header_t chunk_header;
+		if (size - pos < sizeof(chunk_header)) {
+			log_event("Savestate is truncated!");
+			return false;
+		}
+		memcpy(&chunk_header, in + pos, sizeof(chunk_header));
+		pos += sizeof(chunk_header);
+
+		if (size - pos < chunk_header.size) {
+			log_event("Savestate is truncated!");
+			return false;
+		}
+
+		for (size_t i = 0; i < NUM_CHUNKS; i++) {
+			if (memcmp(chunk_header.tag, chunks[i].tag, sizeof(chunk_header.tag)) != 0) {
+				continue;
+			}
+
+			if (chunk_header.size != chunks[i].size) {
+				log_event("Savestate chunk '%.4s' is %u bytes, expected %zu",
+					chunk_header.tag, chunk_header.size, chunks[i].size);
+				return false;
+			}
+
+			memcpy((uint8_t *)state + chunks[i].offset, in + pos, chunks[i].size);
+			found[i] = true;
+			break;
+		}
+
+		pos += chunk_header.size;
+	}
+
+	for (size_t i = 0; i < NUM_CHUNKS; i++) {
+		if (!found[i]) {
+			log_event("Savestate is missing chunk '%.4s'", chunks[i].tag);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+Fills state from a serialized savestate, compressed or not. On failure state
+is left partly written, so callers deserialize into a scratch state first
+*/
+bool state_deserialize(nes_state_t *state, const uint8_t *in, size_t size)
+{
+	state_compressed_header_t header;
+	if (size < sizeof(header) || memcmp(in, STATE_COMPRESSED_MAGIC, sizeof(header.magic)) != 0) {
+		return state_deserialize_chunks(state, in, size);
+	}
+	memcpy(&header, in, sizeof(header));
+
+	if (header.size > STATE_MAX_UNCOMPRESSED_SIZE) {
+		log_event("Compressed savestate claims to be %u bytes!", header.size);
+		return false;
+	}
+
+	uint8_t *data = malloc(header.size);
+	if (!data) {
+		log_event("Could not allocate savestate!");
+		return false;
+	}
+
+	bool code = lz_decompress(in + sizeof(header), size - sizeof(header), data, header.size);
+	if (code) {
+		code = state_deserialize_chunks(state, data, header.size);
+	} else {
+		log_event("Compressed savestate is corrupt!");
+	}
+
+	free(data);
+	return code;
+}
+
+size_t state_compressed_bound(void)
+{
+	return sizeof(state_compressed_header_t) + lz_compress_bound(state_serialized_size());
+}
+
+/*
+Compresses a state serialized by state_serialize. out has to hold
+state_compressed_bound() bytes, returns the compressed size
+*/
+size_t state_compress(const uint8_t *serialized, uint8_t *out)
+{
+	state_compressed_header_t header = {
+		STATE_COMPRESSED_MAGIC,
+		state_serialized_size()
+	};
+	memcpy(out, &header, sizeof(header));
+
+	return sizeof(header) + lz_compress(serialized, header.size, out + sizeof(header));
+}
+
+bool nes_save_state(nes_t *nes, const char *path)
+{
+	nes_state_t *state = malloc(sizeof(nes_state_t));
+	uint8_t *serialized = malloc(state_serialized_size());
+	uint8_t *data = malloc(state_compressed_bound());
+	bool code = false;
+
+	if (!state || !serialized || !data) {
+		log_event("Could not allocate savestate!");
+		goto done;
+	}
+
+	state_save(state, nes);
+	state_serialize(state, serialized);
+	size_t size = state_compress(serialized, data);
+
+	FILE *handle = fopen(path, "wb");
+	if (!handle) {
+		log_event("Could not open savestate file %s", path);
+		goto done;
+	}
+
+	code = fwrite(data, sizeof(uint8_t), size, handle) == size;
+	if (fclose(handle) != 0) {
+		code = false;
+	}
+	if (!code) {
+		log_event("Could not write savestate file %s", path);
+	}
+
+done:
+	free(state);
+	free(serialized);
+	free(data);
+	return code;
+}
+
+// Leaves nes untouched if the file can't be loaded
+bool nes_load_state(nes_t *nes, const char *path)
+{
+	size_t size;
+	uint8_t *data = read_file(path, &size);
+	if (!data) {
+		log_event("Could not read savestate file %s", path);
+		return false;
+	}
+
+	nes_state_t *state = malloc(sizeof(nes_state_t));
+	bool code = state && state_deserialize(state, data, size);
+	if (code) {
+		state_load(state, nes);
+
+		// the frame that was waiting to be presented isn't part of the state
+		nes->ppu.skip_render = true;
+	}
+
+	free(state);
+	free(data);
+	return code;
+}
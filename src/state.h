@@ -0,0 +1,81 @@
+#ifndef STATE_INCLUDE
+#define STATE_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include "nes.h"
+
+/*
+The complete emulation state of a nes_t as one flat, fixed size struct, so a
+single preallocated nes_state_t can be saved into and loaded from any number
+of times without allocating. Host pointers (component handles, frame buffers,
+callbacks, the ROM copy) are not part of the state: loading keeps the ones the
+target nes_t already has.
+*/
+struct nes_state {
+	nes_cpu_t cpu;
+	nes_ppu_t ppu;
+	nes_apu_t apu;
+	nes_scheduler_t scheduler;
+
+	uint8_t key_state;
+	bool skip_render;
+	uint64_t frames;
+
+	uint8_t memory[ADDRESS_SPACE_SIZE_6502];
+	uint8_t vmemory[ADDRESS_SPACE_SIZE_2C02];
+};
+
+/*
+Savestate files are a header followed by chunks, each a four character tag,
+a u32 size and the data. The data of every chunk is the raw, fixed layout
+struct (or memory region) it holds, so loading one is a size check and a
+memcpy. Host pointers are zeroed on save. The layout is the host's, a file
+only loads into a build whose chunk sizes match it; bump the version when a
+layout changes without its size changing. Unknown chunks are skipped.
+*/
+#define STATE_FILE_MAGIC "NESS"
+#define STATE_FILE_VERSION 2
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t num_chunks;
+	uint32_t reserved;
+} state_file_header_t;
+
+typedef struct {
+	char tag[4];
+	uint32_t size;
+} state_chunk_header_t;
+
+/*
+Compressed savestates (what nes_save_state writes) wrap a whole savestate:
+the magic "NESZ" and its uncompressed size, followed by it as one LZ block.
+state_deserialize takes either form.
+*/
+#define STATE_COMPRESSED_MAGIC "NESZ"
+
+// Far above any real savestate, so a corrupt size can't ask for gigabytes
+#define STATE_MAX_UNCOMPRESSED_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+	char magic[4];
+	uint32_t size;
+} state_compressed_header_t;
+
+void state_save(nes_state_t *, const nes_t *);
+void state_save_pages(nes_state_t *, const nes_t *, const uint64_t *, const uint64_t *);
+void state_load(const nes_state_t *, nes_t *);
+void state_clear_host_pointers(nes_state_t *);
+void nes_clone(nes_t *, const nes_t *);
+
+size_t state_serialized_size(void);
+void state_serialize(const nes_state_t *, uint8_t *);
+bool state_deserialize(nes_state_t *, const uint8_t *, size_t);
+
+size_t state_compressed_bound(void);
+size_t state_compress(const uint8_t *, uint8_t *);
+
+bool nes_save_state(nes_t *, const char *);
+bool nes_load_state(nes_t *, const char *);
+#endif // STATE_INCLUDE
@@ -0,0 +1,63 @@
+#include "triple_buffer.h"
+#include <stdlib.h>
+
+bool triple_buffer_init(triple_buffer_t *tb, size_t buffer_size)
+{
+	tb->buffer_size = buffer_size;
+	for (int i = 0; i < 3; i++) {
+		tb->buffers[i] = calloc(1, buffer_size);
+		if (!tb->buffers[i]) {
+			triple_buffer_cleanup(tb);
+			return false;
+		}
+	}
+
+	tb->back = 0;
+	atomic_init(&tb->middle, 1);
+	tb->front = 2;
+
+	return true;
+}
+
+void triple_buffer_cleanup(triple_buffer_t *tb)
+{
+	for (int i = 0; i < 3; i++) {
+		free(tb->buffers[i]);
+		tb->buffers[i] = NULL;
+	}
+}
+
+void *triple_buffer_back(triple_buffer_t *tb)
+{
+	return tb->buffers[tb->back];
+}
+
+// Hands the back buffer to the consumer and takes the middle one to write next
+void triple_buffer_publish(triple_buffer_t *tb)
+{
+	uint32_t old_middle = atomic_exchange_explicit(&tb->middle,
+		tb->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+
+	tb->back = old_middle & TRIPLE_BUFFER_INDEX_MASK;
+}
+
+/*
+Takes the most recently published buffer as the new front buffer. Returns
+false (keeping the current front buffer) if nothing new was published.
+*/
+bool triple_buffer_acquire(triple_buffer_t *tb)
+{
+	if (!(atomic_load_explicit(&tb->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH)) {
+		return false;
+	}
+
+	uint32_t old_middle = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+	tb->front = old_middle & TRIPLE_BUFFER_INDEX_MASK;
+
+	return true;
+}
+
+const void *triple_buffer_front(triple_buffer_t *tb)
+{
+	return tb->buffers[tb->front];
+}
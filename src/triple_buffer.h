@@ -0,0 +1,40 @@
+#ifndef TRIPLE_BUFFER_INCLUDE
+#define TRIPLE_BUFFER_INCLUDE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+Lock-free single producer / single consumer triple buffer. The producer always
+has a back buffer to write to and the consumer always has a front buffer to
+read from, the third buffer sits in the middle and is swapped with either side
+by a single atomic exchange. Neither side ever waits on the other; a consumer
+that falls behind just skips to the newest buffer.
+*/
+
+// Set in middle when the producer has published a buffer the consumer hasn't
+// taken yet
+#define TRIPLE_BUFFER_FRESH 0x4
+#define TRIPLE_BUFFER_INDEX_MASK 0x3
+
+typedef struct {
+	void *buffers[3];
+	size_t buffer_size;
+
+	_Atomic uint32_t middle;
+
+	// Owned by the producer / consumer respectively
+	uint32_t back;
+	uint32_t front;
+} triple_buffer_t;
+
+bool triple_buffer_init(triple_buffer_t *, size_t);
+void triple_buffer_cleanup(triple_buffer_t *);
+
+void *triple_buffer_back(triple_buffer_t *);
+void triple_buffer_publish(triple_buffer_t *);
+
+bool triple_buffer_acquire(triple_buffer_t *);
+const void *triple_buffer_front(triple_buffer_t *);
+#endif // TRIPLE_BUFFER_INCLUDE
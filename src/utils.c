@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <SDL3/SDL.h>
+#include <stdarg.h>
+#include <string.h>
 #include <time.h>
 #include "utils.h"
 #include "utils_platform.h"
@@ -50,25 +51,6 @@ void log_event(const char *message, ...)
 	fputc('\n', stdout);
 }
 
-void handle_keypress(SDL_Event *event, uint8_t *key_state)
-{
-	static const SDL_Keycode keys[] = {SDLK_A, SDLK_S, SDLK_O, SDLK_P, SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT};
-	
-	SDL_Keycode pressed_key = event->key.key;
-	bool key_down = event->key.type == SDL_EVENT_KEY_DOWN;
-
-	uint8_t temp_key_state = *key_state;
-
-	for (int idx = 0; idx < 8; idx++) {
-		if (pressed_key == keys[idx]) {
-			temp_key_state ^= (-key_down ^ temp_key_state) & (1UL << idx);
-			break;
-		}
-	}
-
-	*key_state = temp_key_state;
-}
-
 bool read_bytes(void *addr, uint32_t num_bytes, uint32_t offset, FILE *file)
 {
 	long int orig = ftell(file);
@@ -83,6 +65,56 @@ bool read_bytes(void *addr, uint32_t num_bytes, uint32_t offset, FILE *file)
 	return result == (sizeof(uint8_t) * num_bytes);
 }
 
+// 64-bit FNV-1a, for telling ROMs and states apart (not for security)
+uint64_t hash_bytes(const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+Reads a whole file into a malloc'd buffer, which the caller frees
+*/
+uint8_t *read_file(const char *path, size_t *size)
+{
+	FILE *handle = fopen(path, "rb");
+	if (!handle) {
+		return NULL;
+	}
+
+	uint8_t *data = NULL;
+	if (fseek(handle, 0, SEEK_END) != 0) {
+		goto done;
+	}
+
+	long file_size = ftell(handle);
+	if (file_size <= 0) {
+		goto done;
+	}
+	rewind(handle);
+
+	data = malloc(file_size);
+	if (!data) {
+		goto done;
+	}
+
+	if (fread(data, sizeof(uint8_t), file_size, handle) != (size_t)file_size) {
+		free(data);
+		data = NULL;
+		goto done;
+	}
+	*size = file_size;
+
+done:
+	fclose(handle);
+	return data;
+}
+
 static uint32_t bswap32(uint32_t x)
 {
 	return
@@ -99,16 +131,16 @@ static inline uint8_t __get_bit_8(uint8_t byte, int bit)
 
 #define INES_ROM_MAGIC 0x4E45531A
 
-bool get_rom_info(FILE *handle, ines_rom_header_t *header, nes_rom_info_t *rom)
+bool get_rom_info(const uint8_t *data, size_t size, ines_rom_header_t *header, nes_rom_info_t *rom)
 {
-	if (!handle || !header || !rom)
+	if (!data || !header || !rom)
 		return false;
 
-	int result = read_bytes(header, sizeof(header), 0, handle);
-	if (!result) {
+	if (size < sizeof(*header)) {
 		log_event("Error getting ROM header");
 		return false;
 	}
+	memcpy(header, data, sizeof(*header));
 
 	uint32_t rom_magic_swapped = bswap32(header->magic);
 
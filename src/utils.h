@@ -5,8 +5,6 @@
 #include <stdbool.h>
 #include "memory.h"
 
-union SDL_Event;
-
 typedef struct {
     uint32_t magic;
     uint8_t PRG_ROM_size;
@@ -30,8 +28,9 @@ typedef struct {
 } nes_rom_info_t;
 
 bool read_bytes(void *, uint32_t, uint32_t, FILE *);
-bool get_rom_info(FILE *, ines_rom_header_t *, nes_rom_info_t *);
-void handle_keypress(union SDL_Event *, uint8_t *);
+uint8_t *read_file(const char *, size_t *);
+uint64_t hash_bytes(const void *, size_t);
+bool get_rom_info(const uint8_t *, size_t, ines_rom_header_t *, nes_rom_info_t *);
 void exit_with_error(int, const char *, ...);
 void log_event(const char *, ...);
 bool byte_to_binary_str(char *, size_t, uint8_t);
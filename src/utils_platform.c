@@ -1,3 +1,8 @@
+#ifdef NESEMU_LINUX
+// clock_gettime / clock_nanosleep are POSIX, which a strict -std=c23 build hides
+#define _POSIX_C_SOURCE 200112L
+#endif
+#include <errno.h>
 #include <stdint.h>
 #include "utils_platform.h"
 
@@ -44,3 +49,70 @@ precise_time_t get_precise_time()
 	#error Unknown platform for get_precise_time
 #endif
 }
+
+#ifdef NESEMU_WINDOWS
+static uint64_t get_monotonic_ns_win32(void)
+{
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+	uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+	return seconds * 1000000000ULL + remainder * 1000000000ULL / frequency.QuadPart;
+}
+#endif
+
+// Nanoseconds on a clock that never jumps, for measuring and pacing
+uint64_t get_monotonic_ns()
+{
+#ifdef NESEMU_WINDOWS
+	return get_monotonic_ns_win32();
+#elif defined NESEMU_MACOS || defined NESEMU_LINUX
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+	#error Unknown platform for get_monotonic_ns
+#endif
+}
+
+/*
+Sleeps until get_monotonic_ns() reaches deadline (or a little after, the OS
+decides). Linux sleeps on the absolute deadline so time spent being woken up
+late doesn't add up, other platforms have to use a relative sleep.
+*/
+void sleep_until_monotonic_ns(uint64_t deadline)
+{
+#ifdef NESEMU_LINUX
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+
+	int result;
+	do {
+		// interrupted by a signal, go back to sleep. Any other error can't
+		// go away by retrying, so it just ends the sleep early
+		result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	} while (result == EINTR);
+#else
+	uint64_t now = get_monotonic_ns();
+	if (now >= deadline) {
+		return;
+	}
+
+	#ifdef NESEMU_WINDOWS
+	Sleep((DWORD)((deadline - now) / 1000000ULL));
+	#else
+	struct timespec ts;
+	ts.tv_sec = (deadline - now) / 1000000000ULL;
+	ts.tv_nsec = (deadline - now) % 1000000000ULL;
+	nanosleep(&ts, NULL);
+	#endif
+#endif
+}
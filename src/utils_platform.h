@@ -1,5 +1,6 @@
 #ifndef UTILS_PLATFORM_INCLUDE
 #define UTILS_PLATFORM_INCLUDE
+#include <stdint.h>
 #include <time.h>
 typedef struct {
 	time_t time;
@@ -7,5 +8,7 @@ typedef struct {
 } precise_time_t;
 
 precise_time_t get_precise_time();
+uint64_t get_monotonic_ns();
+void sleep_until_monotonic_ns(uint64_t);
 
 #endif // UTILS_PLATFORM_INCLUDE